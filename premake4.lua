@@ -43,7 +43,8 @@ JUCEDefines = {"JUCE_ASIO=0", "JUCE_DIRECTSOUND=0", "JUCE_JACK=0",
 JUCELinuxLinks = {"freetype", "pthread", "rt", "X11", "GL", "GLU", "Xinerama",
                   "asound"}
                   
-ExtendedLinks = {"fftw3", "sndfile", "fftw3_threads", "m", "pthread"}
+ExtendedLinks = {"fftw3", "fftw3f", "sndfile", "fftw3_threads",
+                 "fftw3f_threads", "m", "pthread"}
 
 --------------------------------------------------------------------------------
 --                                  Paths
@@ -309,6 +310,52 @@ project(ProjectName)
 
 print("")
 
+--------------------------------------------------------------------------------
+--                                 libbrick
+--------------------------------------------------------------------------------
+
+--[[The C interface for resampling caller-owned buffers in memory. Programs that
+link it also link the Belle, Bonne, Sage and JUCE libraries and the extended
+links, the same as Brick.]]
+ProjectName = "libbrick"
+PathToProject = PathToSrc
+PathToLibBrick = PathToSrc .. "lib/"
+
+project(ProjectName)
+  uuid(GenerateUUID())
+  language "C++"
+  kind "StaticLib"
+  flags {"StaticRuntime", "ExtraWarnings"}
+  defines(ExtendedDefines)
+  includedirs(ExtendedIncludePath)
+  files {FromRoot(PathToLibBrick) .. "*.cpp",
+         FromRoot(PathToLibBrick) .. "*.h",
+         FromRoot(PathToProject) .. "StreamingResampler.*",
+         FromRoot(PathToProject) .. "Kaiser.*",
+         FromRoot(PathToProject) .. "Kernels.h"}
+  includedirs {FromRoot(PathToPrim), FromRoot(PathToProject)}
+  objdir(FromRoot(PathToObj) .. ProjectName)
+  targetdir(FromRoot(PathToLib))
+  targetname("brick")
+  defines(JUCEDefines)
+  
+  --Build for as many versions of Mac OS X as possible.
+  configuration "xcode3"
+    buildoptions(BuildFor10_4MacOSXSystems)
+  
+  --Build position-independent code so that it can go into shared objects.
+  configuration "gmake"
+    buildoptions({"-fPIC"})
+  
+  configuration "linux"
+    defines("PRIM_LINUX")
+  configuration "windows" defines("PRIM_WINDOWS")
+  configuration "macosx" defines("PRIM_MACOSX")
+  configuration "Debug" flags(DebugFlags)
+  configuration "Release" flags(ReleaseFlags)
+
+print("")
+
 --------------------------------------------------------------------------------
 --                                 Cleanup
 --------------------------------------------------------------------------------
@@ -0,0 +1,280 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#include "Batch.h"
+
+#include "FileIO.h"
+#include "FilterCache.h"
+#include "Pipe.h"
+
+void BatchRunner::run(void)
+{
+  int64 Job;
+  while(b->TakeJob(Job))
+    b->RunJob(Job);
+}
+
+bool Batch::Load(const String& Manifest, const Parameters& Settings)
+{
+  Console c;
+  juce::File f(Manifest.Merge());
+  if(!f.existsAsFile())
+  {
+    c += "The batch manifest '"; c &= Manifest; c &= "' could not be found.";
+    return false;
+  }
+  
+  juce::StringArray Lines;
+  Lines.addLines(f.loadFileAsString());
+  for(int i = 0; i < Lines.size(); i++)
+  {
+    juce::String Line = Lines[i].trim();
+    if(Line.isEmpty() || Line.startsWithChar('#'))
+      continue;
+    
+    juce::StringArray Names;
+    Names.addTokens(Line, " \t", "\"");
+    Names.removeEmptyStrings();
+    if(Names.size() != 2)
+    {
+      c += "Line "; c &= (integer)(i + 1); c &= " of the batch manifest must "
+        "name one input file and one output file.";
+      return false;
+    }
+    
+    BatchJob& j = Jobs.Add();
+    j.Settings = Settings;
+    j.Settings.InputFilename = Names[0].unquoted().toUTF8();
+    j.Settings.OutputFilename = Names[1].unquoted().toUTF8();
+  }
+  
+  if(!Jobs.n())
+  {
+    c += "The batch manifest does not list any files.";
+    return false;
+  }
+  return true;
+}
+
+bool Batch::Plan(void)
+{
+  Console c;
+  FileIO fio;
+  
+  //Share the CPUs between the jobs that run at once.
+  Runners = math::Max((int64)1, math::Min(Runners, (int64)Jobs.n()));
+  CoresPerJob = math::Max((int64)1, Threads / Runners);
+  if(MemoryBudget <= 0)
+    MemoryBudget = (int64)juce::SystemStats::getMemorySizeInMegabytes() *
+      1024 * 1024 / 2;
+  
+  List<BatchJob> Planned;
+  List<int64> GroupP, GroupQ;
+  for(count i = 0; i < Jobs.n(); i++)
+  {
+    BatchJob& j = Jobs[i];
+    Parameters& p = j.Settings;
+    
+    /*Streams can only be read once, and raw input and spectrograms take
+    options of their own, so these are left to single conversions.*/
+    if(Pipe::IsPipe(p.InputFilename) || Pipe::IsPipe(p.OutputFilename) ||
+      p.InputFilename.Suffix(4) == ".raw" ||
+      p.OutputFilename.Suffix(4) == ".png" ||
+      p.OutputFilename.Suffix(4) == ".jpg")
+    {
+      c += "Skipping '"; c &= p.InputFilename; c &= "': a batch only "
+        "converts audio files to audio files.";
+      Skipped++;
+      continue;
+    }
+    
+    //Read the rate, channels and length of the input from its header.
+    SF_INFO s_info;
+    Memory::ClearObject(s_info);
+    SNDFILE* s = sf_open(p.InputFilename, SFM_READ, &s_info);
+    if(!s)
+    {
+      c += "Skipping '"; c &= p.InputFilename; c &= "': it could not be "
+        "opened.";
+      Skipped++;
+      continue;
+    }
+    sf_close(s);
+    
+    /*Plan the job with the same derivation as FileIO::Go, on a copy, sharing
+    the machine with the jobs that run alongside it.*/
+    Parameters d = p;
+    d.Channels = s_info.channels;
+    d.Frames = (int64)s_info.frames;
+    d.Streaming = false;
+    d.ConvolveHandle = 0;
+    d.Cores = CoresPerJob;
+    d.MaxScratchSize = MemoryBudget / Runners;
+    if(!fio.PlanConversion(d, (int64)s_info.samplerate,
+      fio.GetSampleType(s_info)))
+    {
+      c += "Skipping '"; c &= p.InputFilename; c &= "'.";
+      Skipped++;
+      continue;
+    }
+    j.P = d.P;
+    j.Q = d.Q;
+    j.Memory = d.EstimateMemory();
+    if(!d.SkipFilter && !d.Cascaded)
+      j.FilterKey = d.FilterKey();
+    
+    //Jobs with the same rate change make up a group.
+    j.Group = -1;
+    for(count g = 0; g < GroupP.n() && j.Group < 0; g++)
+      if(GroupP[g] == j.P && GroupQ[g] == j.Q)
+        j.Group = g;
+    if(j.Group < 0)
+    {
+      j.Group = GroupP.n();
+      GroupP.Add() = j.P;
+      GroupQ.Add() = j.Q;
+    }
+    Planned.Add() = j;
+  }
+  
+  //Run the jobs group by group, each group in the order of the manifest.
+  Jobs.RemoveAll();
+  GroupJobs.RemoveAll();
+  for(count g = 0; g < GroupP.n(); g++)
+  {
+    int64& Count = GroupJobs.Add();
+    Count = 0;
+    for(count i = 0; i < Planned.n(); i++)
+    {
+      if(Planned[i].Group != g)
+        continue;
+      Jobs.Add() = Planned[i];
+      Count++;
+    }
+  }
+  
+  c++;
+  c += "Batch Information";
+  c += "----------------------------------------------------------------------";
+  c += "Jobs: "; c &= (integer)Jobs.n();
+  c += "Skipped: "; c &= Skipped;
+  c += "Groups (Rate Changes): "; c &= (integer)GroupJobs.n();
+  c += "Jobs At Once: "; c &= Runners;
+  c += "Threads Per Job: "; c &= CoresPerJob;
+  c += "Memory Budget: "; c &= (number)MemoryBudget / (number)(1024 * 1024);
+    c &= " MB";
+  c++;
+  return Jobs.n() > 0;
+}
+
+bool Batch::Go(void)
+{
+  Console c;
+  
+  //Filters are shared within a group, and let go once the group is done.
+  FilterCache::Enabled = true;
+  BatchRunner* r = new BatchRunner[Runners];
+  for(int64 i = 0; i < Runners; i++)
+  {
+    r[i].b = this;
+    r[i].startThread();
+  }
+  for(int64 i = 0; i < Runners; i++)
+    r[i].waitForThreadToExit(-1);
+  delete [] r;
+  FilterCache::Trim();
+  FilterCache::Enabled = false;
+  
+  c++;
+  c += "Batch Summary";
+  c += "----------------------------------------------------------------------";
+  c += "Converted: "; c &= Converted;
+  c += "Failed: "; c &= Failed;
+  c += "Skipped: "; c &= Skipped;
+  return Failed == 0 && Skipped == 0;
+}
+
+bool Batch::TakeJob(int64& Job)
+{
+  for(;;)
+  {
+    {
+      const juce::ScopedLock sl(Lock);
+      if(NextJob >= (int64)Jobs.n())
+        return false;
+      
+      /*A job that needs more than the whole budget still runs, but only once
+      nothing else is running.*/
+      int64 Memory = Jobs[(count)NextJob].Memory;
+      if(!Running || MemoryInUse + Memory <= MemoryBudget)
+      {
+        Job = NextJob++;
+        Running++;
+        MemoryInUse += Memory;
+        return true;
+      }
+    }
+    JobFinished.wait(100);
+  }
+}
+
+void Batch::RunJob(int64 Job)
+{
+  BatchJob& j = Jobs[(count)Job];
+  Parameters p = j.Settings;
+  p.Cores = CoresPerJob;
+  p.MaxScratchSize = MemoryBudget / Runners;
+  {
+    Console c;
+    c += "Job "; c &= Job + 1; c &= "/"; c &= (integer)Jobs.n(); c &= ": '";
+    c &= p.InputFilename; c &= "' to '"; c &= p.OutputFilename; c &= "'";
+  }
+  
+  FileIO fio;
+  fio.Go(p);
+  
+  const juce::ScopedLock sl(Lock);
+  Running--;
+  MemoryInUse -= j.Memory;
+  if(fio.Completed)
+    Converted++;
+  else
+  {
+    Console c;
+    c += "Job "; c &= Job + 1; c &= " ('"; c &= p.InputFilename;
+    c &= "') failed.";
+    Failed++;
+  }
+  if(--GroupJobs[(count)j.Group] == 0)
+  {
+    for(count i = 0; i < Jobs.n(); i++)
+      if(Jobs[i].Group == j.Group && Jobs[i].FilterKey)
+        FilterCache::Trim(Jobs[i].FilterKey);
+  }
+  JobFinished.signal();
+}
@@ -0,0 +1,133 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "Libraries.h"
+#include "Parameters.h"
+
+struct Batch;
+
+///One conversion of a batch: an input file, its output file and its settings.
+struct BatchJob
+{
+  Parameters Settings;
+  
+  ///Rate change of the job, and the group of jobs with the same one.
+  int64 P;
+  int64 Q;
+  int64 Group;
+  
+  ///Key of the filter the job keeps in the filter cache (empty if none).
+  String FilterKey;
+  
+  ///Bytes of memory the job is estimated to take while it runs.
+  int64 Memory;
+  
+  BatchJob() : P(1), Q(1), Group(0), Memory(0) {}
+};
+
+///Runs the jobs of a batch one after another until there are none left.
+struct BatchRunner : public juce::Thread
+{
+  Batch* b;
+  
+  BatchRunner() : juce::Thread("BrickBatchThread"), b(0) {}
+  
+  void run(void);
+};
+
+/**Converts the files listed in a manifest in one process, so that FFTW, the
+wisdom and JUCE are started only once. Jobs with the same rate change (and so
+the same filter, since the depth and bandwidth are those of the whole batch)
+are run next to each other: the first of a group designs the filter and keeps
+it in the filter cache for the rest, and their FFTs are planned from the wisdom
+the first gathered. The jobs are run by several runners at once, which share
+the CPUs between them, and a job only starts once its memory fits in what the
+running jobs leave of the memory budget.*/
+struct Batch
+{
+  List<BatchJob> Jobs;
+  
+  /**Jobs left in each group, to know when its filters can be let go. Only the
+  filters of a finished group are freed, since the jobs of the next group may
+  already be running alongside its last ones, with filters of their own.*/
+  List<int64> GroupJobs;
+  
+  ///CPUs to keep busy, jobs to run at once, and the CPUs of each job.
+  int64 Threads;
+  int64 Runners;
+  int64 CoresPerJob;
+  
+  ///Bytes of memory the running jobs may take together, and take now.
+  int64 MemoryBudget;
+  int64 MemoryInUse;
+  
+  /**Next job to start, jobs running, and how the finished ones went: those
+  whose output was written, and those that stopped or could not be rendered.
+  Jobs that could not be planned are skipped.*/
+  int64 NextJob;
+  int64 Running;
+  int64 Converted;
+  int64 Failed;
+  int64 Skipped;
+  
+  juce::CriticalSection Lock;
+  
+  ///Signaled when a job finishes and its memory is given back.
+  juce::WaitableEvent JobFinished;
+  
+  Batch() : Threads(1), Runners(1), CoresPerJob(1), MemoryBudget(0),
+    MemoryInUse(0), NextJob(0), Running(0), Converted(0), Failed(0),
+    Skipped(0) {}
+  
+  /**Reads the manifest, which lists a job per line: the input file and then
+  the output file, separated by spaces or tabs (with double quotes around a
+  name that has spaces in it). Blank lines and lines starting with '#' are
+  skipped. Each job starts from the settings of the batch. Returns false if
+  the manifest could not be read or a line is not understood.*/
+  bool Load(const String& Manifest, const Parameters& Settings);
+  
+  /**Reads the rate and length of each input, orders the jobs by group, and
+  estimates the memory of each. Threads and Runners should be set first, and
+  if MemoryBudget is zero, half of the memory of the machine is used.*/
+  bool Plan(void);
+  
+  ///Runs all the jobs, and returns whether every one of them was converted.
+  bool Go(void);
+  
+  /**Takes the next job once there is memory for it. Returns false once every
+  job has been started.*/
+  bool TakeJob(int64& Job);
+  
+  ///Converts a job, and gives its memory back.
+  void RunJob(int64 Job);
+};
+
+#endif
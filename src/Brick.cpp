@@ -26,7 +26,9 @@
   ==============================================================================
 */
 
+#include "Batch.h"
 #include "FileIO.h"
+#include "FilterCache.h"
 #include "Globals.h"
 #include "Kaiser.h"
 #include "Parameters.h"
@@ -82,6 +84,9 @@ void DoWisdom(Wisdom& w, GlobalInfo& g, FFTMultithread*& fftm)
     if(!fftm)
       fftm = new FFTMultithread;
     w.LoadWisdomFromCache();
+    
+    //Filters designed by earlier runs are stored next to the wisdom.
+    FilterCache::Folder = w.GetFilterFolder();
   }
   
   if(g.IsSpecified("acquirewisdom"))
@@ -98,129 +103,16 @@ void DoWisdom(Wisdom& w, GlobalInfo& g, FFTMultithread*& fftm)
   }
 }
 
-void CommandLine(prim::List<prim::String>& Arguments)
+/**Works out from the names of the files whether the input is raw and whether
+the output is a spectrogram, and reads the options these need.*/
+bool SetFileParameters(GlobalInfo& g, Parameters& p)
 {
   Console c;
-  if(Arguments.n() == 2 && Arguments[1] == "test")
-  {
-    //Function to generate line from -0.5 to 0.5
-    if(false)
-    {
-      int64 samples = 1024 * 1024;
-      float64* data = new float64[samples];
-      Random r;
-      for(int64 i = 0; i < samples; i++)
-      {
-        float64 value = 0.5 / 32768. + math::Sin((float64)(i % 100) * 441. / 
-          44100. * 2. * 3.14159265) / 32768. / 4.;
-        data[i] = value;
-      }
-      File::Write("/generated/dithertest.raw", (byte*)data, (count)samples * 
-        sizeof(float64));
-    }
-    
-    //Function to test Bessel functions
-    if(false)
-    {
-      Kaiser k;
-      std::cout.precision(30);
-      for(float64 z = 0; z <= 700.0; z += 0.25)
-      {
-        std::cout << z << ": " << k.BesselI0(z) << std::endl;
-      }
-    }
-    
-    //Function to test Kaiser window on FFT
-    if(false)
-    {
-      //DoSpectrogram();
-    }
-    
-    if(false)
-    {
-      //Double rounding does weird things!
-      float64 j = 1.0;
-      while(true)
-      {
-        j *= 0.5;
-        float64 n = 1.0 - j;
-        if(n >= 1.0) break;
-        if(lrint(32766.5 + n) == 32768)
-        {
-          std::cout.precision(30);
-          std::cout << n << std::endl;
-        }
-      }
-    }
-    
-    if(true)
-    {
-      count samples = 80 * 96000 + 1;
-      double* d = new double[samples];
-      
-      //double samples = 80 * 96000 + 1;
-      /*Mathematica code:
-      f = 2 Pi*(1/E);
-      N[f, 20]
-      N[2 Cos[f], 20]
-      N[Sin[-f], 20]
-      N[Sin[-2 f], 20]
-      */
-      double f = 2.3114546995818434358;
-      double twocosf = -1.3495479061189383385;
-      double prev = -0.73802446590373770493;
-      double pprev = 0.99599937262493702099;
-
-      for(int i = 0; i < samples; i++)
-      {
-        double sinnf = twocosf * prev - pprev;
-        d[i] = 0.5 * sinnf;
-        pprev = prev;
-        prev = sinnf;
-      }
-      
-      /*
-      for(count i = 0; i < samples; i++)
-      {
-        double x = (double)i;
-        double x2 = 2.0453077171808549730e-07 * x * x;
-        const double twopi = 6.2831853071795864769;
-        d[i] = 0.5 * sin(fmod(x2, twopi));
-      }
-      */
-      File::Write("/generated/mathematica/_Tone80s_Recursive.raw", (byte*)d,
-        samples * sizeof(float64));
-      c += "Wrote recursive sin tone.";
-    }
-    return;
-  }
-  
-  if(DisplayHelp(Arguments))
-    return;
-  
-  GlobalInfo g;
-  if(!SetGlobals(Arguments, g))
-    return;
-    
-  juce::initialiseJuce_NonGUI();
-  
-  FFTMultithread* fftm = 0;
-  Wisdom w;
-  DoWisdom(w, g, fftm);
-  
-  FileIO fio;
-  Parameters p;
-  
-  //Set the parameters.
-  if(g.Files.n() != 2)
-    return;
-
-  p.InputFilename = g.Files[0];
-  p.OutputFilename = g.Files[1];
-  
   String v;
   count i;
   
+  p.IsRaw = false;
+  p.MakeSpectrogram = false;
   if(p.OutputFilename.Suffix(4) == ".png")
   {
     p.MakeSpectrogram = true;
@@ -232,7 +124,10 @@ void CommandLine(prim::List<prim::String>& Arguments)
     p.SpectrogramFormat = "jpg";
   }
   
-  if(p.InputFilename.Suffix(4) == ".raw")
+  /*Standard input is read as raw data when its format is given, since it has
+  no suffix to tell by.*/
+  if(p.InputFilename.Suffix(4) == ".raw" ||
+    (p.InputFilename == "-" && g.IsSpecified("inputsampleformat")))
   {
     if(!p.MakeSpectrogram)
     {
@@ -241,7 +136,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
       {
         c += "To read raw input files you must specify --inputsamplerate, "
           "--inputsampleformat, and --inputchannels.";
-        return;
+        return false;
       }
     }
     else
@@ -250,7 +145,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
       {
         c += "To read raw input files for spectrogram analysis you must specify"
           " --inputsampleformat and --inputchannels";
-        return;
+        return false;
       }
     }
     
@@ -264,7 +159,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
     {
       c += "Input sample format not understood. Must be one of: [int8 ";
       c &= "int16 int24 int32 float32 float64]";
-      return;
+      return false;
     }
     
     p.IsRaw = true;
@@ -275,14 +170,14 @@ void CommandLine(prim::List<prim::String>& Arguments)
       if(!v.Find("Hz", i))
       {
         c += "Input sample rate must be specified in Hz, i.e. 44100Hz";
-        return;
+        return false;
       }
       v.Replace("Hz", "");
       p.InputSampleRate = v.ToInteger();
       if(p.InputSampleRate < 0)
       {
         c += "Input sample rate is not a valid integer.";
-        return;
+        return false;
       }
       
       v = g.GetValue("inputchannels");
@@ -293,10 +188,19 @@ void CommandLine(prim::List<prim::String>& Arguments)
       else
       {
         c += "Input channels not understood. Must be an integer 1 to 128.";
-        return;
+        return false;
       }
     }
   }
+  return true;
+}
+
+///Reads the options that apply to every file converted.
+bool SetParameters(GlobalInfo& g, Parameters& p)
+{
+  Console c;
+  String v;
+  count i;
   
   v = g.GetValue("convolve");
   if(v)
@@ -306,18 +210,18 @@ void CommandLine(prim::List<prim::String>& Arguments)
       c += "Convolution is incompatible with the spectrogram feature. First "
         "convolve the file to a new file, and then create spectrogram from the "
         "new file.";
-      return;
+      return false;
     }
     if(v.Suffix(4) == ".raw")
     {
       c += "Convolution currently does not support raw input. First convert the"
         " raw data to an audio format, and then proceed with convolution.";
-      return;
+      return false;
     }
     if(!juce::File(v.Merge()).existsAsFile())
     {
       c += "The impulse response file '"; c &= v; c &= "' could not be found.";
-      return;
+      return false;
     }
       
     p.ConvolveFilename = juce::File(v.Merge()).getFullPathName().toUTF8();
@@ -335,7 +239,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
     if(!v.Find("Hz", i))
     {
       c += "Sample rate must be specified in Hz, i.e. 44100Hz";
-      return;
+      return false;
     }
     v.Replace("Hz", "");
     p.OutputSampleRate = v.ToInteger();
@@ -352,7 +256,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
   {
     c += "Output sample format not understood. Must be one of: [int8 ";
     c &= "int16 int24 int32 float32 float64 keep]";
-    return;
+    return false;
   }
   
   v = g.GetValue("pitchshift");
@@ -379,9 +283,20 @@ void CommandLine(prim::List<prim::String>& Arguments)
   if(p.DitherBits < 0 || p.DitherBits > 1.0)
   {
     c += "Dither bits must be between 0.0 and 1.0";
-    return;
+    return false;
   }
   
+  //Left empty to choose by whether the output is a stream (see FileIO::Go).
+  v = g.GetValue("normalize");
+  if(v == "peak" || v == "limit" || v == "none" || v == "")
+    p.Normalization = v;
+  else
+  {
+    c += "Normalization not understood. Must be one of: [peak limit none]";
+    return false;
+  }
+  p.MeasureLevels = g.IsSpecified("levels");
+  
   v = g.GetValue("allowablebandwidthloss");
   if(!v)
     v = "0.1%";
@@ -389,7 +304,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
   {
     c += "Allowable bandwidth loss must be specified as a percentage, "
       "i.e. 0.1%";
-    return;
+    return false;
   }
   v.Replace("%", "");
   p.AllowableBandwidthLoss = v.ToNumber();
@@ -397,7 +312,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
   {
     c += "Allowable bandwidth loss must be a percentage greater than 0%, "
       "and less than 50%. Typical: 0.1%";
-    return;
+    return false;
   }
   p.AllowableBandwidthLoss *= 0.01;
   
@@ -409,7 +324,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
   {
     c += "Depth must be specified in dB, "
       "i.e. 200dB";
-    return;
+    return false;
   }
   v.Replace("dB", "");
   p.StopbandAttenuation = v.ToNumber();
@@ -417,7 +332,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
   {
     c += "Depth must be at least 6dB and at most 300dB. "
       "Typical value is 200dB.";
-    return;
+    return false;
   }
   
   //Spectrogram parameters
@@ -429,7 +344,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
   {
     c += "Spectrogram step must be between 128 and 65536. Powers of two and "
       "powers of small primes be faster to calculate.";
-    return;
+    return false;
   }
   
   v = g.GetValue("spectrogramstep");
@@ -439,7 +354,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
   if(p.SpectrogramStep < 1 || p.SpectrogramStep > p.SpectrogramSize)
   {
     c += "Spectrogram step must be between 1 and the spectrogram size.";
-    return;
+    return false;
   }
   
   v = g.GetValue("spectrogrambeta");
@@ -450,7 +365,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
   {
     c += "Spectrogram beta must be between 5.0 and 40.0. Typical value is "
       "35.0 (190 dB dynamic range).";
-    return;
+    return false;
   }
 
   v = g.GetValue("gradient");
@@ -479,7 +394,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
   if(!v.Find("dB", i))
   {
     c += "Gradient range must be specified in dB, i.e. 200dB";
-    return;
+    return false;
   }
   v.Replace("dB", "");
   p.GradientRange = v.ToNumber();
@@ -487,7 +402,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
   {
     c += "Gradient range must be at least 6dB and at most 300dB. "
       "Typical value is 180dB.";
-    return;
+    return false;
   }
   
   v = g.GetValue("exportfilter");
@@ -497,7 +412,7 @@ void CommandLine(prim::List<prim::String>& Arguments)
     {
       c += "Export filter must use a .fft extension. The result will be complex"
         " float64 pairs of the current filter's frequency response.";
-      return;
+      return false;
     }
       
     p.ExportFilterFilename = juce::File(v.Merge()).getFullPathName().toUTF8();
@@ -507,12 +422,196 @@ void CommandLine(prim::List<prim::String>& Arguments)
   if(g.IsSpecified("nofilter"))
     p.SkipFilter = true;
   
+  p.AllowPolyphase = !g.IsSpecified("nopolyphase");
+  p.AllowDirect = !g.IsSpecified("nodirect");
+  p.AllowPartitioned = !g.IsSpecified("nopartition");
+  p.AllowSinglePrecision = !g.IsSpecified("nosingle");
+  p.AllowPairs = !g.IsSpecified("nopairs");
+  p.AllowCascade = !g.IsSpecified("nocascade");
+  p.AllowHalfBand = !g.IsSpecified("nohalfband");
+  
+  //Zero lets the render size itself for the whole machine.
+  p.Cores = (g.IsSpecified("threads") ? g.GetValue("threads").ToInteger() : 0);
+  if(g.IsSpecified("threads") && p.Cores < 1)
+  {
+    c += "Threads must be a whole number of at least 1.";
+    return false;
+  }
+  p.MaxScratchSize = 0;
+  return true;
+}
+
+///Converts the files of a batch manifest, all with the same settings.
+void DoBatch(GlobalInfo& g, Parameters& p, const String& Manifest)
+{
+  Console c;
+  Batch b;
+  b.Threads = (p.Cores > 0 ? p.Cores :
+    (int64)juce::SystemStats::getNumCpus());
+  b.Runners = b.Threads;
+  if(g.IsSpecified("jobs"))
+  {
+    b.Runners = g.GetValue("jobs").ToInteger();
+    if(b.Runners < 1)
+    {
+      c += "Jobs must be a whole number of at least 1.";
+      return;
+    }
+  }
+  
+  if(b.Load(Manifest, p) && b.Plan())
+    b.Go();
+}
+
+void CommandLine(prim::List<prim::String>& Arguments)
+{
+  Console c;
+  if(Arguments.n() == 2 && Arguments[1] == "test")
+  {
+    //Function to generate line from -0.5 to 0.5
+    if(false)
+    {
+      int64 samples = 1024 * 1024;
+      float64* data = new float64[samples];
+      Random r;
+      for(int64 i = 0; i < samples; i++)
+      {
+        float64 value = 0.5 / 32768. + math::Sin((float64)(i % 100) * 441. / 
+          44100. * 2. * 3.14159265) / 32768. / 4.;
+        data[i] = value;
+      }
+      File::Write("/generated/dithertest.raw", (byte*)data, (count)samples * 
+        sizeof(float64));
+    }
+    
+    //Function to test Bessel functions
+    if(false)
+    {
+      Kaiser k;
+      std::cout.precision(30);
+      for(float64 z = 0; z <= 700.0; z += 0.25)
+      {
+        std::cout << z << ": " << k.BesselI0(z) << std::endl;
+      }
+    }
+    
+    //Function to test Kaiser window on FFT
+    if(false)
+    {
+      //DoSpectrogram();
+    }
+    
+    if(false)
+    {
+      //Double rounding does weird things!
+      float64 j = 1.0;
+      while(true)
+      {
+        j *= 0.5;
+        float64 n = 1.0 - j;
+        if(n >= 1.0) break;
+        if(lrint(32766.5 + n) == 32768)
+        {
+          std::cout.precision(30);
+          std::cout << n << std::endl;
+        }
+      }
+    }
+    
+    if(true)
+    {
+      count samples = 80 * 96000 + 1;
+      double* d = new double[samples];
+      
+      //double samples = 80 * 96000 + 1;
+      /*Mathematica code:
+      f = 2 Pi*(1/E);
+      N[f, 20]
+      N[2 Cos[f], 20]
+      N[Sin[-f], 20]
+      N[Sin[-2 f], 20]
+      */
+      double f = 2.3114546995818434358;
+      double twocosf = -1.3495479061189383385;
+      double prev = -0.73802446590373770493;
+      double pprev = 0.99599937262493702099;
+
+      for(int i = 0; i < samples; i++)
+      {
+        double sinnf = twocosf * prev - pprev;
+        d[i] = 0.5 * sinnf;
+        pprev = prev;
+        prev = sinnf;
+      }
+      
+      /*
+      for(count i = 0; i < samples; i++)
+      {
+        double x = (double)i;
+        double x2 = 2.0453077171808549730e-07 * x * x;
+        const double twopi = 6.2831853071795864769;
+        d[i] = 0.5 * sin(fmod(x2, twopi));
+      }
+      */
+      File::Write("/generated/mathematica/_Tone80s_Recursive.raw", (byte*)d,
+        samples * sizeof(float64));
+      c += "Wrote recursive sin tone.";
+    }
+    return;
+  }
+  
+  if(DisplayHelp(Arguments))
+    return;
+  
+  GlobalInfo g;
+  if(!SetGlobals(Arguments, g))
+    return;
+    
+  juce::initialiseJuce_NonGUI();
+  
+  FFTMultithread* fftm = 0;
+  Wisdom w;
+  DoWisdom(w, g, fftm);
+  
+  Parameters p;
+  String Manifest = g.GetValue("batch");
+  if(!Manifest && g.Files.n() != 2)
+    return;
+  if(Manifest && g.Files.n())
+  {
+    c += "Files may not be given with --batch, which reads them from its "
+      "manifest.";
+    return;
+  }
+  
+  //Set the parameters.
+  if(!Manifest)
+  {
+    p.InputFilename = g.Files[0];
+    p.OutputFilename = g.Files[1];
+    if(!SetFileParameters(g, p))
+      return;
+  }
+  else
+  {
+    p.IsRaw = false;
+    p.MakeSpectrogram = false;
+  }
+  if(!SetParameters(g, p))
+    return;
   
   //Begin timer.
   prim::float64 StartTick = juce::Time::getMillisecondCounterHiRes();
   
-  //Finally convert the file.
-  fio.Go(p);
+  //Finally convert the file, or each file of the batch.
+  if(!Manifest)
+  {
+    FileIO fio;
+    fio.Go(p);
+  }
+  else
+    DoBatch(g, p, Manifest);
+  juce::File::getSpecialLocation(juce::File::tempDirectory).deleteRecursively();
   
   //Check timer.
   prim::float64 EndTick = juce::Time::getMillisecondCounterHiRes();
@@ -0,0 +1,413 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#include "Cascade.h"
+
+#include "HalfBand.h"
+#include "Kaiser.h"
+#include "Parameters.h"
+#include "Render.h"
+#include "Scratch.h"
+#include "StreamingResampler.h"
+
+#include "Work.h"
+
+#include <iostream>
+
+///Estimates the floating-point operations of a real FFT of size N.
+static float64 EstimateFFTOperations(int64 N)
+{
+  return 2.5 * (float64)N * math::Log(2.0, (float64)N);
+}
+
+///Frames of the input blocks of a stage, as the streaming resampler sizes them.
+static int64 StageBlockFrames(const CascadeStage& s)
+{
+  int64 PhaseLength = (s.Taps + s.P - 1) / s.P;
+  int64 BlockFrames = s.Q;
+  while(BlockFrames < math::Max((int64)1024, PhaseLength - 1))
+    BlockFrames *= 2;
+  return BlockFrames;
+}
+
+/**Estimates the operations per output frame of a stage on the streaming
+resampler: a forward transform of each block, and for each phase a complex
+multiply (six operations per bin) and an inverse transform.*/
+static float64 EstimateStreamingCost(const CascadeStage& s)
+{
+  int64 BlockFrames = StageBlockFrames(s);
+  int64 FFTSize = BlockFrames * 2;
+  float64 PerPhase = 3.0 * (float64)FFTSize +
+    EstimateFFTOperations(FFTSize / s.Q);
+  return (EstimateFFTOperations(FFTSize) + (float64)s.P * PerPhase) /
+    (float64)(BlockFrames / s.Q * s.P);
+}
+
+/**Estimates the operations per output frame of a half-band filter: an add and
+a multiply-add for each pair of taps, which only every other output needs when
+upsampling.*/
+static float64 EstimateHalfBandCost(int64 Length, bool Up)
+{
+  float64 Pairs = (float64)((Length + 1) / 4);
+  return Pairs * 2.0 / (Up ? 2.0 : 1.0);
+}
+
+///Passband of a half-band stage as a fraction of the lower Nyquist frequency.
+static float64 HalfBandPassband(const CascadeStage& s)
+{
+  return (s.P > s.Q ? s.Passband : s.Passband * 2.0);
+}
+
+void CascadePlan::Add(int64 P, int64 Q, float64 Passband, float64 Stopband,
+  float64 StopbandAttenuation, bool Sharp, bool AllowHalfBand)
+{
+  CascadeStage& s = Stages[Count++];
+  math::Ratio Reduced(P, Q);
+  s.P = Reduced.Num();
+  s.Q = Reduced.Den();
+  s.Sharp = Sharp;
+  
+  //The stopband can go no higher than the P-space Nyquist frequency.
+  s.Passband = Passband;
+  s.Stopband = math::Min(Stopband, (float64)s.P);
+  
+  //Design the length the same way the streaming resampler will.
+  Kaiser KaiserLPF;
+  float64 Scale = 1.0 / (float64)s.P;
+  KaiserLPF.Initialize(s.Passband * Scale, (s.Stopband - s.Passband) * Scale,
+    StopbandAttenuation);
+  s.Taps = KaiserLPF.GetOrder();
+  s.HalfBand = false;
+  
+  /*A rate change of two can instead be a half-band filter around the lower
+  Nyquist frequency, with the stopband as far above it as the passband is
+  below. It is applied directly, so it is only used when that is cheaper. The
+  sharp upsampling stage must have its stopband at the input Nyquist frequency,
+  which a half-band filter cannot do.*/
+  bool Up = (s.P == 2 && s.Q == 1);
+  if(AllowHalfBand && ((Up && !Sharp) || (s.P == 1 && s.Q == 2)))
+  {
+    float64 Lower = (Up ? 1.0 : 0.5);
+    float64 HalfPassband = HalfBandPassband(s);
+    int64 HalfLength = HalfBand::EstimateLength(HalfPassband,
+      StopbandAttenuation);
+    if(EstimateHalfBandCost(HalfLength, Up) < EstimateStreamingCost(s))
+    {
+      s.HalfBand = true;
+      s.Stopband = (2.0 - HalfPassband) * Lower;
+      s.Taps = HalfLength;
+      HalfBands++;
+    }
+  }
+  Taps += s.Taps;
+}
+
+bool CascadePlan::Plan(int64 P, int64 Q, float64 AllowableBandwidthLoss,
+  float64 StopbandAttenuation, bool AllowHalfBand)
+{
+  Count = 0;
+  Taps = 0;
+  HalfBands = 0;
+  math::Ratio Reduced(P, Q);
+  P = Reduced.Num();
+  Q = Reduced.Den();
+  if(P == Q)
+    return false;
+  
+  if(P > Q)
+  {
+    /*Rates are in units of the input rate, so the band ends at 1/2. The stage
+    at rate r keeps 1/2 of its Nyquist frequency r/2, and its first image
+    starts at r - 1/2.*/
+    math::Ratio Rest(P, Q * 2);
+    int64 RestP = Rest.Num(), RestQ = Rest.Den();
+    Add(2, 1, 1.0 - AllowableBandwidthLoss, 1.0, StopbandAttenuation, true,
+      AllowHalfBand);
+    float64 Rate = 2.0;
+    while(RestP % 2 == 0 && RestP >= RestQ * 2 && Count < MaxStages - 1)
+    {
+      Add(2, 1, 1.0 / Rate, 2.0 - 1.0 / Rate, StopbandAttenuation, false,
+        AllowHalfBand);
+      RestP /= 2;
+      Rate *= 2.0;
+    }
+    if(RestP != RestQ)
+      Add(RestP, RestQ, 1.0 / Rate, 2.0 - 1.0 / Rate, StopbandAttenuation,
+        false, AllowHalfBand);
+  }
+  else
+  {
+    /*Rates are in units of the output rate, so the band ends at 1/2. A stage
+    that decimates to rate r folds everything above r - 1/2 onto the band.*/
+    math::Ratio Rest(P * 2, Q);
+    int64 RestP = Rest.Num(), RestQ = Rest.Den();
+    int64 Octaves = 0;
+    while(RestQ % 2 == 0 && RestQ >= RestP * 2 && Octaves < MaxStages - 2)
+    {
+      RestQ /= 2;
+      Octaves++;
+    }
+    float64 Rate = 2.0;
+    for(int64 i = 0; i < Octaves; i++)
+      Rate *= 2.0;
+    if(RestP != RestQ)
+    {
+      float64 InputRate = Rate * (float64)RestQ / (float64)RestP;
+      Add(RestP, RestQ, 1.0 / InputRate, (2.0 * Rate - 1.0) / InputRate,
+        StopbandAttenuation, false, AllowHalfBand);
+    }
+    for(; Octaves > 0; Octaves--, Rate /= 2.0)
+      Add(1, 2, 1.0 / Rate, 1.0 - 1.0 / Rate, StopbandAttenuation, false,
+        AllowHalfBand);
+    Add(1, 2, (1.0 - AllowableBandwidthLoss) * 0.5, 0.5, StopbandAttenuation,
+      true, AllowHalfBand);
+  }
+  return Count > 1 || HalfBands > 0;
+}
+
+int64 CascadePlan::OutputFrames(int64 InputFrames)
+{
+  int64 Frames = InputFrames;
+  for(int64 i = 0; i < Count && Frames > 0; i++)
+  {
+    const CascadeStage& s = Stages[i];
+    Frames = ((Frames - 1) * s.P + s.Taps - 1) / s.Q + 1;
+  }
+  return math::Max(Frames, (int64)0);
+}
+
+int64 CascadePlan::EstimateMemory(int64 Channels)
+{
+  //Size the blocks of each stage the same way the streaming resampler does.
+  int64 Samples = 0;
+  for(int64 i = 0; i < Count; i++)
+  {
+    const CascadeStage& s = Stages[i];
+    if(s.HalfBand)
+    {
+      /*The streams with their history (twice for the two halves of the input
+      when downsampling), the taps, one channel of filtered output, and the
+      buffer of output.*/
+      int64 Half = (s.Taps + 1) / 4, Block = HalfBand::DefaultBlockFrames;
+      int64 Streams = (s.P > s.Q ? 1 : 2);
+      Samples += (Half * 2 - 1 + Block) * Channels * Streams;
+      Samples += Half + Block + Block * 2 * Channels;
+      continue;
+    }
+    int64 BlockFrames = StageBlockFrames(s);
+    int64 OutputBlockFrames = BlockFrames / s.Q * s.P;
+    int64 FFTSize = BlockFrames * 2;
+    int64 SpectrumSize = FFTSize + 2;
+    
+    /*The spectra of the phases and of the block, the outputs of the phases,
+    the transforms, the previous and pending blocks, and the ready output along
+    with the buffer it is pulled into.*/
+    Samples += (s.P + 1) * SpectrumSize + s.P * (FFTSize / s.Q);
+    Samples += SpectrumSize * 2 + OutputBlockFrames;
+    Samples += (BlockFrames * 2 + OutputBlockFrames * 2) * Channels;
+  }
+  return Samples * (int64)sizeof(float64);
+}
+
+bool CascadeRenderer::Initialize(Parameters* p)
+{
+  Cleanup();
+  CascadeRenderer::p = p;
+  const CascadePlan& Plan = p->Cascade;
+  Resamplers = new StreamingResampler[Plan.Count];
+  HalfBands = new HalfBand[Plan.Count];
+  Buffers = new float64*[Plan.Count];
+  BufferFrames = new int64[Plan.Count];
+  Memory::ClearArray(Buffers, Plan.Count);
+  for(int64 i = 0; i < Plan.Count; i++)
+  {
+    const CascadeStage& s = Plan.Stages[i];
+    if(s.HalfBand)
+    {
+      if(!HalfBands[i].Initialize(s.P > s.Q, p->Channels, HalfBandPassband(s),
+        p->StopbandAttenuation))
+      {
+        Console c;
+        c += "The half-band filter of stage "; c &= i + 1; c &= " of the "
+          "cascade could not be designed.";
+        Cleanup();
+        return false;
+      }
+      BufferFrames[i] = HalfBands[i].OutputBlockSize();
+      Buffers[i] = new float64[BufferFrames[i] * p->Channels];
+      continue;
+    }
+    if(!Resamplers[i].InitializeBand(s.P, s.Q, p->Channels, s.Passband,
+      s.Stopband, p->StopbandAttenuation))
+    {
+      Console c;
+      c += "The filter of stage "; c &= i + 1; c &= " of the cascade could "
+        "not be designed.";
+      Cleanup();
+      return false;
+    }
+    BufferFrames[i] = Resamplers[i].OutputBlockSize();
+    Buffers[i] = new float64[BufferFrames[i] * p->Channels];
+  }
+  return true;
+}
+
+void CascadeRenderer::Go(SNDFILE* s_in, Scratch* s_scratch,
+  RenderSink* s_sink, RenderLevels* s_levels)
+{
+  Console c;
+  Accumulator = s_scratch;
+  Sink = s_sink;
+  Levels = s_levels;
+  Written = 0;
+  
+  c += "Pass: 1/1";
+  c++;
+  GlobalWorkInfo::setPassNumber(1);
+  GlobalWorkInfo::setTotalPasses(1);
+  GlobalWorkInfo::setPercentComplete(0);
+  
+  //Read the input a chunk at a time, and push it through the stages.
+  const int64 ChunkFrames = (int64)1 << 16;
+  float64* Input = new float64[ChunkFrames * p->Channels];
+  int64 FramesRead = 0, TotalRead = 0;
+  while((FramesRead = (int64)sf_readf_double(s_in, Input,
+    (sf_count_t)ChunkFrames)) > 0)
+  {
+    Feed(0, Input, FramesRead);
+    TotalRead += FramesRead;
+    
+    //Report the current read place, unless the length is not known.
+    if(p->Streaming || p->Frames < 1)
+      continue;
+    float64 pc = (float64)TotalRead / (float64)p->Frames * 100.;
+    c &= (number)pc;
+    c &= "%...";
+    GlobalWorkInfo::setPercentComplete(pc);
+    std::cout.flush();
+  }
+  delete [] Input;
+  
+  //The length of a stream is only known once it runs out.
+  if(p->Streaming)
+  {
+    p->Frames = TotalRead;
+    p->CountOutputFrames();
+  }
+  
+  /*End the input of each stage in turn, which flushes the end of its filter
+  into the next.*/
+  for(int64 i = 0; i < p->Cascade.Count; i++)
+  {
+    if(p->Cascade.Stages[i].HalfBand)
+    {
+      int64 Flushed;
+      while((Flushed = HalfBands[i].Flush(Buffers[i])) > 0)
+        Pass(i, Buffers[i], Flushed);
+      continue;
+    }
+    Resamplers[i].Finish();
+    Drain(i);
+  }
+}
+
+void CascadeRenderer::Feed(int64 Stage, const float64* Frames, int64 Count)
+{
+  //A half-band stage filters a block at a time straight into its buffer.
+  if(p->Cascade.Stages[Stage].HalfBand)
+  {
+    HalfBand& h = HalfBands[Stage];
+    for(int64 Taken = 0; Taken < Count;)
+    {
+      int64 Frames_i = math::Min(h.InputBlockSize(), Count - Taken);
+      int64 Given = h.Process(&Frames[Taken * p->Channels], Frames_i,
+        Buffers[Stage]);
+      Pass(Stage, Buffers[Stage], Given);
+      Taken += Frames_i;
+    }
+    return;
+  }
+  
+  //A stage only takes more once the output of its last block is pulled.
+  int64 Taken = 0;
+  while(Taken < Count)
+  {
+    Taken += Resamplers[Stage].Push(&Frames[Taken * p->Channels],
+      Count - Taken);
+    Drain(Stage);
+  }
+}
+
+void CascadeRenderer::Drain(int64 Stage)
+{
+  for(;;)
+  {
+    int64 Pulled = Resamplers[Stage].Pull(Buffers[Stage], BufferFrames[Stage]);
+    if(!Pulled)
+      break;
+    Pass(Stage, Buffers[Stage], Pulled);
+  }
+}
+
+void CascadeRenderer::Pass(int64 Stage, const float64* Frames, int64 Count)
+{
+  if(!Count)
+    return;
+  if(Stage + 1 < p->Cascade.Count)
+    Feed(Stage + 1, Frames, Count);
+  else
+    Write(Frames, Count);
+}
+
+void CascadeRenderer::Write(const float64* Frames, int64 Count)
+{
+  if(Levels)
+    Levels->Measure(Frames, Count);
+  if(Sink)
+    Sink->Write(Frames, Count);
+  else if(Accumulator)
+    Accumulator->Write(Written, Frames, Count);
+  Written += Count;
+}
+
+void CascadeRenderer::Cleanup(void)
+{
+  if(Buffers)
+  {
+    for(int64 i = 0; p && i < p->Cascade.Count; i++)
+      delete [] Buffers[i];
+  }
+  delete [] Buffers;
+  delete [] BufferFrames;
+  delete [] Resamplers;
+  delete [] HalfBands;
+  Buffers = 0;
+  BufferFrames = 0;
+  Resamplers = 0;
+  HalfBands = 0;
+}
@@ -0,0 +1,175 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#ifndef CASCADE_H
+#define CASCADE_H
+
+#include "Libraries.h"
+
+struct Parameters;
+struct RenderLevels;
+struct RenderSink;
+struct Scratch;
+class HalfBand;
+class StreamingResampler;
+
+///One rate change of a cascade, and the band that its filter keeps.
+struct CascadeStage
+{
+  ///The reduced ratio of the stage.
+  int64 P;
+  int64 Q;
+  
+  /**Edges of the passband and the stopband, as fractions of the Nyquist
+  frequency of the input of the stage.*/
+  float64 Passband;
+  float64 Stopband;
+  
+  ///Length of the filter of the stage in its P-space.
+  int64 Taps;
+  
+  ///Whether the stage has the sharp transition of the whole cascade.
+  bool Sharp;
+  
+  ///Whether the stage is a half-band filter applied directly (see HalfBand.h).
+  bool HalfBand;
+  
+  CascadeStage() : P(1), Q(1), Passband(0), Stopband(0), Taps(0),
+    Sharp(false), HalfBand(false) {}
+};
+
+/**Splits a rate change into stages that together need far fewer taps than one
+filter does. The transition of a single filter is a fraction of the band it
+keeps, but the filter is designed in P-space, which is max(P, Q) times wider,
+so ratios like 147/160 take millions of taps. A filter's length only depends on
+how narrow its transition is next to the rate it runs at, so the cascade puts
+the narrow transition in a rate change of two, at twice the lower of the two
+rates, where it costs the same as the single filter would for 2/1. All the
+other stages only have to keep the band below the lower Nyquist frequency and
+reject what would land on it, which leaves them wide transitions:
+
+- Upsampling: 2/1 with the narrow transition, then as many 2/1 as go into the
+  rest of the ratio, then what is left of the ratio. Nothing is left between
+  the band and its first image, so the stopband of each stage only starts at
+  the image.
+- Downsampling: the reverse, ending on 1/2 with the narrow transition. What a
+  stage lets into the band between the lower Nyquist frequency and its own
+  stopband is removed by the stages after it, so its stopband only has to start
+  where the decimation would fold onto the band.
+
+Every stage has the full stopband attenuation. A rate change of two may be a
+half-band filter instead, whose transition is centered on the lower Nyquist
+frequency: the stopband starts as far above it as the passband ends below it.
+The stages between the ends already have such a band. So does the sharp stage
+of a decimation in effect, since what the half-band lets fold lands only on
+the band that was given up. The sharp stage of upsampling would let images of
+that band through just above the input Nyquist frequency, so it is never
+half-band. A half-band filter is used where applying it directly costs less
+than the transforms of the streaming resampler.*/
+struct CascadePlan
+{
+  static const int64 MaxStages = 64;
+  
+  CascadeStage Stages[MaxStages];
+  int64 Count;
+  
+  ///Taps of all the stages together, and the stages that are half-band.
+  int64 Taps;
+  int64 HalfBands;
+  
+  CascadePlan() : Count(0), Taps(0), HalfBands(0) {}
+  
+  /**Plans the stages for resampling by P / Q with the bandwidth loss and the
+  attenuation of the single filter, with half-band stages if allowed. Returns
+  false if the ratio does not split into more than one stage, unless its one
+  stage is half-band.*/
+  bool Plan(int64 P, int64 Q, float64 AllowableBandwidthLoss,
+    float64 StopbandAttenuation, bool AllowHalfBand);
+  
+  ///Output frames the stages give in total for a number of input frames.
+  int64 OutputFrames(int64 InputFrames);
+  
+  ///Bytes of memory that the stages take, with their buffers.
+  int64 EstimateMemory(int64 Channels);
+  
+  private:
+  
+  ///Adds a stage and designs the length of its filter.
+  void Add(int64 P, int64 Q, float64 Passband, float64 Stopband,
+    float64 StopbandAttenuation, bool Sharp, bool AllowHalfBand);
+};
+
+/**Runs the input through the stages of a cascade back to back, in one pass
+that streams each stage into the next, and hands the output to a scratch or a
+sink as it comes out. Each stage is a streaming resampler or a half-band
+filter.*/
+struct CascadeRenderer
+{
+  Parameters* p;
+  StreamingResampler* Resamplers;
+  HalfBand* HalfBands;
+  
+  ///Output of each stage on its way into the next.
+  float64** Buffers;
+  int64* BufferFrames;
+  
+  Scratch* Accumulator;
+  RenderSink* Sink;
+  RenderLevels* Levels;
+  
+  ///Frames of the output written so far.
+  int64 Written;
+  
+  CascadeRenderer() : p(0), Resamplers(0), HalfBands(0), Buffers(0),
+    BufferFrames(0), Accumulator(0), Sink(0), Levels(0), Written(0) {}
+  ~CascadeRenderer() {Cleanup();}
+  
+  ///Designs the filters of the stages in the parameters.
+  bool Initialize(Parameters* p);
+  
+  ///Renders the input into either the scratch or the sink.
+  void Go(SNDFILE* s_in, Scratch* s_scratch, RenderSink* s_sink,
+    RenderLevels* s_levels);
+  
+  /**Pushes frames into a stage, passing on whatever comes out of it, and the
+  output of the last stage to the scratch or the sink.*/
+  void Feed(int64 Stage, const float64* Frames, int64 Count);
+  
+  ///Pulls all the output that a stage has ready into the next.
+  void Drain(int64 Stage);
+  
+  ///Passes output of a stage on to the next stage, or writes it if it is last.
+  void Pass(int64 Stage, const float64* Frames, int64 Count);
+  
+  ///Writes frames of the finished output.
+  void Write(const float64* Frames, int64 Count);
+  
+  void Cleanup(void);
+};
+
+#endif
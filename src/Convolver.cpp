@@ -0,0 +1,223 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#include "Convolver.h"
+
+#include "Kernels.h"
+
+void ConvolverFilter::Initialize(const float64* Response, int64 ResponseLength,
+  int64 HeadSize, int64 MaxSize)
+{
+  delete [] Head;
+  delete [] Stages;
+  ConvolverFilter::HeadSize = HeadSize;
+  ConvolverFilter::MaxSize = math::Max(MaxSize, HeadSize);
+  
+  //The head is stored back to front and padded with zeroes if it is short.
+  Head = new float64[HeadSize];
+  Memory::ClearArray(Head, HeadSize);
+  for(int64 i = 0; i < HeadSize && i < ResponseLength; i++)
+    Head[HeadSize - 1 - i] = Response[i];
+  
+  //Count the stages of partitions needed to cover the rest of the response.
+  StageCount = 0;
+  Length = HeadSize;
+  for(int64 Size = HeadSize; Length < ResponseLength; StageCount++)
+  {
+    int64 Partitions = (ResponseLength - Length + Size - 1) / Size;
+    if(Size < ConvolverFilter::MaxSize)
+      Partitions = math::Min(Partitions, (int64)2);
+    Length += Partitions * Size;
+    if(Size < ConvolverFilter::MaxSize)
+      Size *= 2;
+  }
+  
+  /*Lay out the stages and transform their partitions. The input is transformed
+  without normalization, so the 1 / N of the FFT goes into the partitions.*/
+  Stages = new ConvolverStage[StageCount];
+  int64 Start = HeadSize;
+  int64 Size = HeadSize;
+  for(int64 s = 0; s < StageCount; s++)
+  {
+    ConvolverStage& Stage = Stages[s];
+    int64 Partitions = (ResponseLength - Start + Size - 1) / Size;
+    if(Size < ConvolverFilter::MaxSize)
+      Partitions = math::Min(Partitions, (int64)2);
+    Stage.Size = Size;
+    Stage.Start = Start;
+    Stage.Partitions = Partitions;
+    
+    AudioFFT FFTer;
+    FFTer.Initialize((int)(Size * 2), FFTW_PATIENT, 0, true);
+    int64 FFTer_N_Freq_2 = FFTer.N_Freq() * 2;
+    float64 NormalizeFactor = 1.0 / (float64)(Size * 2);
+    float64* fft_time = FFTer.GetTimeDomain();
+    float64* fft_freq = FFTer.GetFreqDomain();
+    Stage.Spectra = new float64[Partitions * FFTer_N_Freq_2];
+    for(int64 k = 0; k < Partitions; k++)
+    {
+      int64 PartitionStart = Start + k * Size;
+      int64 Taps = math::Min(Size, ResponseLength - PartitionStart);
+      Memory::ClearArray(fft_time, FFTer_N_Freq_2);
+      Memory::CopyArray(fft_time, &Response[PartitionStart], Taps);
+      FFTer.TimeToFreqUnnormalized();
+      float64* Spectrum = &Stage.Spectra[k * FFTer_N_Freq_2];
+      for(int64 i = 0; i < FFTer_N_Freq_2; i++)
+        Spectrum[i] = fft_freq[i] * NormalizeFactor;
+    }
+    
+    Start += Partitions * Size;
+    if(Size < ConvolverFilter::MaxSize)
+      Size *= 2;
+  }
+}
+
+Convolver::~Convolver()
+{
+  if(Filter)
+  {
+    for(int64 s = 0; s < Filter->StageCount; s++)
+      delete [] InputSpectra[s];
+  }
+  delete [] InputSpectra;
+  delete [] FFTers;
+  delete [] History;
+  delete [] Pending;
+}
+
+void Convolver::Initialize(const ConvolverFilter& Filter)
+{
+  Convolver::Filter = &Filter;
+  Kernel = &Kernels<float64>::Get();
+  
+  //FFTW plans are made here, since planning is not thread-safe.
+  FFTers = new AudioFFT[Filter.StageCount];
+  InputSpectra = new float64*[Filter.StageCount];
+  for(int64 s = 0; s < Filter.StageCount; s++)
+  {
+    const ConvolverStage& Stage = Filter.Stages[s];
+    FFTers[s].Initialize((int)(Stage.Size * 2), FFTW_PATIENT, 0, true);
+    InputSpectra[s] = new float64[Stage.Partitions * FFTers[s].N_Freq() * 2];
+  }
+  
+  /*The history holds at least the last two blocks of the largest stage. When
+  it fills up, its second half is moved to the front. It starts out silent.*/
+  HistorySize = Filter.MaxSize * 4;
+  History = new float64[HistorySize];
+  Memory::ClearArray(History, HistorySize);
+  HistoryEnd = HistorySize / 2;
+  
+  //Stage outputs reach at most the length of the filter into the future.
+  PendingSize = 1;
+  while(PendingSize <= Filter.Length)
+    PendingSize *= 2;
+  Pending = new float64[PendingSize];
+  Memory::ClearArray(Pending, PendingSize);
+  Time = 0;
+}
+
+void Convolver::Process(const float64* Input, int64 InputHop,
+  float64* Output, int64 OutputHop, int64 Frames)
+{
+  const ConvolverFilter& f = *Filter;
+  int64 HeadSize = f.HeadSize;
+  int64 PendingMask = PendingSize - 1;
+  for(int64 i = 0; i < Frames; i++)
+  {
+    if(HistoryEnd == HistorySize)
+    {
+      int64 Keep = HistorySize / 2;
+      Memory::CopyArray(History, &History[HistorySize - Keep], Keep);
+      HistoryEnd = Keep;
+    }
+    History[HistoryEnd++] = *Input;
+    Input += InputHop;
+    
+    /*The head is convolved directly with the latest input, and the stages have
+    already added the rest of the response to this sample.*/
+    float64& PendingSample = Pending[Time & PendingMask];
+    *Output += PendingSample +
+      DotProduct(f.Head, &History[HistoryEnd - HeadSize], HeadSize);
+    PendingSample = 0;
+    Output += OutputHop;
+    Time++;
+    
+    //Apply each stage whose block has just ended.
+    if(Time % HeadSize == 0)
+    {
+      for(int64 s = 0; s < f.StageCount; s++)
+      {
+        if(Time % f.Stages[s].Size == 0)
+          ApplyStage(s);
+      }
+    }
+  }
+}
+
+void Convolver::ApplyStage(int64 Index)
+{
+  const ConvolverStage& Stage = Filter->Stages[Index];
+  AudioFFT& FFTer = FFTers[Index];
+  int64 Size = Stage.Size;
+  int64 Bins = FFTer.N_Freq();
+  int64 FFTer_N_Freq_2 = Bins * 2;
+  int64 Block = Time / Size - 1;
+  float64* Spectra = InputSpectra[Index];
+  
+  /*Transform the last two blocks of the input (overlap-save), and keep the
+  spectrum for the partitions after the first.*/
+  float64* fft_time = FFTer.GetTimeDomain();
+  float64* fft_freq = FFTer.GetFreqDomain();
+  Memory::CopyArray(fft_time, &History[HistoryEnd - Size * 2], Size * 2);
+  FFTer.TimeToFreqUnnormalized();
+  Memory::CopyArray(&Spectra[(Block % Stage.Partitions) * FFTer_N_Freq_2],
+    fft_freq, FFTer_N_Freq_2);
+  
+  /*Partition k applies to the block k blocks back. The blocks before the start
+  of the input are silent, so they are left out.*/
+  int64 Partitions = math::Min(Stage.Partitions, Block + 1);
+  for(int64 k = 0; k < Partitions; k++)
+  {
+    const float64* Input =
+      &Spectra[((Block - k) % Stage.Partitions) * FFTer_N_Freq_2];
+    const float64* Partition = &Stage.Spectra[k * FFTer_N_Freq_2];
+    if(k == 0)
+      Kernel->MultiplySpectrum(fft_freq, Input, Partition, Bins);
+    else
+      Kernel->MultiplyAccumulateSpectrum(fft_freq, Input, Partition, Bins);
+  }
+  FFTer.FreqToTime();
+  
+  /*The second half of the window is the output of the stage for the block,
+  which starts Stage.Start samples after the block did. Since the stage starts
+  at least a block into the response, none of it has been given out yet.*/
+  int64 First = (Block * Size + Stage.Start) & (PendingSize - 1);
+  int64 Wrapped = math::Max(First + Size - PendingSize, (int64)0);
+  Kernel->AddScaled(&Pending[First], &fft_time[Size], Size - Wrapped, 1.0);
+  Kernel->AddScaled(Pending, &fft_time[Size * 2 - Wrapped], Wrapped, 1.0);
+}
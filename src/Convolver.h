@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#ifndef CONVOLVER_H
+#define CONVOLVER_H
+
+#include "Libraries.h"
+
+template <class Sample> struct Kernels;
+
+///A run of equally long partitions of an impulse response.
+struct ConvolverStage
+{
+  ///Length of each partition, which is also the block length of the stage.
+  int64 Size;
+  
+  ///Tap of the impulse response at which the first partition starts.
+  int64 Start;
+  
+  ///Number of partitions in the stage.
+  int64 Partitions;
+  
+  ///Spectra of the partitions (2 * Size-point transforms), one after another.
+  float64* Spectra;
+  
+  ConvolverStage() : Size(0), Start(0), Partitions(0), Spectra(0) {}
+  ~ConvolverStage() {delete [] Spectra;}
+};
+
+/**An impulse response cut into partitions that grow along it (non-uniformly
+partitioned convolution), shared by the convolvers of all the channels. The
+head is applied directly in the time domain, so that the convolution has no
+latency. A partition of N taps is applied with a transform once a block of N
+input samples has come in, so it has to start at least N taps into the
+response to be in time. Each stage therefore has two partitions twice as long
+as those of the stage before it, up to the largest size, which then takes the
+rest of the response. The short partitions keep the head cheap, and the long
+ones keep the number of spectra (and so the cost per sample) of the tail low.*/
+struct ConvolverFilter
+{
+  ///Time-reversed taps of the head, so that each output is a dot product.
+  float64* Head;
+  int64 HeadSize;
+  
+  ConvolverStage* Stages;
+  int64 StageCount;
+  
+  ///Largest partition size, and the taps covered by the head and the stages.
+  int64 MaxSize;
+  int64 Length;
+  
+  ConvolverFilter() : Head(0), HeadSize(0), Stages(0), StageCount(0),
+    MaxSize(0), Length(0) {}
+  ~ConvolverFilter() {delete [] Head; delete [] Stages;}
+  
+  /**Partitions an impulse response, given the size of the head and of the
+  largest partitions (powers of two).*/
+  void Initialize(const float64* Response, int64 ResponseLength,
+    int64 HeadSize, int64 MaxSize);
+};
+
+/**Streams one channel through a ConvolverFilter. Each output sample is ready
+as soon as its input sample has come in, so the input can be given in blocks
+of any length. Convolvers of different channels may run on different threads.*/
+struct Convolver
+{
+  const ConvolverFilter* Filter;
+  
+  ///Transform of each stage, and the spectra of its last input blocks.
+  AudioFFT* FFTers;
+  float64** InputSpectra;
+  
+  ///The input so far ends at HistoryEnd, with room after it to append to.
+  float64* History;
+  int64 HistorySize;
+  int64 HistoryEnd;
+  
+  ///Output of the stages not yet given out, indexed by time modulo its size.
+  float64* Pending;
+  int64 PendingSize;
+  
+  ///Samples convolved so far.
+  int64 Time;
+  
+  ///Inner loops for the instruction set of the CPU.
+  const Kernels<float64>* Kernel;
+  
+  Convolver() : Filter(0), FFTers(0), InputSpectra(0), History(0),
+    HistorySize(0), HistoryEnd(0), Pending(0), PendingSize(0), Time(0),
+    Kernel(0) {}
+  ~Convolver();
+  
+  ///Prepares to convolve with a filter, starting from silence.
+  void Initialize(const ConvolverFilter& Filter);
+  
+  /**Convolves the next frames of the input, mixing them into the output. The
+  hops are the distances between consecutive samples (for interleaving).*/
+  void Process(const float64* Input, int64 InputHop, float64* Output,
+    int64 OutputHop, int64 Frames);
+  
+  ///Applies the partitions of a stage to the input blocks that just ended.
+  void ApplyStage(int64 Index);
+};
+
+#endif
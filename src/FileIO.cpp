@@ -28,8 +28,12 @@
 
 #include "FileIO.h"
 #include "Kaiser.h"
+#include "Kernels.h"
 #include "Render.h"
 #include "Parameters.h"
+#include "Pipe.h"
+#include "Scratch.h"
+
 
 String FileIO::GetFormat(SF_INFO& s_info, String* Description)
 {
@@ -605,21 +609,40 @@ void FileIO::MakeSpectrogram(Parameters& p, SNDFILE* s)
   }
 }
 
+///Formats a level relative to full scale in decibels.
+static String Decibels(float64 Level)
+{
+  String s;
+  if(Level <= 0.0)
+    s = "-inf";
+  else
+    s &= (number)(math::Log(10, Level) * 20.0);
+  s &= " dBFS";
+  return s;
+}
+
 void FileIO::Go(Parameters& p)
 {
   Console c;
+  Completed = false;
   
   //Set up file info structures.
-  SF_INFO s_info, s_out_info, s_scratch_info;
+  SF_INFO s_info, s_out_info;
   Memory::ClearObject(s_info);
   Memory::ClearObject(s_out_info);
-  Memory::ClearObject(s_scratch_info);
   Memory::ClearObject(p.ConvolveInfo);
   p.ConvolveHandle = 0;
   
+  /*Standard input and output and named pipes can only be read or written once
+  from start to end, so they are streamed in a single pass without a scratch.*/
+  bool InputIsPipe = Pipe::IsPipe(p.InputFilename);
+  bool OutputIsPipe = Pipe::IsPipe(p.OutputFilename);
+  p.Streaming = InputIsPipe || OutputIsPipe;
+  Pipe InputPipe, OutputPipe;
+  
   /*Make absolutely certain the input file is not the ouput file. Brick should
   never, ever work with in = out.*/
-  if(juce::File(p.InputFilename.Merge()) ==
+  if(p.InputFilename != "-" && juce::File(p.InputFilename.Merge()) ==
     juce::File(p.OutputFilename.Merge()))
   {
     c += "Input file is the same as the output file. Only non-destructive ";
@@ -640,11 +663,15 @@ void FileIO::Go(Parameters& p)
   }
   
   c += "Opening '"; c &= p.InputFilename; c &= "' for reading...";
-  SNDFILE* s = sf_open(p.InputFilename, SFM_READ, &s_info);
+  SNDFILE* s;
+  if(InputIsPipe)
+    s = InputPipe.Open(p.InputFilename, SFM_READ, s_info);
+  else
+    s = sf_open(p.InputFilename, SFM_READ, &s_info);
   String s_error = CheckFileError(s);
-  if(s_error)
+  if(s_error || !s)
   {
-    c += s_error;
+    c += (s_error ? s_error : String("The input stream could not be opened."));
     return;
   }
   c++;
@@ -658,7 +685,11 @@ void FileIO::Go(Parameters& p)
   //Get description of input file.
   c += "Input Information";
   c += "----------------------------------------------------------------------";
-  c += "Frames: "; c &= (integer)s_info.frames;
+  c += "Frames: ";
+  if(InputIsPipe)
+    c &= "unknown until the stream ends";
+  else
+    c &= (integer)s_info.frames;
   c += "Sample Rate: "; c &= (integer)s_info.samplerate;
   c += "Channels: "; c &= (integer)s_info.channels;
   
@@ -675,12 +706,18 @@ void FileIO::Go(Parameters& p)
   
   //Set the basics.
   p.Channels = s_info.channels;
-  p.Frames = s_info.frames;
+  p.Frames = (InputIsPipe ? 0 : (int64)s_info.frames);
   p.OldSampleRate = s_info.samplerate;
   
   //If doing a spectrogram, fork off to do that here.
   if(p.MakeSpectrogram)
   {
+    if(InputIsPipe)
+    {
+      c += "Spectrograms can not be created from a stream.";
+      sf_close(s);
+      return;
+    }
     if(s_info.channels > 2)
     {
       c += "Spectrograms can currently only be created from monoaural "
@@ -692,37 +729,6 @@ void FileIO::Go(Parameters& p)
     return;
   }
   
-  //Calculate the sample rate ratio
-  math::Ratio SampleRate;
-  if(p.OutputSampleRate <= 0)
-    p.OutputSampleRate = s_info.samplerate;
-    
-  SampleRate = p.OutputSampleRate;
-  SampleRate = SampleRate / s_info.samplerate;
-
-  math::Ratio PitchRate = GetPitchShiftRatio(p.PitchShift, p.CentsTolerance);
-  math::Ratio TotalRateChange = SampleRate / PitchRate;
-  p.P = TotalRateChange.Num();
-  p.Q = TotalRateChange.Den();
-  if((p.P == 1 && p.Q == 1) && !(p.ConvolveFilename))
-    p.SkipFilter = true;
-
-  //Calculate maximum FFT size.
-  int Megs = juce::SystemStats::getMemorySizeInMegabytes();
-  p.MaxFFTSize = (int64)(math::Log(2.0, (float64)Megs) + 0.1) - 6 + 20;
-  if(p.MaxFFTSize > 26)
-    p.MaxFFTSize = 26; //FFTW will not uses sizes higher due to malloc failing.
-
-  //Set other parameters.
-  p.BCOptimizationLevel = 2;
-  p.NewSampleRate = p.OutputSampleRate;
-  
-  /*If keeping the input sample format, then copy the input format to the
-  output format.*/
-  if(!p.OutputSampleFormat)
-    p.OutputSampleFormat = sampletype;
-  p.OutFormat = p.OutputSampleFormat;
-  
   //Set convolution.
   if(p.ConvolveFilename)
   {
@@ -745,8 +751,26 @@ void FileIO::Go(Parameters& p)
     sf_command(p.ConvolveHandle, SFC_SET_NORM_DOUBLE, 0, SF_TRUE);
   }
   
-  if(!p.SkipFilter && !p.InitializeDerivedParameters())
+  if(!PlanConversion(p, (int64)s_info.samplerate, sampletype))
+  {
+    sf_close(s);
+    return;
+  }
+  
+  /*Normalizing to the peak takes a pass over the whole output before any of it
+  is written, so a stream is instead limited if it is written as integers and
+  otherwise passed through as floats.*/
+  if(!p.Normalization)
+  {
+    if(!p.Streaming)
+      p.Normalization = "peak";
+    else
+      p.Normalization = (IsFormatInt(p.OutFormat) ? "limit" : "none");
+  }
+  else if(p.Streaming && p.Normalization == "peak")
   {
+    c += "A stream can not be normalized to its peak. Use --normalize=limit "
+      "or --normalize=none.";
     sf_close(s);
     return;
   }
@@ -758,75 +782,108 @@ void FileIO::Go(Parameters& p)
   c += "Downsample by: "; c &= p.Q; 
   c += "Filtering: "; c &= (!p.SkipFilter ? "yes" : "no");
   c += "Convolving: "; c &= (p.ConvolveFilename ? "yes" : "no");
+  c += "Streaming: "; c &= (p.Streaming ? "yes" : "no");
+  c += "Normalization: "; c &= p.Normalization;
   if(!p.SkipFilter)
   {
     c += "Allowable Bandwidth Loss: ";
     c &= (number)p.AllowableBandwidthLoss * 100.f; c &= "%";
     c += "Stopband Attenuation: "; c &= (number)p.StopbandAttenuation;
       c &= "dB";
-    c += "Scratch File Size: "; c &= (number)p.ScratchFileSize /
-      (number)(1024 * 1024); c &= " MB";
-    c += "Filter Length: "; c &= p.idealM;
-    c += "Passes: "; c &= p.S;
-    c += "FFT Size: "; c &= (number)p.FFTSize / (number)1024; c &= " K";
+    if(!p.Streaming)
+    {
+      c += "Scratch Size: "; c &= (number)p.ScratchFileSize /
+        (number)(1024 * 1024); c &= " MB";
+      c += "Scratch In Memory: "; c &= (p.ScratchInMemory ? "yes" : "no");
+    }
+    if(p.Cascaded)
+    {
+      c += "Filter Length: "; c &= p.Cascade.Taps; c &= " in ";
+      c &= p.Cascade.Count; c &= " stages (instead of "; c &= p.idealM;
+      c &= ")";
+      for(int64 i = 0; i < p.Cascade.Count; i++)
+      {
+        const CascadeStage& Stage = p.Cascade.Stages[i];
+        c += "Stage "; c &= i + 1; c &= ": "; c &= Stage.P; c &= "/";
+        c &= Stage.Q; c &= ", "; c &= Stage.Taps; c &= " taps";
+        c &= (Stage.Sharp ? " (sharp)" : "");
+        c &= (Stage.HalfBand ? " (half-band)" : "");
+      }
+    }
+    else
+    {
+      c += "Filter Length: "; c &= p.idealM;
+      c += "Passes: "; c &= p.S;
+      c += "Filter Partitions: "; c &= p.Partitions;
+      c += "Worker Threads: "; c &= p.Workers;
+      c += "Blocks Per Chunk: "; c &= p.Blocks;
+      c += "Polyphase: "; c &= (p.Polyphase || p.Direct ? "yes" : "no");
+      c += "Direct Convolution: "; c &= (p.Direct ? "yes" : "no");
+      c += "Growing Partitions: "; c &= (p.NonUniform ? "yes" : "no");
+      if(p.Direct)
+      {
+        c += "Taps Per Phase: "; c &= p.PolyphaseM;
+      }
+      else if(p.NonUniform)
+      {
+        c += "Largest Partition: "; c &= (number)p.ConvolverMaxSize /
+          (number)1024; c &= " K";
+      }
+      else if(p.Polyphase)
+      {
+        c += "FFT Size: "; c &= (number)p.PolyphaseFFTSize / (number)1024;
+        c &= " K";
+      }
+      else
+      {
+        c += "FFT Size: "; c &= (number)p.FFTSize / (number)1024; c &= " K";
+      }
+      c += "Decimated Inverse FFT: "; c &= (p.Decimate ? "yes" : "no");
+      c += "Zero-Phase Filter: "; c &= (p.ZeroPhase ? "yes" : "no");
+      c += "Paired Channels: "; c &= (p.Paired ? "yes" : "no");
+    }
+    c += "Precision: "; c &= (p.SinglePrecision ? "single" : "double");
+    c += "Vector Instructions: "; c &= Kernels<float64>::Get().InstructionSet;
   }
   c++;
   
   c += "Working";
   c += "----------------------------------------------------------------------";
   
-  //Open the scratch file.
-  String ScratchFilename;
-  juce::File ScratchFile = juce::File::createTempFile(".aiff");
-  ScratchFilename = ScratchFile.getFullPathName().toUTF8();
-  c += "Opening scratch file '"; c &= ScratchFilename;
-  c &= "' for reading/writing...";
-  s_scratch_info.samplerate = p.NewSampleRate;
-  s_scratch_info.channels = p.Channels;
-  s_scratch_info.format = SF_FORMAT_DOUBLE | SF_FORMAT_AIFF;
-  SNDFILE* s_scratch = sf_open(ScratchFilename, SFM_RDWR, &s_scratch_info);
-  String s_scratch_error = CheckFileError(s_scratch);
-  if(s_scratch_error)
+  /*Open the scratch, which has room for the output when filtering and for the
+  input otherwise. A stream has no scratch.*/
+  Scratch s_scratch;
+  int64 ScratchFrames = (!p.SkipFilter ? p.OutPQFrames : p.Frames);
+  if(!p.Streaming && !s_scratch.Open(ScratchFrames, p.Channels,
+    p.NewSampleRate, p.ScratchInMemory))
   {
-    c += s_scratch_error;
     sf_close(s);
-    ScratchFile.deleteFile();
     return;
   }
   
-  /*Zero out the scratch file, or if no filter is being used, just copy the
-  audio data from the input file into the scratch file.*/
-  
-  if(!p.SkipFilter)
-  {
-    int64 BlankFrames = 1024 * 128;
-    float64* BlankMemory = new float64[p.Channels * BlankFrames];
-    Memory::ClearArray(BlankMemory, p.Channels * BlankFrames);
-    int64 FramesLeft = p.OutPQFrames;
-    while(FramesLeft > 0)
-    {
-      if(FramesLeft < BlankFrames)
-        BlankFrames = FramesLeft;
-      FramesLeft -= BlankFrames;
-      sf_writef_double(s_scratch, BlankMemory, (sf_count_t)BlankFrames);
-    }
-    delete [] BlankMemory;
-  }
-  else
+  /*Zero out the scratch, or if no filter is being used, just copy the audio
+  data from the input file into the scratch.*/
+  int64 CopyFrames = 1024 * 128;
+  if(!p.Streaming && !p.SkipFilter)
+    s_scratch.Clear(p.OutPQFrames);
+  else if(!p.Streaming)
   {
-    //Copy data into scratch file.
-    int64 CopyFrames = 1024 * 128;
+    //Copy data into scratch.
     float64* CopyMemory = new float64[p.Channels * CopyFrames];
     int64 FramesRead = 0;
+    int64 Position = 0;
     do
     {
       FramesRead = sf_readf_double(s, CopyMemory, (sf_count_t)CopyFrames);
-      sf_writef_double(s_scratch, CopyMemory, (sf_count_t)FramesRead);
+      OutputLevels.Measure(CopyMemory, FramesRead);
+      s_scratch.Write(Position, CopyMemory, FramesRead);
+      Position += FramesRead;
     } while(FramesRead > 0);
     delete [] CopyMemory;
   }
   
-  //Open the output file.
+  /*Open the output file. Standard output without a suffix to go by is written
+  in the container of the input.*/
   c += "Opening '"; c &= p.OutputFilename; c &= "' for writing...";
   s_out_info.samplerate = p.NewSampleRate;
   s_out_info.channels = p.Channels;
@@ -839,39 +896,47 @@ void FileIO::Go(Parameters& p)
     s_out_info.format = s_out_info.format | SF_FORMAT_AU;
   else if(p.OutputFilename.Suffix(4) == ".raw")
     s_out_info.format = s_out_info.format | SF_FORMAT_RAW | SF_ENDIAN_CPU;
+  else if(p.OutputFilename == "-" &&
+    (s_info.format & SF_FORMAT_TYPEMASK) == SF_FORMAT_RAW)
+    s_out_info.format = s_out_info.format | SF_FORMAT_RAW | SF_ENDIAN_CPU;
+  else if(p.OutputFilename == "-")
+    s_out_info.format = s_out_info.format |
+      (s_info.format & SF_FORMAT_TYPEMASK);
   else
     s_out_info.format = s_out_info.format | SF_FORMAT_AIFF;
-  File::Replace(p.OutputFilename, ""); //Zero out the file.
-  SNDFILE* s_out = sf_open(p.OutputFilename, SFM_WRITE, &s_out_info);
-    String s_out_error = CheckFileError(s_out);
-  if(s_out_error)
+  SNDFILE* s_out;
+  if(OutputIsPipe)
+    s_out = OutputPipe.Open(p.OutputFilename, SFM_WRITE, s_out_info);
+  else
   {
-    c += s_out_error;
+    File::Replace(p.OutputFilename, ""); //Zero out the file.
+    s_out = sf_open(p.OutputFilename, SFM_WRITE, &s_out_info);
+  }
+  String s_out_error = CheckFileError(s_out);
+  if(s_out_error || !s_out)
+  {
+    c += (s_out_error ? s_out_error :
+      String("The output stream could not be opened."));
     sf_close(s);
-    sf_close(s_scratch);
-    ScratchFile.deleteFile();
     return;
   }
   
   //We'll handle our own output clipping.
   sf_command(s_out, SFC_SET_CLIPPING, 0, SF_FALSE);
   
-  //Resample!
-  if(!p.SkipFilter)
-  {
-    Renderer R;
-    R.Initialize(&p);
-    R.Go(s, s_scratch);
-  }
-  
-  //Copy the scratch file to the output file.
-  c += "Writing scratch file to output.";
-  int64 FramesRead;
+  //Prepare the chunks that are converted and written to the output.
   int64 NumChannels = p.Channels;
   int64 NumFramesPerChunk = 1024 * 128;
   InitializeChunks(NumFramesPerChunk, NumChannels, IsFormatInt(p.OutFormat),
      GetFormatBits(p.OutFormat));
-  bool IsIntegerFormat = IsFormatInt(p.OutFormat);
+  OutputFile = s_out;
+  OutputParameters = &p;
+  Amplification = 1.0;
+  OutputLevels.Initialize(NumChannels, p.MeasureLevels);
+  Limiting = (p.Normalization == "limit");
+  if(Limiting)
+    OutputLimiter.Initialize(NumChannels, p.NewSampleRate,
+      GetNormalizedMaxValue());
   
   /*Semi-disable dithering if we are only upconverting. Note: in weird cases,
   like float32 -> int32, it is still a good idea to at least do a rectangular
@@ -889,79 +954,63 @@ void FileIO::Go(Parameters& p)
       //interval and jump up or down an integer.
   }
   
-  
-  //Determine the peak value.
-  float64 MostPositiveValue = 0.0;
-  float64 MostNegativeValue = 0.0;
-  bool UsedNormalization = false;
-  sf_seek(s_scratch, 0, SEEK_SET);
-  do
+  /*A stream is written as it is filtered (or copied straight through), a chunk
+  at a time.*/
+  bool UsedNormalization = false, Rendered = true;
+  if(p.Streaming)
   {
-    //Read in a block from the scratch file.
-    FramesRead = (int64)sf_readf_double(
-      s_scratch, OutChunk, (sf_count_t)NumFramesPerChunk);
-    int64 SamplesRead = FramesRead * NumChannels;
-    
-    //Look for peak.
-    for(count i = 0; i < SamplesRead; i++)
+    if(!p.SkipFilter)
+      Rendered = Render(p, s, *this, &OutputLevels);
+    else
     {
-      float64 Value = OutChunk[i];
-      if(Value < MostNegativeValue) MostNegativeValue = Value;
-      if(Value > MostPositiveValue) MostPositiveValue = Value;
+      float64* CopyMemory = new float64[p.Channels * CopyFrames];
+      int64 FramesRead = 0;
+      do
+      {
+        FramesRead = sf_readf_double(s, CopyMemory, (sf_count_t)CopyFrames);
+        OutputLevels.Measure(CopyMemory, FramesRead);
+        Write(CopyMemory, FramesRead);
+      } while(FramesRead > 0);
+      delete [] CopyMemory;
     }
-      
-  } while(FramesRead > 0);
-  
-  float64 Amplification1 = 0, Amplification2 = 0;
-  
-  if(MostNegativeValue != 0.)
-    Amplification1 = GetNormalizedMinValue() / MostNegativeValue;
-  if(MostPositiveValue != 0.)
-    Amplification2 = GetNormalizedMaxValue() / MostPositiveValue;
-    
-  float64 Amplification = math::Min(Amplification1, Amplification2);
-  if(Amplification >= 1.0)
-    Amplification = 1.0;
+  }
   else
-    UsedNormalization = true;
-  
-  sf_seek(s_scratch, 0, SEEK_SET);
-  do
   {
-    //Read in a block from the scratch file.
-    FramesRead = (int64)sf_readf_double(
-      s_scratch, OutChunk, (sf_count_t)NumFramesPerChunk);
-    int64 SamplesRead = FramesRead * NumChannels;
-    
-    //Zero out any portion that was not read.
-    int64 ChunkSamples = NumFramesPerChunk * NumChannels;
-    Memory::ClearArray(&OutChunk[SamplesRead], ChunkSamples - SamplesRead);
+    //Resample!
+    if(!p.SkipFilter)
+      Rendered = Render(p, s, s_scratch, &OutputLevels);
     
-    if(IsIntegerFormat)
+    /*The peaks were measured as the output was made (or copied), so the
+    scratch only has to be read once, to write it.*/
+    if(Rendered && p.Normalization == "peak")
     {
-      //Convert to integer format.
-      OutChunkToOutChunkInt(p.DitherType, p.DitherBits, Amplification);
+      float64 MostNegativeValue = OutputLevels.Minimum();
+      float64 MostPositiveValue = OutputLevels.Maximum();
+      float64 Amplification1 = 0, Amplification2 = 0;
       
-      //Write the data to file.
-      sf_writef_int(s_out, OutChunkInt, (sf_count_t)FramesRead);
+      if(MostNegativeValue != 0.)
+        Amplification1 = GetNormalizedMinValue() / MostNegativeValue;
+      if(MostPositiveValue != 0.)
+        Amplification2 = GetNormalizedMaxValue() / MostPositiveValue;
+        
+      Amplification = math::Min(Amplification1, Amplification2);
+      if(Amplification >= 1.0)
+        Amplification = 1.0;
+      else
+        UsedNormalization = true;
     }
-    else
+    
+    //Copy the scratch to the output file, unless nothing was rendered into it.
+    if(Rendered)
     {
-      //Check for clipping in the normalized double.
-      float64* ptr_OutChunkEnd = &OutChunk[ChunkSamples - 1];
-      for(float64* ptr_OutChunk = OutChunk;
-        ptr_OutChunk < ptr_OutChunkEnd - 1; ptr_OutChunk++)
-      {
-        float64 Value = *ptr_OutChunk;
-        if(Value < -1.0 || Value > 1.0)
-          Clipped = true;
-      }
-      
-      //Write the data to file.
-      sf_writef_double(s_out, OutChunk, (sf_count_t)FramesRead);
+      c += "Writing scratch to output.";
+      WriteScratch(s_scratch);
     }
-      
-  } while(FramesRead > 0);
+  }
+  if(Rendered)
+    FinishOutput();
+  else
+    c += "The input could not be rendered, so the output was not written.";
   
   //Warn about clipping.
   if(UsedNormalization)
@@ -971,17 +1020,85 @@ void FileIO::Go(Parameters& p)
     c &= (number)math::Log(10, Amplification) * 20.0f;
     c &= " dB.";
   }
+  else if(Limiting && OutputLimiter.LowestGain < 1.0)
+  {
+    c += "Warning: the waveform was limited to prevent clipping by "
+      "attenuating by up to ";
+    c &= (number)math::Log(10, OutputLimiter.LowestGain) * 20.0f;
+    c &= " dB.";
+  }
   else if(Clipped)
     c += "Warning: the waveform clipped.";
   
+  //Report the levels of each channel.
+  if(Rendered && p.MeasureLevels && OutputLevels.Frames > 0)
+  {
+    c++;
+    c += "Output Levels (before normalization)";
+    c += "----------------------------------------------------------------------";
+    for(int64 i = 0; i < OutputLevels.Channels; i++)
+    {
+      float64 Peak = math::Max(-OutputLevels.Minimums[i],
+        OutputLevels.Maximums[i]);
+      float64 Frames = (float64)OutputLevels.Frames;
+      float64 RMS = math::Sqrt(OutputLevels.SumSquares[i] / Frames);
+      c += "Channel "; c &= (integer)(i + 1); c &= ": Peak ";
+      c &= Decibels(Peak); c &= ", RMS "; c &= Decibels(RMS); c &= ", DC ";
+      c &= (number)(OutputLevels.Sums[i] / Frames);
+    }
+  }
+  
   //Close the files.
   //c += "Closing files.";
   sf_close(s);
   sf_close(s_out);
-  sf_close(s_scratch);
-  ScratchFile.deleteFile();
-  juce::File::getSpecialLocation(juce::File::tempDirectory).deleteRecursively();
+  InputPipe.Close();
+  OutputPipe.Close();
+  OutputFile = 0;
+  if(!p.Streaming)
+    s_scratch.Close();
+  if(!Rendered)
+    return;
   c += "Finished.";
+  Completed = true;
+}
+
+bool FileIO::PlanConversion(Parameters& p, int64 InputSampleRate,
+  String InputSampleType)
+{
+  //Calculate the sample rate ratio
+  math::Ratio SampleRate;
+  if(p.OutputSampleRate <= 0)
+    p.OutputSampleRate = InputSampleRate;
+    
+  SampleRate = p.OutputSampleRate;
+  SampleRate = SampleRate / InputSampleRate;
+
+  math::Ratio PitchRate = GetPitchShiftRatio(p.PitchShift, p.CentsTolerance);
+  math::Ratio TotalRateChange = SampleRate / PitchRate;
+  p.P = TotalRateChange.Num();
+  p.Q = TotalRateChange.Den();
+  if((p.P == 1 && p.Q == 1) && !(p.ConvolveFilename))
+    p.SkipFilter = true;
+
+  //Size the FFTs and the scratch for the memory of the machine.
+  p.SetMachineLimits();
+  p.ScratchInMemory = (p.Frames * p.Channels * (int64)sizeof(float64) <=
+    p.MaxScratchSize);
+
+  //Set other parameters.
+  p.BCOptimizationLevel = 2;
+  p.NewSampleRate = p.OutputSampleRate;
+  
+  /*If keeping the input sample format, then copy the input format to the
+  output format.*/
+  if(!p.OutputSampleFormat)
+    p.OutputSampleFormat = InputSampleType;
+  p.OutFormat = p.OutputSampleFormat;
+  p.OutputIntegerBits = (IsFormatInt(p.OutFormat) ?
+    GetFormatBits(p.OutFormat) : 0);
+  
+  return p.SkipFilter || p.InitializeDerivedParameters();
 }
 
 void FileIO::GetNormalizationScaleAndBitShift(float64& Scale, int64& BitShift)
@@ -1179,7 +1296,8 @@ void FileIO::InitializeChunks(int64 Frames, int64 Channels, bool IsInt,
 }
 
 FileIO::FileIO() : OutChunk(0), OutChunkInt(0), Clipped(false),
-  UseDither(true)
+  UseDither(true), OutputFile(0), OutputParameters(0), Amplification(1.0),
+  Limiting(false), Completed(false)
 {
   /*We want dithering to always return the same result on consecutive runs. In
   dithering we are only concerned with the stochastic distribution of the
@@ -1187,6 +1305,83 @@ FileIO::FileIO() : OutChunk(0), OutChunkInt(0), Clipped(false),
   RandomNumberGenerator.PickSequence(10271985);
 }
 
+void FileIO::Write(const float64* Frames, int64 Count)
+{
+  while(Count > 0)
+  {
+    //Limit or copy as much as fits in the out chunk.
+    int64 Piece = math::Min(Count, FramesPerChunk);
+    int64 Ready = Piece;
+    if(Limiting)
+      Ready = OutputLimiter.Process(Frames, OutChunk, Piece);
+    else
+      Memory::CopyArray(OutChunk, Frames, Piece * ChannelsPerChunk);
+    WriteOutChunk(Ready);
+    
+    Frames += Piece * ChannelsPerChunk;
+    Count -= Piece;
+  }
+}
+
+void FileIO::WriteOutChunk(int64 Frames)
+{
+  //Zero out any portion that is not written.
+  int64 Samples = Frames * ChannelsPerChunk;
+  int64 ChunkSamples = FramesPerChunk * ChannelsPerChunk;
+  Memory::ClearArray(&OutChunk[Samples], ChunkSamples - Samples);
+  
+  if(OutputIsIntType)
+  {
+    //Convert to integer format.
+    OutChunkToOutChunkInt(OutputParameters->DitherType,
+      OutputParameters->DitherBits, Amplification);
+    
+    //Write the data to file.
+    sf_writef_int(OutputFile, OutChunkInt, (sf_count_t)Frames);
+  }
+  else
+  {
+    //Check for clipping in the normalized double.
+    float64 Lowest = 0.0, Highest = 0.0;
+    Kernels<float64>::Get().FindRange(OutChunk, 1, Samples, &Lowest,
+      &Highest);
+    if(Lowest < -1.0 || Highest > 1.0)
+      Clipped = true;
+    
+    //Write the data to file.
+    sf_writef_double(OutputFile, OutChunk, (sf_count_t)Frames);
+  }
+}
+
+void FileIO::WriteScratch(Scratch& s_scratch)
+{
+  float64* CopyMemory = new float64[ChannelsPerChunk * FramesPerChunk];
+  int64 ScratchPosition = 0;
+  int64 FramesRead;
+  do
+  {
+    //Read in a block from the scratch.
+    FramesRead = s_scratch.Read(ScratchPosition, CopyMemory, FramesPerChunk);
+    ScratchPosition += FramesRead;
+    Write(CopyMemory, FramesRead);
+  } while(FramesRead > 0);
+  delete [] CopyMemory;
+}
+
+void FileIO::FinishOutput(void)
+{
+  //Run silence through the limiter until the frames it holds back are out.
+  if(!Limiting)
+    return;
+  int64 Remaining = OutputLimiter.LookAhead;
+  while(Remaining > 0)
+  {
+    int64 Piece = math::Min(Remaining, FramesPerChunk);
+    WriteOutChunk(OutputLimiter.Process(0, OutChunk, Piece));
+    Remaining -= Piece;
+  }
+}
+
 void FileIO::CleanupChunks(void)
 {
   delete [] OutChunk;
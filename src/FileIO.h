@@ -30,9 +30,11 @@
 #define BRICK_FILEIO_H
 
 #include "Libraries.h"
+#include "Limiter.h"
 #include "Parameters.h"
+#include "Render.h"
 
-struct FileIO
+struct FileIO : public RenderSink
 {
   int64 FramesPerChunk;
   int64 ChannelsPerChunk;
@@ -47,6 +49,20 @@ struct FileIO
   
   Random RandomNumberGenerator;
   
+  /**The output file, and how the frames written to it are scaled, or limited
+  in a single pass.*/
+  SNDFILE* OutputFile;
+  Parameters* OutputParameters;
+  float64 Amplification;
+  Limiter OutputLimiter;
+  bool Limiting;
+  
+  ///Levels of the output before it is scaled or limited.
+  RenderLevels OutputLevels;
+  
+  ///Whether the last conversion ran to the end and its output was written.
+  bool Completed;
+  
   FileIO();
   ~FileIO();
 
@@ -60,6 +76,18 @@ struct FileIO
     float64 NormalizationScale);
   void InitializeChunks(int64 Frames, int64 Channels, bool IsInt, 
     int64 IntBits);
+  
+  ///Writes frames to the output file, through the limiter when limiting.
+  void Write(const float64* Frames, int64 Count);
+  
+  ///Converts and writes the first frames of the out chunk to the output file.
+  void WriteOutChunk(int64 Frames);
+  
+  ///Writes the whole scratch to the output file.
+  void WriteScratch(Scratch& s_scratch);
+  
+  ///Writes out the frames still held back by the limiter.
+  void FinishOutput(void);
 
   int GetFormatEnum(String Format);
   bool IsFormatInt(String Format);
@@ -72,6 +100,14 @@ struct FileIO
   
   void Go(Parameters& p);
   
+  /**Works out the rate change, the output format, the machine limits and the
+  scratch of a conversion from the rate and sample type of its input, and then
+  the parameters derived from them, as the render uses them. The channels,
+  frames and convolution handle of the parameters must be set. Returns false
+  if the filter can not be planned.*/
+  bool PlanConversion(Parameters& p, int64 InputSampleRate,
+    String InputSampleType);
+  
   void MakeSpectrogram(Parameters& p, SNDFILE* s);
   
   //Inline functions
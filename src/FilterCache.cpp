@@ -0,0 +1,268 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#include "FilterCache.h"
+
+#if JUCE_WINDOWS
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+//Statics...
+bool FilterCache::Enabled = false;
+juce::File FilterCache::Folder;
+juce::CriticalSection FilterCache::Lock;
+List<FilterCache::Entry*> FilterCache::Entries;
+
+///Fills in the header of a stored filter of the given size.
+static void InitializeHeader(FilterCache::FileHeader& h, int64 Bytes)
+{
+  const char* Magic = "BrickLPF";
+  Memory::ClearObject(h);
+  for(count i = 0; i < 8; i++)
+    h.Magic[i] = Magic[i];
+  h.Version = FilterCache::FileVersion;
+  h.Bytes = Bytes;
+}
+
+void* FilterCache::Acquire(const String& Key, int64 Bytes)
+{
+  const juce::ScopedLock sl(Lock);
+  for(count i = 0; i < Entries.n(); i++)
+  {
+    Entry* e = Entries[i];
+    if(e->Key == Key && e->Bytes == Bytes)
+    {
+      e->Users++;
+      return e->Data;
+    }
+  }
+  
+  //Map the filter in if an earlier run stored it.
+  Entry* e = Map(Key, Bytes);
+  if(!e)
+    return 0;
+  e->Users = 1;
+  Entries.Add() = e;
+  return e->Data;
+}
+
+void* FilterCache::Share(const String& Key, const void* Data, int64 Bytes)
+{
+  //Copy the filter outside of the lock, since it may be large.
+  Entry* e = new Entry;
+  e->Key = Key;
+  e->Data = new byte[Bytes];
+  e->Bytes = Bytes;
+  e->Users = 1;
+  Memory::CopyArray(e->Data, (const byte*)Data, Bytes);
+  
+  //Another render may have kept the same filter while it was being copied.
+  const juce::ScopedLock sl(Lock);
+  void* Kept = Acquire(Key, Bytes);
+  if(Kept)
+  {
+    Free(e);
+    return Kept;
+  }
+  Entries.Add() = e;
+  return e->Data;
+}
+
+void FilterCache::Store(const String& Key, const void* Data, int64 Bytes)
+{
+  Console c;
+  if(Folder.getFullPathName().isEmpty() || Bytes > MaxFileBytes)
+    return;
+  juce::File f = GetFile(Key);
+  if(f.existsAsFile() || !Folder.createDirectory())
+    return;
+  
+  /*Write to a file of its own first and then rename it, so that another run
+  never maps a filter that is only partly written.*/
+  FileHeader h;
+  InitializeHeader(h, Bytes);
+  juce::File Part = Folder.getChildFile(f.getFileName() +
+    ".part").getNonexistentSibling(false);
+  juce::FileOutputStream* Out = Part.createOutputStream();
+  bool Written = Out && !Out->failedToOpen() &&
+    Out->write(&h, (int)sizeof(h)) && Out->write(Data, (int)Bytes);
+  delete Out;
+  if(!Written || !Part.moveFileTo(f))
+  {
+    Part.deleteFile();
+    return;
+  }
+  c += "Stored the filter in '"; c &= f.getFullPathName().toUTF8(); c &= "'.";
+}
+
+void FilterCache::Release(const void* Data)
+{
+  const juce::ScopedLock sl(Lock);
+  for(count i = 0; i < Entries.n(); i++)
+  {
+    Entry* e = Entries[i];
+    if(e->Data == Data)
+    {
+      e->Users--;
+      if(!Enabled && e->Users <= 0)
+      {
+        Free(e);
+        Entries.Remove(i);
+      }
+      return;
+    }
+  }
+}
+
+void FilterCache::Trim(void)
+{
+  const juce::ScopedLock sl(Lock);
+  for(count i = Entries.n() - 1; i >= 0; i--)
+  {
+    Entry* e = Entries[i];
+    if(e->Users > 0)
+      continue;
+    Free(e);
+    Entries.Remove(i);
+  }
+}
+
+void FilterCache::Trim(const String& Key)
+{
+  const juce::ScopedLock sl(Lock);
+  for(count i = Entries.n() - 1; i >= 0; i--)
+  {
+    Entry* e = Entries[i];
+    if(e->Users > 0 || e->Key != Key)
+      continue;
+    Free(e);
+    Entries.Remove(i);
+  }
+}
+
+juce::File FilterCache::GetFile(const String& Key)
+{
+  //The key only has digits, letters, underscores and minus signs.
+  return Folder.getChildFile(juce::String(Key.Merge()) + ".lpf");
+}
+
+FilterCache::Entry* FilterCache::Map(const String& Key, int64 Bytes)
+{
+  if(Folder.getFullPathName().isEmpty())
+    return 0;
+  juce::File f = GetFile(Key);
+  int64 FileBytes = (int64)sizeof(FileHeader) + Bytes;
+  if(!f.existsAsFile() || f.getSize() != FileBytes ||
+    (int64)(size_t)FileBytes != FileBytes)
+      return 0;
+  String Filename = f.getFullPathName().toUTF8();
+  
+  //The filter is only read, so the mapping is read-only and private.
+  void* View = 0;
+  uintptr MapFile = 0, MapHandle = 0;
+#if JUCE_WINDOWS
+  HANDLE FileHandle = CreateFileA(Filename, GENERIC_READ, FILE_SHARE_READ |
+    FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+  if(FileHandle == INVALID_HANDLE_VALUE)
+    return 0;
+  HANDLE MappingHandle = CreateFileMappingA(FileHandle, 0, PAGE_READONLY, 0, 0,
+    0);
+  if(MappingHandle)
+    View = MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0,
+      (SIZE_T)FileBytes);
+  if(!View)
+  {
+    if(MappingHandle)
+      CloseHandle(MappingHandle);
+    CloseHandle(FileHandle);
+    return 0;
+  }
+  MapFile = (uintptr)FileHandle;
+  MapHandle = (uintptr)MappingHandle;
+#else
+  int FileDescriptor = open(Filename, O_RDONLY);
+  if(FileDescriptor < 0)
+    return 0;
+  View = mmap(0, (size_t)FileBytes, PROT_READ, MAP_PRIVATE, FileDescriptor, 0);
+  if(!View || View == MAP_FAILED)
+  {
+    close(FileDescriptor);
+    return 0;
+  }
+  MapFile = (uintptr)FileDescriptor;
+#endif
+  
+  Entry* e = new Entry;
+  e->Key = Key;
+  e->Data = (byte*)View + sizeof(FileHeader);
+  e->Bytes = Bytes;
+  e->Mapped = true;
+  e->View = View;
+  e->MappedBytes = FileBytes;
+  e->MapFile = MapFile;
+  e->MapHandle = MapHandle;
+  
+  //Only use a whole filter of the same version and size.
+  FileHeader Expected;
+  InitializeHeader(Expected, Bytes);
+  const FileHeader* h = (const FileHeader*)View;
+  bool Valid = h->Version == Expected.Version && h->Bytes == Expected.Bytes;
+  for(count i = 0; i < 8; i++)
+    Valid = Valid && h->Magic[i] == Expected.Magic[i];
+  if(!Valid)
+  {
+    Free(e);
+    return 0;
+  }
+  
+  Console c;
+  c += "Mapped the stored filter '"; c &= Filename; c &= "' into memory.";
+  return e;
+}
+
+void FilterCache::Free(Entry* e)
+{
+  if(e->Mapped)
+  {
+#if JUCE_WINDOWS
+    UnmapViewOfFile(e->View);
+    CloseHandle((HANDLE)e->MapHandle);
+    CloseHandle((HANDLE)e->MapFile);
+#else
+    munmap(e->View, (size_t)e->MappedBytes);
+    close((int)e->MapFile);
+#endif
+  }
+  else
+    delete [] e->Data;
+  delete e;
+}
@@ -0,0 +1,133 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#ifndef FILTERCACHE_H
+#define FILTERCACHE_H
+
+#include "Libraries.h"
+
+/**Finished filters (the spectra of FilterFFT, or the direct taps), kept so that
+renders with the same design can share one copy instead of each designing and
+transforming its own. Only a filter that is applied in a single pass is kept,
+looked up by the key of its design (see Parameters::FilterKey). Each render
+that uses a filter holds on to it until it is done.
+
+Within a process, the cache is off unless a batch turns it on, and a filter no
+render holds stays until the cache is trimmed. Across processes, filters are
+stored in a folder next to the wisdom, one file per key, laid out so that the
+filter can be mapped straight into memory and used as it is. A render that
+finds its filter there starts on the audio without designing anything.*/
+struct FilterCache
+{
+  ///A filter and the number of renders using it.
+  struct Entry
+  {
+    String Key;
+    byte* Data;
+    int64 Bytes;
+    int64 Users;
+    
+    ///Whether Data is in a mapping of a stored filter, and its handles.
+    bool Mapped;
+    void* View;
+    int64 MappedBytes;
+    uintptr MapFile;
+    uintptr MapHandle;
+    
+    Entry() : Data(0), Bytes(0), Users(0), Mapped(false), View(0),
+      MappedBytes(0), MapFile(0), MapHandle(0) {}
+  };
+  
+  /**Start of a stored filter file. The filter follows it, 64 bytes into the
+  file, so that a mapping of the file leaves the filter aligned for SIMD.*/
+  struct FileHeader
+  {
+    char Magic[8];
+    int64 Version;
+    int64 Bytes;
+    int64 Reserved[5];
+  };
+  
+  ///Changed whenever the design of a filter with the same key changes.
+  static const int64 FileVersion = 2;
+  
+  ///Largest filter stored on disk, so that the folder stays a reasonable size.
+  static const int64 MaxFileBytes = 256 * 1024 * 1024;
+  
+  ///Whether filters are kept in memory between renders.
+  static bool Enabled;
+  
+  ///Folder of the stored filters (none if the path is empty).
+  static juce::File Folder;
+  
+  ///Guards the entries, which renders on several threads look up at once.
+  static juce::CriticalSection Lock;
+  
+  static List<Entry*> Entries;
+  
+  ///Whether a render should look for its filter at all.
+  static bool IsOn(void)
+  {
+    return Enabled || Folder.getFullPathName().isNotEmpty();
+  }
+  
+  /**Returns the filter kept under the key and takes a use of it, or null if
+  there is none of that size. A filter that is not in memory is looked for in
+  the folder of stored filters.*/
+  static void* Acquire(const String& Key, int64 Bytes);
+  
+  /**Keeps a copy of a filter that has just been designed, and takes a use of
+  it. If another render kept the same filter in the meantime, that one is
+  used. Returns the copy to use in place of the original.*/
+  static void* Share(const String& Key, const void* Data, int64 Bytes);
+  
+  /**Stores a filter that has just been designed in the folder of stored
+  filters, if there is one and the filter is not too large.*/
+  static void Store(const String& Key, const void* Data, int64 Bytes);
+  
+  /**Gives up a use of a filter returned by Acquire or Share. Unless filters are
+  kept in memory, a filter is freed as soon as nothing uses it.*/
+  static void Release(const void* Data);
+  
+  ///Frees the filters that no render is using.
+  static void Trim(void);
+  
+  ///Frees the filter kept under the key, unless a render is using it.
+  static void Trim(const String& Key);
+  
+  ///Returns the file of the filter stored under the key.
+  static juce::File GetFile(const String& Key);
+  
+  ///Maps a stored filter into memory, or returns null if it is not usable.
+  static Entry* Map(const String& Key, int64 Bytes);
+  
+  ///Frees the memory or the mapping of an entry, and the entry.
+  static void Free(Entry* e);
+};
+
+#endif
@@ -167,6 +167,13 @@ void GlobalInfo::CreateListOfParameters(void)
   AddParameter("allowablebandwidthloss", "");
   AddParameter("depth", "");
   AddParameter("nofilter", "");
+  AddParameter("nopolyphase", "");
+  AddParameter("nodirect", "");
+  AddParameter("nopartition", "");
+  AddParameter("nosingle", "");
+  AddParameter("nopairs", "");
+  AddParameter("nocascade", "");
+  AddParameter("nohalfband", "");
   AddParameter("pitchshift", "");
   AddParameter("centstolerance", "");
   /*AddParameter("lpfcutoff", "");
@@ -177,6 +184,8 @@ void GlobalInfo::CreateListOfParameters(void)
   AddParameter("hpfdepth", "");*/
   AddParameter("dither", "");
   AddParameter("ditherbits", "");
+  AddParameter("normalize", "");
+  AddParameter("levels", "");
   
   /*AddParameter("keeporiginallength", "");
   AddParameter("forceoriginallength", "");
@@ -194,6 +203,9 @@ void GlobalInfo::CreateListOfParameters(void)
   AddParameter("gradientrange", "");
   AddParameter("convolve", "");
   AddParameter("exportfilter", "");
+  AddParameter("batch", "");
+  AddParameter("jobs", "");
+  AddParameter("threads", "");
 }
 
 bool GlobalInfo::IsSpecified(String Name)
@@ -257,6 +269,41 @@ bool GlobalInfo::CheckParameterExclusions(void)
       c += "--allowablebandwidthloss parameter incompatible with --nofilter";
       return false;
     }
+    if(IsSpecified("nopolyphase"))
+    {
+      c += "--nopolyphase parameter incompatible with --nofilter";
+      return false;
+    }
+    if(IsSpecified("nodirect"))
+    {
+      c += "--nodirect parameter incompatible with --nofilter";
+      return false;
+    }
+    if(IsSpecified("nopartition"))
+    {
+      c += "--nopartition parameter incompatible with --nofilter";
+      return false;
+    }
+    if(IsSpecified("nosingle"))
+    {
+      c += "--nosingle parameter incompatible with --nofilter";
+      return false;
+    }
+    if(IsSpecified("nopairs"))
+    {
+      c += "--nopairs parameter incompatible with --nofilter";
+      return false;
+    }
+    if(IsSpecified("nocascade"))
+    {
+      c += "--nocascade parameter incompatible with --nofilter";
+      return false;
+    }
+    if(IsSpecified("nohalfband"))
+    {
+      c += "--nohalfband parameter incompatible with --nofilter";
+      return false;
+    }
   }
   /*
   if(
@@ -331,6 +378,19 @@ bool GlobalInfo::CheckParameterExclusions(void)
     return false;
   }
   
+  if(IsSpecified("batch") && (IsSpecified("convolve") ||
+    IsSpecified("exportfilter")))
+  {
+    c += "--batch may not be used with --convolve or --exportfilter";
+    return false;
+  }
+  
+  if(IsSpecified("jobs") && !IsSpecified("batch"))
+  {
+    c += "--jobs may only be used with --batch";
+    return false;
+  }
+  
   if(IsSpecified("acquirewisdom") || IsSpecified("forgetwisdom"))
   {
     if(ParameterKeys.n() > 1)
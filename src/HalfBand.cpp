@@ -0,0 +1,203 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#include "HalfBand.h"
+
+#include "Kaiser.h"
+#include "Kernels.h"
+
+///Moves the last samples of a stream to its start, as the next history.
+static void KeepHistory(float64* Stream, int64 History, int64 New)
+{
+  //The samples move toward the start, so copying forward is safe.
+  for(int64 i = 0; i < History; i++)
+    Stream[i] = Stream[New + i];
+}
+
+int64 HalfBand::EstimateLength(float64 Passband, float64 StopbandAttenuation)
+{
+  /*In P-space (twice the lower rate), the band ends at half the Nyquist
+  frequency, and the transition is the same width on either side of it.*/
+  Kaiser KaiserLPF;
+  KaiserLPF.Initialize(Passband * 0.5, 1.0 - Passband, StopbandAttenuation);
+  int64 Half = (KaiserLPF.GetOrder() + 4) / 4;
+  return Half * 4 - 1;
+}
+
+bool HalfBand::Initialize(bool Up, int64 Channels, float64 Passband,
+  float64 StopbandAttenuation)
+{
+  Cleanup();
+  if(Channels < 1 || Passband <= 0.0 || Passband >= 1.0 ||
+    StopbandAttenuation <= 0.0)
+      return false;
+  
+  HalfBand::Up = Up;
+  HalfBand::Channels = Channels;
+  Length = EstimateLength(Passband, StopbandAttenuation);
+  Half = (Length + 1) / 4;
+  History = Half * 2 - 1;
+  BlockFrames = DefaultBlockFrames;
+  
+  /*Design the whole filter at the beta of the attenuation, with the cutoff on
+  the lower Nyquist frequency (half that of P-space), and keep the taps an odd
+  distance from the center, which are the even ones from the start.*/
+  Kaiser Estimate;
+  Estimate.Initialize(Passband * 0.5, 1.0 - Passband, StopbandAttenuation);
+  Kaiser KaiserLPF;
+  KaiserLPF.Initialize(Length, Estimate.GetBeta(), 0.5);
+  float64* Taps = new float64[Length];
+  KaiserLPF.CreateLPFInPlace(Taps, 0, Length);
+  float64 Gain = (Up ? 2.0 : 1.0);
+  Coefficients = new float64[Half];
+  for(int64 t = 0; t < Half; t++)
+    Coefficients[t] = Taps[t * 2] * Gain;
+  CenterGain = Taps[Half * 2 - 1] * Gain;
+  delete [] Taps;
+  
+  int64 Span = History + BlockFrames;
+  Streams = new float64[Channels * Span];
+  Memory::ClearArray(Streams, Channels * Span);
+  if(!Up)
+  {
+    Odds = new float64[Channels * Span];
+    Memory::ClearArray(Odds, Channels * Span);
+  }
+  Filtered = new float64[BlockFrames];
+  FramesIn = Place = FramesOut = 0;
+  return true;
+}
+
+int64 HalfBand::FilterBlock(const float64* Input, int64 Frames,
+  float64* Output)
+{
+  const Kernels<float64>& k = Kernels<float64>::Get();
+  int64 Span = History + BlockFrames;
+  int64 Given = 0;
+  for(int64 c = 0; c < Channels; c++)
+  {
+    float64* Stream = &Streams[c * Span];
+    if(Up)
+    {
+      /*Output 2i is the symmetric filter over the input up to i, and output
+      2i + 1 is input i - K + 1 through the center tap.*/
+      for(int64 i = 0; i < Frames; i++)
+        Stream[History + i] = (Input ? Input[i * Channels + c] : 0.0);
+      k.SymmetricFilter(Filtered, &Stream[History], Coefficients, Half,
+        Frames);
+      float64* Frame = &Output[c];
+      for(int64 i = 0; i < Frames; i++, Frame += Channels * 2)
+      {
+        Frame[0] = Filtered[i];
+        Frame[Channels] = Stream[History + i - Half + 1] * CenterGain;
+      }
+      KeepHistory(Stream, History, Frames);
+      Given = Frames * 2;
+    }
+    else
+    {
+      /*Output m is the symmetric filter over the even samples up to m, plus
+      odd sample m - K through the center tap. Before the block, there may
+      have been one more even sample than odd ones.*/
+      float64* Odd = &Odds[c * Span];
+      int64 Lag = (Place + 1) / 2 - Place / 2;
+      int64 Evens = 0, OddCount = 0;
+      for(int64 i = 0; i < Frames; i++)
+      {
+        float64 x = (Input ? Input[i * Channels + c] : 0.0);
+        if((Place + i) % 2 == 0)
+          Stream[History + Evens++] = x;
+        else
+          Odd[History + OddCount++] = x;
+      }
+      k.SymmetricFilter(Filtered, &Stream[History], Coefficients, Half,
+        Evens);
+      const float64* Center = &Odd[History + Lag - Half];
+      for(int64 m = 0; m < Evens; m++)
+        Output[m * Channels + c] = Filtered[m] + Center[m] * CenterGain;
+      KeepHistory(Stream, History, Evens);
+      KeepHistory(Odd, History, OddCount);
+      Given = Evens;
+    }
+  }
+  Place += Frames;
+  return Given;
+}
+
+int64 HalfBand::Process(const float64* Input, int64 Frames, float64* Output)
+{
+  int64 Given = 0;
+  for(int64 Taken = 0; Taken < Frames;)
+  {
+    int64 n = math::Min(InputBlockSize(), Frames - Taken);
+    Given += FilterBlock(&Input[Taken * Channels], n,
+      &Output[Given * Channels]);
+    Taken += n;
+  }
+  FramesIn += Frames;
+  FramesOut += Given;
+  return Given;
+}
+
+int64 HalfBand::Flush(float64* Output)
+{
+  //Run silence through the filter until the end of the filter is given out.
+  int64 Remaining = OutputFrames(FramesIn) - FramesOut;
+  if(Remaining <= 0)
+    return 0;
+  int64 Given = math::Min(FilterBlock(0, InputBlockSize(), Output), Remaining);
+  FramesOut += Given;
+  return Given;
+}
+
+int64 HalfBand::OutputFrames(int64 InputFrames)
+{
+  if(InputFrames < 1 || !Length)
+    return 0;
+  return (Up ? (InputFrames - 1) * 2 + Length :
+    (InputFrames + Length - 2) / 2 + 1);
+}
+
+int64 HalfBand::MaxOutputFrames(int64 InputFrames)
+{
+  return (Up ? InputFrames * 2 : InputFrames / 2 + 1);
+}
+
+void HalfBand::Cleanup(void)
+{
+  delete [] Coefficients;
+  delete [] Streams;
+  delete [] Odds;
+  delete [] Filtered;
+  Coefficients = 0;
+  Streams = 0;
+  Odds = 0;
+  Filtered = 0;
+  Half = Length = History = BlockFrames = 0;
+  FramesIn = Place = FramesOut = 0;
+}
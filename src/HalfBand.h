@@ -0,0 +1,133 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#ifndef HALFBAND_H
+#define HALFBAND_H
+
+#include "Libraries.h"
+
+/**Changes the rate by exactly two, up or down, with a half-band filter applied
+directly in the time domain. A half-band filter's transition is centered on the
+Nyquist frequency of the lower rate, which makes every other tap from the
+center zero, apart from the center itself (one half). Its taps are also
+symmetric. Upsampling then takes every other output straight from the input,
+and the rest are a symmetric filter of half the taps over the input.
+Downsampling filters the even input samples the same way and adds half of an
+odd one. Each of the taps that is left filters a pair of samples with one
+multiply, so a quarter of the filter is applied per output frame.
+
+The filter is the Kaiser window design of the other filters, with the length
+rounded up to 4K - 1 so that its ends are the nonzero taps. Like the other
+renders, the output is that of the whole filter in P-space, starting with its
+delay, so OutputFrames matches the formula of the streaming resampler.*/
+class HalfBand
+{
+  ///Whether the rate goes up, and the number of interleaved channels.
+  bool Up;
+  int64 Channels;
+  
+  ///Nonzero taps on each side of the center (K), and the length 4K - 1.
+  int64 Half;
+  int64 Length;
+  
+  ///Samples of each stream kept from the last block (2K - 1).
+  int64 History;
+  
+  ///Most new samples of a stream in a block.
+  int64 BlockFrames;
+  
+  ///The first half of the symmetric taps, with the gain of the rate change.
+  float64* Coefficients;
+  
+  ///Gain of the center tap (one, or one half when downsampling).
+  float64 CenterGain;
+  
+  /**For each channel, the history and the new samples of the input of the
+  symmetric filter: the input when upsampling, the even samples otherwise.*/
+  float64* Streams;
+  
+  ///For each channel, the odd samples of the input (downsampling only).
+  float64* Odds;
+  
+  ///Output of the symmetric filter for one channel of a block.
+  float64* Filtered;
+  
+  ///Frames of input taken (with the silence that ends it) and given out.
+  int64 FramesIn;
+  int64 Place;
+  int64 FramesOut;
+  
+  ///Filters one block of input frames into interleaved output frames.
+  int64 FilterBlock(const float64* Input, int64 Frames, float64* Output);
+  
+  public:
+  
+  ///Most new frames of a stream in a block.
+  static const int64 DefaultBlockFrames = 4096;
+  
+  HalfBand() : Up(true), Channels(0), Half(0), Length(0), History(0),
+    BlockFrames(0), Coefficients(0), CenterGain(0), Streams(0), Odds(0),
+    Filtered(0), FramesIn(0), Place(0), FramesOut(0) {}
+  
+  ~HalfBand() {Cleanup();}
+  
+  /**Length of the half-band filter that keeps the passband, as a fraction of
+  the lower Nyquist frequency, with its stopband as far above it.*/
+  static int64 EstimateLength(float64 Passband, float64 StopbandAttenuation);
+  
+  /**Designs the filter for the passband, as a fraction of the Nyquist
+  frequency of the lower rate, and allocates everything. Returns false if the
+  band does not make sense.*/
+  bool Initialize(bool Up, int64 Channels, float64 Passband,
+    float64 StopbandAttenuation);
+  
+  /**Filters interleaved input frames, which may be any number, and returns the
+  number of output frames. The output has room for MaxOutputFrames(Frames).*/
+  int64 Process(const float64* Input, int64 Frames, float64* Output);
+  
+  /**Gives the next output after the input has ended, up to the end of the
+  filter, with room for OutputBlockSize() frames. Returns zero at the end.*/
+  int64 Flush(float64* Output);
+  
+  ///Output frames there are in total for a number of input frames.
+  int64 OutputFrames(int64 InputFrames);
+  
+  ///Most output frames that Process can give for a number of input frames.
+  int64 MaxOutputFrames(int64 InputFrames);
+  
+  ///Input frames of each block, and the most output frames that each gives.
+  int64 InputBlockSize(void) {return (Up ? BlockFrames : BlockFrames * 2);}
+  int64 OutputBlockSize(void) {return (Up ? BlockFrames * 2 : BlockFrames);}
+  
+  ///Length of the filter in P-space.
+  int64 GetLength(void) {return Length;}
+  
+  void Cleanup(void);
+};
+
+#endif
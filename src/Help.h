@@ -31,6 +31,7 @@ void DoHelp(void)
   Console c;
   c += "Usage: brick inputfile.aiff outputfile.wav [settings]";
   c += "       brick inputfile.aiff outputspectrogram.png [settings]";
+  c += "       brick --batch=manifest.txt [settings]";
   c += "";
   c += "  Brick can read and write multi-channel .aiff (or .aif), .wav, .au, .raw";
   c += "  ";
@@ -42,6 +43,9 @@ void DoHelp(void)
   c += "  Brick is a non-destructive resampler. It can not be used to resample a file";
   c += "  in place.";
   c += "  ";
+  c += "  Either file can be '-' for standard input or output, or a named pipe. These";
+  c += "  are streamed in a single pass without a scratch file (see STREAMING).";
+  c += "  ";
   c += "  The [settings] can be combinations of the following:";
   c += "  ";
   c += "                                   *****";
@@ -102,6 +106,49 @@ void DoHelp(void)
   c += "  rate. This option is also used internally when the overall sample rate ratio";
   c += "  stays the same (i.e., 44.1kHz to 88.2kHz with a +1 pitch-shift).";
   c += "  ";
+  c += "  --nopolyphase";
+  c += "  When upsampling, the filter is normally split into one sub-filter per output";
+  c += "  phase so that the zeroes between the upsampled input samples are never";
+  c += "  transformed. This option forces the original zero-stuffing algorithm instead,";
+  c += "  which gives the same result more slowly.";
+  c += "  ";
+  c += "  --nodirect";
+  c += "  Short filters (low depth or wide allowable bandwidth loss) are normally";
+  c += "  applied directly in the time domain, one dot product per output sample,";
+  c += "  whenever that is estimated to be cheaper than FFT convolution. This option";
+  c += "  always uses FFT convolution instead.";
+  c += "  ";
+  c += "  --nopartition";
+  c += "  When the filter is too long for one transform, its partitions are normally";
+  c += "  all applied in a single pass over the input, keeping the spectra of the";
+  c += "  recent input blocks in memory. This option splits the filter into passes";
+  c += "  instead, each of which reads the whole input again. With --convolve, it also";
+  c += "  turns off the growing partitions.";
+  c += "  ";
+  c += "  --nosingle";
+  c += "  When the output is integer with 24 bits or fewer and the depth is 140dB or";
+  c += "  less, the filter is normally applied in single precision, which is faster";
+  c += "  and takes half the memory. This option keeps it in double precision.";
+  c += "  ";
+  c += "  --nopairs";
+  c += "  Channels are normally filtered two at a time, as the real and imaginary parts";
+  c += "  of one complex transform, which halves the number of transforms for stereo.";
+  c += "  This option transforms each channel on its own instead.";
+  c += "  ";
+  c += "  --nocascade";
+  c += "  When P or Q is large (as in 44.1kHz to 48kHz), the rate is normally changed";
+  c += "  in several stages: a rate change of two that has the narrow transition of the";
+  c += "  filter, and the rest of the ratio with a wide transition. Together they take";
+  c += "  a small fraction of the taps of a single filter. This option always uses the";
+  c += "  single filter instead, as does --exportfilter.";
+  c += "  ";
+  c += "  --nohalfband";
+  c += "  Stages that change the rate by two (as in 4x oversampling, or decimating by";
+  c += "  2x and 4x) are normally half-band filters applied directly when that is";
+  c += "  faster than the transforms, and power-of-two ratios then always use the";
+  c += "  stages. They keep the full stopband. This option applies those stages with";
+  c += "  the transforms instead.";
+  c += "  ";
   c += "                                   *****";
   c += "";
   c += "  PITCH SHIFT";
@@ -135,6 +182,30 @@ void DoHelp(void)
   c += "  ";
   c += "                                   *****";
   c += "";
+  c += "  STREAMING";
+  c += "  When the input or output file is '-' (standard input or output) or a named";
+  c += "  pipe, the audio is resampled as it is read and written as it is made, using a";
+  c += "  few blocks of memory however long the audio is. The filter has to be applied";
+  c += "  in one pass, so a very long filter may not be usable. Standard input is read";
+  c += "  as raw data if --inputsampleformat is given. Standard output is written in";
+  c += "  the container of the input, and the length in its header is not filled in,";
+  c += "  so it should be read until it ends. All other messages go to standard error";
+  c += "  when the output is standard output.";
+  c += "  ";
+  c += "  --normalize=peak [peak limit none]";
+  c += "  How the output is kept from clipping. 'peak' attenuates the whole output to";
+  c += "  fit its peak, which is only known at the end, so it is not possible when";
+  c += "  streaming. 'limit' turns the gain down 5 ms ahead of a peak that would clip";
+  c += "  and lets it recover over 50 ms. 'none' writes the output as it is (floating";
+  c += "  point output can go past full scale). The default is 'peak', and for streams";
+  c += "  'limit' for integer output and 'none' for floating point.";
+  c += "  ";
+  c += "  --levels";
+  c += "  Reports the peak, RMS and DC levels of each channel of the output (before any";
+  c += "  normalization), measured as the output is made.";
+  c += "  ";
+  c += "                                   *****";
+  c += "";
   c += "  SPECTROGRAM (mono and stereo only)";
   c += "  A spectrogram is made when the output file is of type '.png' (PNG) or";
   c += "  '.jpg' (JPEG). For JPEG the highest quality compression will be used. The";
@@ -178,11 +249,34 @@ void DoHelp(void)
   c += "  --convolve=[impulseresponse.aiff/au/wav]";
   c += "  Performs convolution using the given impulse-response. Since the convolution";
   c += "  is calculated using the same algorithm used for sample-rate conversion, it";
-  c += "  will be very efficient.";
+  c += "  will be very efficient. When the sample rate stays the same, the response is";
+  c += "  cut into partitions that grow along it, so that even a response many seconds";
+  c += "  long is convolved in a single pass with little memory.";
   c += "  ";
   c += "  ";
   c += "                                   *****";
   c += "";
+  c += "  BATCH";
+  c += "  --batch=[manifest.txt]";
+  c += "  Converts every file listed in the manifest with the same settings, in one";
+  c += "  run. Each line of the manifest names an input file and then its output file,";
+  c += "  separated by spaces or tabs; put double quotes around a name with spaces in";
+  c += "  it. Blank lines and lines starting with '#' are skipped. Files with the same";
+  c += "  rate change are converted one after another, so that their filter is only";
+  c += "  designed once. Streams, raw input and spectrograms are not converted in a";
+  c += "  batch, and --convolve and --exportfilter may not be used with it.";
+  c += "  ";
+  c += "  --jobs=[1 2 3 nn] (integers only)";
+  c += "  The number of files converted at once. The default is one per thread. A file";
+  c += "  is only started when its memory fits in half of the memory of the machine,";
+  c += "  less what the files being converted are taking.";
+  c += "  ";
+  c += "  --threads=[1 2 3 nn] (integers only)";
+  c += "  The number of threads to use, shared between the files of a batch. The";
+  c += "  default is the number of CPUs.";
+  c += "  ";
+  c += "                                   *****";
+  c += "";
   c += "  WISDOM";
   c += "  Wisdom is an accumulation of machine-dependent optimizations that take place";
   c += "  during the plan-phase of the FFTs used in Brick (via FFTW). Wisdom is stored";
@@ -206,12 +300,18 @@ void DoHelp(void)
   c += "  accumulated all the wisdom up to that point. If you then begin acquiring";
   c += "  wisdom again, the system will pick up where you left off.";
   c += "  ";
+  c += "  Filters applied in a single pass are also stored next to the wisdom once";
+  c += "  they are designed, so that converting again with the same rates, depth and";
+  c += "  bandwidth loss starts on the audio right away. Filters larger than 256 MB";
+  c += "  are not stored.";
+  c += "  ";
   c += "  --forgetwisdom";
-  c += "  Deletes the cache of wisdom on your system. You should do this when you";
-  c += "  upgrade to a new version of Brick and re-run --acquirewisdom.";
+  c += "  Deletes the cache of wisdom and the stored filters on your system. You";
+  c += "  should do this when you upgrade to a new version of Brick and re-run";
+  c += "  --acquirewisdom.";
   c += "  ";
   c += "  --donotloadwisdom";
-  c += "  Forces the program to not load wisdom during this run.";
+  c += "  Forces the program to not load wisdom or stored filters during this run.";
   c += "  ";
   c += "  ";
   c += "                                   *****";
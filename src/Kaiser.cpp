@@ -154,9 +154,43 @@ float64 Kaiser::EstimateBeta(float64 dB_StopbandAttenuation)
     return 0.1102 * (dB_StopbandAttenuation - 8.7);
 }
 
+void Kaiser::PrepareDesign(void)
+{
+  /*The window is I0(z) / I0(beta) with z in [0, beta], and I0(z) is the sum of
+  t ^ k / (k!) ^ 2 over k, where t = (z / 2) ^ 2. Each term is the last times
+  t / k ^ 2, so once k + 1 > sqrt(t) the tail after term k is at most the next
+  term times 1 / (1 - t / (k + 2) ^ 2). The tail grows with t, so the bound at
+  z = beta covers the whole window. The series is cut at the first term where
+  the bound drops below 2 ^ -60 of I0(beta), which is below the rounding of the
+  window itself.*/
+  float64 t = fx_beta * fx_beta * 0.25, Term = 1.0;
+  float64 Tolerance = ldexp(1.0, -60) * Q;
+  Series[0] = 1.0;
+  SeriesTerms = 0;
+  for(int64 k = 1; k < MaxSeriesTerms && !SeriesTerms; k++)
+  {
+    float64 k2 = (float64)(k * k);
+    Series[k] = Series[k - 1] / k2;
+    Term *= t / k2;
+    float64 Next = Term * t / (float64)((k + 1) * (k + 1));
+    float64 Ratio = t / (float64)((k + 2) * (k + 2));
+    if(Ratio < 1.0 && Next / (1.0 - Ratio) <= Tolerance)
+      SeriesTerms = k;
+  }
+  
+  //The sines of a block are made from its anchor by angle addition.
+  float64 Frequency = wc * fx_pi;
+  for(int64 i = 0; i < SineBlock + Lanes; i++)
+  {
+    BlockSines[i] = sin((float64)i * Frequency);
+    BlockCosines[i] = cos((float64)i * Frequency);
+  }
+}
+
 Kaiser::Kaiser() : fx_0(fx(0)),
   fx_1(fx(1)), fx_2(fx(2)), fx_pi(acos(fx_0) * fx_2), N(0), M(0), beta(0),
-  fx_2_div_M(fx(0)), fx_beta(fx(0)), Q(fx(0)), wc(0), tw(0), atten(0)
+  fx_2_div_M(fx(0)), fx_beta(fx(0)), Q(fx(0)), wc(0), tw(0), atten(0),
+  SeriesTerms(0), Threads(1)
 {
 }
 
@@ -174,6 +208,7 @@ void Kaiser::Initialize(float64 CutoffFrequency, float64 TransitionWidth,
   wc = CutoffFrequency;
   tw = TransitionWidth;
   atten = dB_StopbandAttenuation;
+  PrepareDesign();
 }
 
 void Kaiser::Initialize(int64 P, int64 Q, float64 AllowableBandwidthLoss,
@@ -187,6 +222,13 @@ void Kaiser::Initialize(int64 P, int64 Q, float64 AllowableBandwidthLoss,
 }
 
 void Kaiser::Initialize(int64 Length, float64 Beta)
+{
+  /*The cutoff doesn't matter -- just set it to something reasonable in case
+  user accidentally tries to create a low-pass filter.*/
+  Initialize(Length, Beta, 0.5);
+}
+
+void Kaiser::Initialize(int64 Length, float64 Beta, float64 CutoffFrequency)
 {
   //Set the parameters to the Kaiser window directly.
   N = Length;
@@ -195,12 +237,12 @@ void Kaiser::Initialize(int64 Length, float64 Beta)
   beta = Beta;
   fx_beta = fx(beta);
   Q = BesselI0(fx_beta);
+  wc = CutoffFrequency;
   
-  /*These don't matter -- just set them to something reasonable in case user
-  accidentally tries to create a low-pass filter.*/
-  wc = 0.5;
+  //These don't matter -- the design only uses the cutoff.
   tw = 0.1;
   atten = 100;
+  PrepareDesign();
 }
 
 int64 Kaiser::GetOrder(void)
@@ -249,21 +291,173 @@ void Kaiser::CreateWindowedFilter(Array<float64>& Window,
     WindowedFilter[i] = Window[i] * Filter[i];
 }
 
-void Kaiser::CreateLPFInPlace(float64* Head, count Start, count Samples)
+float64 Kaiser::GetLPFValue(int64 i)
 {
   int64 MiddleSample = (N - 1) / 2;
+  if(i == MiddleSample)
+    return wc;
   float64 fx_freq = wc * fx_pi;
-  int64 i_End = Start + Samples;
-  int64 j = 0;
-  for(int64 i = Start; i < i_End; i++, j++)
+  float64 fx_i = (float64)i - MiddleSample;
+  float64 x = fx_i * fx_freq;
+  return GetKaiserValue(i) * wc * (sin(x) / x);
+}
+
+void Kaiser::DesignTaps(float64* Taps, int64 First, int64 Count)
+{
+  //Taps past either end of the filter are zero.
+  int64 Middle = M / 2;
+  int64 Designed = math::Max(math::Min(Middle + 1 - First, Count), (int64)0);
+  Memory::ClearArray(&Taps[Designed], Count - Designed);
+  
+  //Without a series that keeps within its bound, sum the full one per tap.
+  if(!SeriesTerms)
+  {
+    for(int64 j = 0; j < Designed; j++)
+      Taps[j] = GetLPFValue(Middle + First + j);
+    return;
+  }
+  
+  float64 Frequency = wc * fx_pi;
+  float64 InverseMiddle = 1.0 / (float64)Middle;
+  float64 QuarterBetaSquared = fx_beta * fx_beta * 0.25;
+  float64 Scale = wc / Q;
+  for(int64 j = 0; j < Designed;)
   {
-    float64 fx_i = (float64)i - MiddleSample;
-    float64 x = fx_i * fx_freq;
-    float64 Value;
-    if(i == MiddleSample)
-      Value = wc;
-    else
-      Value = GetKaiserValue(i) * wc * (sin(x) / x);
-    Head[j] = Value;
+    /*Anchor the sines at every SineBlock-th distance, so that their rounding
+    does not build up along the filter, and so that they do not depend on how
+    the taps are split up.*/
+    int64 Anchor = First + j - (First + j) % SineBlock;
+    float64 AnchorSine = sin((float64)Anchor * Frequency);
+    float64 AnchorCosine = cos((float64)Anchor * Frequency);
+    int64 BlockEnd = math::Min(Anchor + SineBlock - First, Designed);
+    while(j < BlockEnd)
+    {
+      /*The lanes work on their own arrays, so that each step vectorizes. The
+      lanes past the end of the block are worked out but not kept.*/
+      int64 n = math::Min(Lanes, BlockEnd - j);
+      int64 Step = First + j - Anchor;
+      float64 t[Lanes], Sum[Lanes], Sinc[Lanes];
+      for(int64 k = 0; k < Lanes; k++)
+      {
+        float64 d = (float64)(First + j + k);
+        float64 v = d * InverseMiddle;
+        t[k] = QuarterBetaSquared * (1.0 - v) * (1.0 + v);
+        Sum[k] = Series[SeriesTerms];
+        Sinc[k] = (AnchorSine * BlockCosines[Step + k] +
+          AnchorCosine * BlockSines[Step + k]) / (d * Frequency);
+      }
+      
+      //Horner's rule on the series, whose terms are all positive.
+      for(int64 i = SeriesTerms - 1; i >= 0; i--)
+        for(int64 k = 0; k < Lanes; k++)
+          Sum[k] = Sum[k] * t[k] + Series[i];
+      
+      for(int64 k = 0; k < n; k++)
+        Taps[j + k] = Sum[k] * Scale * Sinc[k];
+      j += n;
+    }
   }
+  
+  //The middle tap is the cutoff itself.
+  if(First == 0 && Designed)
+    Taps[0] = wc;
+}
+
+///Designs a chunk of the taps of a filter on its own thread.
+struct KaiserDesigner : public juce::Thread
+{
+  Kaiser* k;
+  float64* Taps;
+  int64 First;
+  int64 Count;
+  
+  KaiserDesigner() : juce::Thread("BrickKaiserThread"), k(0), Taps(0),
+    First(0), Count(0) {}
+  
+  void run(void) {k->DesignTaps(Taps, First, Count);}
+};
+
+void Kaiser::DesignTapsInParallel(float64* Taps, int64 First, int64 Count)
+{
+  //Small filters are designed faster than threads can be started.
+  int64 Chunks = math::Min(Threads, Count / (int64)65536);
+  if(Chunks <= 1)
+  {
+    DesignTaps(Taps, First, Count);
+    return;
+  }
+  
+  //The chunks are whole blocks of sines, and this thread takes the last one.
+  int64 ChunkTaps = (Count / Chunks + SineBlock - 1) / SineBlock * SineBlock;
+  KaiserDesigner* Designers = new KaiserDesigner[Chunks - 1];
+  for(int64 i = 0; i < Chunks - 1; i++)
+  {
+    KaiserDesigner& d = Designers[i];
+    d.k = this;
+    d.Taps = &Taps[i * ChunkTaps];
+    d.First = First + i * ChunkTaps;
+    d.Count = ChunkTaps;
+    d.startThread();
+  }
+  int64 Done = (Chunks - 1) * ChunkTaps;
+  DesignTaps(&Taps[Done], First + Done, Count - Done);
+  for(int64 i = 0; i < Chunks - 1; i++)
+    Designers[i].waitForThreadToExit(-1);
+  delete [] Designers;
+}
+
+void Kaiser::SetThreads(int64 Threads)
+{
+  Kaiser::Threads = math::Max(Threads, (int64)1);
+}
+
+void Kaiser::CreateLPFInPlace(float64* Head, count Start, count Samples)
+{
+  //A filter of even length has no middle tap to mirror about.
+  int64 Middle = M / 2;
+  if(M % 2)
+  {
+    for(int64 i = 0; i < Samples; i++)
+      Head[i] = (i + Start < 0 || i + Start > M ? 0. : GetLPFValue(i + Start));
+    return;
+  }
+  
+  //Design the taps at or past the middle.
+  int64 End = Start + Samples;
+  int64 RightStart = math::Max(Start, Middle);
+  int64 Covered = -1;
+  if(RightStart < End)
+  {
+    DesignTapsInParallel(&Head[RightStart - Start], RightStart - Middle,
+      End - RightStart);
+    Covered = End - 1 - Middle;
+  }
+  
+  /*The taps before the middle are those at the same distance past it. Those
+  further out than the taps past the middle reach are designed in order of
+  distance, and then turned around.*/
+  int64 LeftEnd = math::Min(End, Middle);
+  int64 Uncovered = math::Min(LeftEnd, Middle - Covered);
+  if(Start < Uncovered)
+  {
+    int64 n = Uncovered - Start;
+    DesignTapsInParallel(Head, Middle - Uncovered + 1, n);
+    for(int64 i = 0, j = n - 1; i < j; i++, j--)
+    {
+      float64 Swap = Head[i];
+      Head[i] = Head[j];
+      Head[j] = Swap;
+    }
+  }
+  for(int64 i = math::Max(Start, Uncovered); i < LeftEnd; i++)
+    Head[i - Start] = Head[2 * Middle - i - Start];
+}
+
+void Kaiser::CreateLPFInPlace(float32* Head, count Start, count Samples)
+{
+  float64* Taps = new float64[Samples];
+  CreateLPFInPlace(Taps, Start, Samples);
+  for(int64 i = 0; i < Samples; i++)
+    Head[i] = (float32)Taps[i];
+  delete [] Taps;
 }
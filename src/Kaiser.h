@@ -46,6 +46,31 @@ class Kaiser
   ///Initialization parameters
   float64 wc, tw, atten;
   
+  ///Distances from the middle tap whose sines are made from the same anchor.
+  static const int64 SineBlock = 64;
+  
+  ///Taps designed side by side, so that the compiler can vectorize them.
+  static const int64 Lanes = 8;
+  
+  ///Most terms of the power series of I0 that the design will use.
+  static const int64 MaxSeriesTerms = 128;
+  
+  ///Coefficients 1 / (k!)^2 of the power series of I0 in (z / 2)^2.
+  float64 Series[MaxSeriesTerms];
+  
+  ///Last term of the series that keeps within the error bound (zero if none).
+  int64 SeriesTerms;
+  
+  ///Sines and cosines of the distances from the anchor of a block.
+  float64 BlockSines[SineBlock + Lanes];
+  float64 BlockCosines[SineBlock + Lanes];
+  
+  ///Threads that large filters are designed with.
+  int64 Threads;
+  
+  ///Prepares the series and the sines that the filter is designed from.
+  void PrepareDesign(void);
+  
   ///Converts constant value into floatx with appropriate precision.
   inline float64 fx(float64 x)
   {
@@ -83,6 +108,10 @@ class Kaiser
   ///Initialize by specify the parameters directly.
   void Initialize(int64 Length, float64 Beta);
   
+  /**Initialize by specifying the parameters directly, along with the cutoff of
+  the low-pass filter (in the same units as the cutoff frequency above).*/
+  void Initialize(int64 Length, float64 Beta, float64 CutoffFrequency);
+  
   ///Returns the length of the window that has been initialized.
   int64 GetOrder(void);
   
@@ -102,7 +131,24 @@ class Kaiser
   void CreateWindowedFilter(Array<float64>& Window, Array<float64>& Filter,
     Array<float64>& WindowedFilter);
     
-  ///Same as CreateWindowedFilter, but creates to pre-allocated memory.
+  ///Gets the value of the windowed low-pass filter at some index.
+  float64 GetLPFValue(int64 i);
+  
+  /**Same as CreateWindowedFilter, but creates to pre-allocated memory. Only
+  the taps at or past the middle are designed, and the others are mirrored.*/
   void CreateLPFInPlace(float64* Head, count Start, count Samples);
+  
+  ///Same as above, rounding the filter to single precision.
+  void CreateLPFInPlace(float32* Head, count Start, count Samples);
+  
+  /**Designs the taps at the given distances past the middle tap, in order of
+  distance. They are the same as those of GetLPFValue, give or take rounding.*/
+  void DesignTaps(float64* Taps, int64 First, int64 Count);
+  
+  ///Designs the taps as above, in chunks on several threads if there are many.
+  void DesignTapsInParallel(float64* Taps, int64 First, int64 Count);
+  
+  ///Sets the threads that large filters are designed with (one by default).
+  void SetThreads(int64 Threads);
 };
 #endif
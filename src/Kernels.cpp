@@ -0,0 +1,1035 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#include "Kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+  defined(_M_IX86)
+  #define BRICK_X86_KERNELS 1
+  #include <immintrin.h>
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #else
+    #include <cpuid.h>
+  #endif
+#endif
+
+//GCC and Clang only let a function use the instructions of its target.
+#if defined(__GNUC__)
+  #define BRICK_TARGET(Extensions) __attribute__((target(Extensions)))
+#else
+  #define BRICK_TARGET(Extensions)
+#endif
+
+//------------------------------------------------------------------------------
+//Scalar kernels
+//------------------------------------------------------------------------------
+
+template <class Sample>
+static void MultiplySpectrumScalar(Sample* Destination, const Sample* a,
+  const Sample* b, int64 Bins)
+{
+  int64 Bins_2 = Bins * 2;
+  for(int64 FreqSample = 0; FreqSample < Bins_2; FreqSample += 2)
+  {
+    int64 FreqSample_imag = FreqSample + 1;
+    
+    Sample r1 = a[FreqSample];
+    Sample r2 = b[FreqSample];
+    
+    Sample i1 = a[FreqSample_imag];
+    Sample i2 = b[FreqSample_imag];
+    
+    Destination[FreqSample] = r1 * r2 - i1 * i2;
+    Destination[FreqSample_imag] = r1 * i2 + r2 * i1;
+  }
+}
+
+template <class Sample>
+static void MultiplyAccumulateSpectrumScalar(Sample* Destination,
+  const Sample* a, const Sample* b, int64 Bins)
+{
+  int64 Bins_2 = Bins * 2;
+  for(int64 FreqSample = 0; FreqSample < Bins_2; FreqSample += 2)
+  {
+    int64 FreqSample_imag = FreqSample + 1;
+    
+    Sample r1 = a[FreqSample];
+    Sample r2 = b[FreqSample];
+    
+    Sample i1 = a[FreqSample_imag];
+    Sample i2 = b[FreqSample_imag];
+    
+    Destination[FreqSample] += r1 * r2 - i1 * i2;
+    Destination[FreqSample_imag] += r1 * i2 + r2 * i1;
+  }
+}
+
+template <class Sample>
+static void MultiplyRealSpectrumScalar(Sample* Destination, const Sample* a,
+  const Sample* Gains, int64 Bins)
+{
+  for(int64 Bin = 0; Bin < Bins; Bin++)
+  {
+    Destination[Bin * 2] = a[Bin * 2] * Gains[Bin];
+    Destination[Bin * 2 + 1] = a[Bin * 2 + 1] * Gains[Bin];
+  }
+}
+
+template <class Sample>
+static void GatherScalar(Sample* Destination, int64 DestinationHop,
+  const float64* Source, int64 SourceHop, int64 Samples)
+{
+  for(int64 i = 0; i < Samples; i++)
+  {
+    *Destination = (Sample)*Source;
+    Destination += DestinationHop;
+    Source += SourceHop;
+  }
+}
+
+template <class Sample>
+static void ScatterScalar(float64* Destination, int64 DestinationHop,
+  const Sample* Source, int64 SourceHop, int64 Samples)
+{
+  for(int64 i = 0; i < Samples; i++)
+  {
+    *Destination = (float64)*Source;
+    Destination += DestinationHop;
+    Source += SourceHop;
+  }
+}
+
+template <class Sample>
+static void ScatterAddScalar(float64* Destination, int64 DestinationHop,
+  const Sample* Source, int64 SourceHop, int64 Samples, float64 Scale)
+{
+  for(int64 i = 0; i < Samples; i++)
+  {
+    *Destination += (float64)*Source * Scale;
+    Destination += DestinationHop;
+    Source += SourceHop;
+  }
+}
+
+static void AddScaledScalar(float64* Destination, const float64* Source,
+  int64 Samples, float64 Scale)
+{
+  for(int64 i = 0; i < Samples; i++)
+    Destination[i] += Source[i] * Scale;
+}
+
+static void FindRangeScalar(const float64* Source, int64 SourceHop,
+  int64 Samples, float64* Minimum, float64* Maximum)
+{
+  float64 Low = *Minimum, High = *Maximum;
+  for(int64 i = 0; i < Samples; i++)
+  {
+    float64 Value = Source[i * SourceHop];
+    if(Value < Low) Low = Value;
+    if(Value > High) High = Value;
+  }
+  *Minimum = Low;
+  *Maximum = High;
+}
+
+static void SymmetricFilterScalar(float64* Destination, const float64* Source,
+  const float64* Taps, int64 Half, int64 Samples)
+{
+  int64 Last = Half * 2 - 1;
+  for(int64 i = 0; i < Samples; i++)
+  {
+    float64 Sum = 0;
+    for(int64 t = 0; t < Half; t++)
+      Sum += Taps[t] * (Source[i - t] + Source[i - Last + t]);
+    Destination[i] = Sum;
+  }
+}
+
+template <class Sample>
+static void UseScalar(Kernels<Sample>& k)
+{
+  k.MultiplySpectrum = MultiplySpectrumScalar<Sample>;
+  k.MultiplyAccumulateSpectrum = MultiplyAccumulateSpectrumScalar<Sample>;
+  k.MultiplyRealSpectrum = MultiplyRealSpectrumScalar<Sample>;
+  k.Gather = GatherScalar<Sample>;
+  k.Scatter = ScatterScalar<Sample>;
+  k.ScatterAdd = ScatterAddScalar<Sample>;
+  k.AddScaled = AddScaledScalar;
+  k.FindRange = FindRangeScalar;
+  k.SymmetricFilter = SymmetricFilterScalar;
+  k.InstructionSet = "none";
+}
+
+#ifdef BRICK_X86_KERNELS
+
+///Widens the range to take in lanes of lows and highs stored from registers.
+static void FoldRange(const float64* Lows, const float64* Highs, int64 Lanes,
+  float64* Minimum, float64* Maximum)
+{
+  float64 Unused = *Minimum;
+  FindRangeScalar(Lows, 1, Lanes, Minimum, &Unused);
+  Unused = *Maximum;
+  FindRangeScalar(Highs, 1, Lanes, &Unused, Maximum);
+}
+
+/*The complex products below work on pairs of interleaved real and imaginary
+parts (a + bi)(c + di). The real parts of the second spectrum are duplicated
+into both lanes of each pair and multiplied by the pair, the imaginary parts
+are duplicated and multiplied by the swapped pair, and the two are subtracted
+in the real lanes and added in the imaginary lanes: (ac - bd) + (bc + ad)i.*/
+
+//------------------------------------------------------------------------------
+//SSE2 kernels
+//------------------------------------------------------------------------------
+
+BRICK_TARGET("sse2")
+static inline __m128d ComplexProduct(__m128d x, __m128d y)
+{
+  //SSE2 has no add-subtract, so the sign of the real lane is flipped instead.
+  const __m128d RealSign = _mm_set_pd(0.0, -0.0);
+  __m128d Real = _mm_unpacklo_pd(y, y);
+  __m128d Imag = _mm_unpackhi_pd(y, y);
+  __m128d Swapped = _mm_shuffle_pd(x, x, 1);
+  return _mm_add_pd(_mm_mul_pd(x, Real),
+    _mm_xor_pd(_mm_mul_pd(Swapped, Imag), RealSign));
+}
+
+BRICK_TARGET("sse2")
+static inline __m128 ComplexProduct(__m128 x, __m128 y)
+{
+  const __m128 RealSign = _mm_set_ps(0.0f, -0.0f, 0.0f, -0.0f);
+  __m128 Real = _mm_shuffle_ps(y, y, _MM_SHUFFLE(2, 2, 0, 0));
+  __m128 Imag = _mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 3, 1, 1));
+  __m128 Swapped = _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm_add_ps(_mm_mul_ps(x, Real),
+    _mm_xor_ps(_mm_mul_ps(Swapped, Imag), RealSign));
+}
+
+BRICK_TARGET("sse2")
+static void MultiplySpectrumSSE2(float64* Destination, const float64* a,
+  const float64* b, int64 Bins)
+{
+  for(int64 i = 0; i < Bins * 2; i += 2)
+    _mm_storeu_pd(&Destination[i],
+      ComplexProduct(_mm_loadu_pd(&a[i]), _mm_loadu_pd(&b[i])));
+}
+
+BRICK_TARGET("sse2")
+static void MultiplySpectrumSSE2(float32* Destination, const float32* a,
+  const float32* b, int64 Bins)
+{
+  int64 Bin = 0;
+  for(; Bin + 2 <= Bins; Bin += 2)
+    _mm_storeu_ps(&Destination[Bin * 2],
+      ComplexProduct(_mm_loadu_ps(&a[Bin * 2]), _mm_loadu_ps(&b[Bin * 2])));
+  MultiplySpectrumScalar(&Destination[Bin * 2], &a[Bin * 2], &b[Bin * 2],
+    Bins - Bin);
+}
+
+BRICK_TARGET("sse2")
+static void MultiplyAccumulateSpectrumSSE2(float64* Destination,
+  const float64* a, const float64* b, int64 Bins)
+{
+  for(int64 i = 0; i < Bins * 2; i += 2)
+    _mm_storeu_pd(&Destination[i], _mm_add_pd(_mm_loadu_pd(&Destination[i]),
+      ComplexProduct(_mm_loadu_pd(&a[i]), _mm_loadu_pd(&b[i]))));
+}
+
+BRICK_TARGET("sse2")
+static void MultiplyAccumulateSpectrumSSE2(float32* Destination,
+  const float32* a, const float32* b, int64 Bins)
+{
+  int64 Bin = 0;
+  for(; Bin + 2 <= Bins; Bin += 2)
+  {
+    int64 i = Bin * 2;
+    _mm_storeu_ps(&Destination[i], _mm_add_ps(_mm_loadu_ps(&Destination[i]),
+      ComplexProduct(_mm_loadu_ps(&a[i]), _mm_loadu_ps(&b[i]))));
+  }
+  MultiplyAccumulateSpectrumScalar(&Destination[Bin * 2], &a[Bin * 2],
+    &b[Bin * 2], Bins - Bin);
+}
+
+BRICK_TARGET("sse2")
+static void MultiplyRealSpectrumSSE2(float64* Destination, const float64* a,
+  const float64* Gains, int64 Bins)
+{
+  for(int64 Bin = 0; Bin < Bins; Bin++)
+    _mm_storeu_pd(&Destination[Bin * 2],
+      _mm_mul_pd(_mm_loadu_pd(&a[Bin * 2]), _mm_load1_pd(&Gains[Bin])));
+}
+
+BRICK_TARGET("sse2")
+static void MultiplyRealSpectrumSSE2(float32* Destination, const float32* a,
+  const float32* Gains, int64 Bins)
+{
+  int64 Bin = 0;
+  for(; Bin + 2 <= Bins; Bin += 2)
+  {
+    __m128 g = _mm_castpd_ps(_mm_load_sd((const double*)&Gains[Bin]));
+    _mm_storeu_ps(&Destination[Bin * 2],
+      _mm_mul_ps(_mm_loadu_ps(&a[Bin * 2]), _mm_unpacklo_ps(g, g)));
+  }
+  MultiplyRealSpectrumScalar(&Destination[Bin * 2], &a[Bin * 2], &Gains[Bin],
+    Bins - Bin);
+}
+
+BRICK_TARGET("sse2")
+static void AddScaledSSE2(float64* Destination, const float64* Source,
+  int64 Samples, float64 Scale)
+{
+  __m128d s = _mm_set1_pd(Scale);
+  int64 i = 0;
+  for(; i + 2 <= Samples; i += 2)
+    _mm_storeu_pd(&Destination[i], _mm_add_pd(_mm_loadu_pd(&Destination[i]),
+      _mm_mul_pd(_mm_loadu_pd(&Source[i]), s)));
+  AddScaledScalar(&Destination[i], &Source[i], Samples - i, Scale);
+}
+
+//SSE2 can not gather, so only contiguous samples have a vector version.
+BRICK_TARGET("sse2")
+static void FindRangeSSE2(const float64* Source, int64 SourceHop,
+  int64 Samples, float64* Minimum, float64* Maximum)
+{
+  int64 i = 0;
+  if(SourceHop == 1 && Samples >= 2)
+  {
+    __m128d Low = _mm_set1_pd(*Minimum), High = _mm_set1_pd(*Maximum);
+    for(; i + 2 <= Samples; i += 2)
+    {
+      __m128d x = _mm_loadu_pd(&Source[i]);
+      Low = _mm_min_pd(Low, x);
+      High = _mm_max_pd(High, x);
+    }
+    float64 Lows[2], Highs[2];
+    _mm_storeu_pd(Lows, Low);
+    _mm_storeu_pd(Highs, High);
+    FoldRange(Lows, Highs, 2, Minimum, Maximum);
+  }
+  FindRangeScalar(&Source[i * SourceHop], SourceHop, Samples - i, Minimum,
+    Maximum);
+}
+
+/*The symmetric filters work on several vectors of consecutive outputs at once,
+so that each tap is loaded once for all of them, and their sums stay in
+registers until every tap is applied. The leftover outputs are done with
+narrower vectors, down to the scalar version.*/
+BRICK_TARGET("sse2")
+static void SymmetricFilterSSE2(float64* Destination, const float64* Source,
+  const float64* Taps, int64 Half, int64 Samples)
+{
+  int64 Last = Half * 2 - 1;
+  int64 i = 0;
+  for(; i + 8 <= Samples; i += 8)
+  {
+    __m128d Sum0 = _mm_setzero_pd(), Sum1 = _mm_setzero_pd();
+    __m128d Sum2 = _mm_setzero_pd(), Sum3 = _mm_setzero_pd();
+    for(int64 t = 0; t < Half; t++)
+    {
+      __m128d c = _mm_set1_pd(Taps[t]);
+      const float64* a = &Source[i - t];
+      const float64* b = &Source[i - Last + t];
+      Sum0 = _mm_add_pd(Sum0, _mm_mul_pd(c, _mm_add_pd(_mm_loadu_pd(a),
+        _mm_loadu_pd(b))));
+      Sum1 = _mm_add_pd(Sum1, _mm_mul_pd(c, _mm_add_pd(_mm_loadu_pd(a + 2),
+        _mm_loadu_pd(b + 2))));
+      Sum2 = _mm_add_pd(Sum2, _mm_mul_pd(c, _mm_add_pd(_mm_loadu_pd(a + 4),
+        _mm_loadu_pd(b + 4))));
+      Sum3 = _mm_add_pd(Sum3, _mm_mul_pd(c, _mm_add_pd(_mm_loadu_pd(a + 6),
+        _mm_loadu_pd(b + 6))));
+    }
+    _mm_storeu_pd(&Destination[i], Sum0);
+    _mm_storeu_pd(&Destination[i + 2], Sum1);
+    _mm_storeu_pd(&Destination[i + 4], Sum2);
+    _mm_storeu_pd(&Destination[i + 6], Sum3);
+  }
+  SymmetricFilterScalar(&Destination[i], &Source[i], Taps, Half, Samples - i);
+}
+
+template <class Sample>
+static void UseSSE2(Kernels<Sample>& k)
+{
+  k.MultiplySpectrum = MultiplySpectrumSSE2;
+  k.MultiplyAccumulateSpectrum = MultiplyAccumulateSpectrumSSE2;
+  k.MultiplyRealSpectrum = MultiplyRealSpectrumSSE2;
+  k.AddScaled = AddScaledSSE2;
+  k.FindRange = FindRangeSSE2;
+  k.SymmetricFilter = SymmetricFilterSSE2;
+  k.InstructionSet = "SSE2";
+}
+
+//------------------------------------------------------------------------------
+//AVX2 kernels
+//------------------------------------------------------------------------------
+
+BRICK_TARGET("avx2,fma")
+static inline __m256d ComplexProduct(__m256d x, __m256d y)
+{
+  __m256d Real = _mm256_movedup_pd(y);
+  __m256d Imag = _mm256_permute_pd(y, 0xF);
+  __m256d Swapped = _mm256_permute_pd(x, 0x5);
+  return _mm256_fmaddsub_pd(x, Real, _mm256_mul_pd(Swapped, Imag));
+}
+
+BRICK_TARGET("avx2,fma")
+static inline __m256 ComplexProduct(__m256 x, __m256 y)
+{
+  __m256 Real = _mm256_moveldup_ps(y);
+  __m256 Imag = _mm256_movehdup_ps(y);
+  __m256 Swapped = _mm256_permute_ps(x, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm256_fmaddsub_ps(x, Real, _mm256_mul_ps(Swapped, Imag));
+}
+
+BRICK_TARGET("avx2,fma")
+static void MultiplySpectrumAVX2(float64* Destination, const float64* a,
+  const float64* b, int64 Bins)
+{
+  int64 Bin = 0;
+  for(; Bin + 2 <= Bins; Bin += 2)
+  {
+    int64 i = Bin * 2;
+    _mm256_storeu_pd(&Destination[i],
+      ComplexProduct(_mm256_loadu_pd(&a[i]), _mm256_loadu_pd(&b[i])));
+  }
+  MultiplySpectrumScalar(&Destination[Bin * 2], &a[Bin * 2], &b[Bin * 2],
+    Bins - Bin);
+}
+
+BRICK_TARGET("avx2,fma")
+static void MultiplySpectrumAVX2(float32* Destination, const float32* a,
+  const float32* b, int64 Bins)
+{
+  int64 Bin = 0;
+  for(; Bin + 4 <= Bins; Bin += 4)
+  {
+    int64 i = Bin * 2;
+    _mm256_storeu_ps(&Destination[i],
+      ComplexProduct(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i])));
+  }
+  MultiplySpectrumScalar(&Destination[Bin * 2], &a[Bin * 2], &b[Bin * 2],
+    Bins - Bin);
+}
+
+BRICK_TARGET("avx2,fma")
+static void MultiplyAccumulateSpectrumAVX2(float64* Destination,
+  const float64* a, const float64* b, int64 Bins)
+{
+  int64 Bin = 0;
+  for(; Bin + 2 <= Bins; Bin += 2)
+  {
+    int64 i = Bin * 2;
+    _mm256_storeu_pd(&Destination[i],
+      _mm256_add_pd(_mm256_loadu_pd(&Destination[i]),
+      ComplexProduct(_mm256_loadu_pd(&a[i]), _mm256_loadu_pd(&b[i]))));
+  }
+  MultiplyAccumulateSpectrumScalar(&Destination[Bin * 2], &a[Bin * 2],
+    &b[Bin * 2], Bins - Bin);
+}
+
+BRICK_TARGET("avx2,fma")
+static void MultiplyAccumulateSpectrumAVX2(float32* Destination,
+  const float32* a, const float32* b, int64 Bins)
+{
+  int64 Bin = 0;
+  for(; Bin + 4 <= Bins; Bin += 4)
+  {
+    int64 i = Bin * 2;
+    _mm256_storeu_ps(&Destination[i],
+      _mm256_add_ps(_mm256_loadu_ps(&Destination[i]),
+      ComplexProduct(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i]))));
+  }
+  MultiplyAccumulateSpectrumScalar(&Destination[Bin * 2], &a[Bin * 2],
+    &b[Bin * 2], Bins - Bin);
+}
+
+BRICK_TARGET("avx2,fma")
+static void MultiplyRealSpectrumAVX2(float64* Destination, const float64* a,
+  const float64* Gains, int64 Bins)
+{
+  int64 Bin = 0;
+  for(; Bin + 2 <= Bins; Bin += 2)
+  {
+    //Each gain is repeated for the real and imaginary parts of its bin.
+    __m256d g = _mm256_permute4x64_pd(
+      _mm256_castpd128_pd256(_mm_loadu_pd(&Gains[Bin])), 0x50);
+    _mm256_storeu_pd(&Destination[Bin * 2],
+      _mm256_mul_pd(_mm256_loadu_pd(&a[Bin * 2]), g));
+  }
+  MultiplyRealSpectrumScalar(&Destination[Bin * 2], &a[Bin * 2], &Gains[Bin],
+    Bins - Bin);
+}
+
+BRICK_TARGET("avx2,fma")
+static void MultiplyRealSpectrumAVX2(float32* Destination, const float32* a,
+  const float32* Gains, int64 Bins)
+{
+  const __m256i Repeat = _mm256_set_epi32(3, 3, 2, 2, 1, 1, 0, 0);
+  int64 Bin = 0;
+  for(; Bin + 4 <= Bins; Bin += 4)
+  {
+    __m256 g = _mm256_permutevar8x32_ps(
+      _mm256_castps128_ps256(_mm_loadu_ps(&Gains[Bin])), Repeat);
+    _mm256_storeu_ps(&Destination[Bin * 2],
+      _mm256_mul_ps(_mm256_loadu_ps(&a[Bin * 2]), g));
+  }
+  MultiplyRealSpectrumScalar(&Destination[Bin * 2], &a[Bin * 2], &Gains[Bin],
+    Bins - Bin);
+}
+
+///Gathers four samples that are a hop apart.
+BRICK_TARGET("avx2,fma")
+static inline __m256d Gather4(const float64* Source, int64 SourceHop)
+{
+  __m256i Index =
+    _mm256_set_epi64x(SourceHop * 3, SourceHop * 2, SourceHop, 0);
+  return _mm256_i64gather_pd(Source, Index, 8);
+}
+
+BRICK_TARGET("avx2,fma")
+static inline void Store4(float64* Destination, __m256d x)
+{
+  _mm256_storeu_pd(Destination, x);
+}
+
+BRICK_TARGET("avx2,fma")
+static inline void Store4(float32* Destination, __m256d x)
+{
+  _mm_storeu_ps(Destination, _mm256_cvtpd_ps(x));
+}
+
+//AVX2 can gather but not scatter, so only Gather has a vector version.
+template <class Sample>
+BRICK_TARGET("avx2,fma")
+static void GatherAVX2(Sample* Destination, int64 DestinationHop,
+  const float64* Source, int64 SourceHop, int64 Samples)
+{
+  int64 i = 0;
+  if(DestinationHop == 1)
+  {
+    for(; i + 4 <= Samples; i += 4)
+      Store4(&Destination[i], Gather4(&Source[i * SourceHop], SourceHop));
+  }
+  GatherScalar(&Destination[i * DestinationHop], DestinationHop,
+    &Source[i * SourceHop], SourceHop, Samples - i);
+}
+
+BRICK_TARGET("avx2,fma")
+static void AddScaledAVX2(float64* Destination, const float64* Source,
+  int64 Samples, float64 Scale)
+{
+  __m256d s = _mm256_set1_pd(Scale);
+  int64 i = 0;
+  for(; i + 4 <= Samples; i += 4)
+    _mm256_storeu_pd(&Destination[i], _mm256_fmadd_pd(
+      _mm256_loadu_pd(&Source[i]), s, _mm256_loadu_pd(&Destination[i])));
+  AddScaledScalar(&Destination[i], &Source[i], Samples - i, Scale);
+}
+
+BRICK_TARGET("avx2,fma")
+static void FindRangeAVX2(const float64* Source, int64 SourceHop,
+  int64 Samples, float64* Minimum, float64* Maximum)
+{
+  int64 i = 0;
+  if(Samples >= 4)
+  {
+    __m256d Low = _mm256_set1_pd(*Minimum), High = _mm256_set1_pd(*Maximum);
+    for(; i + 4 <= Samples; i += 4)
+    {
+      __m256d x = (SourceHop == 1 ? _mm256_loadu_pd(&Source[i]) :
+        Gather4(&Source[i * SourceHop], SourceHop));
+      Low = _mm256_min_pd(Low, x);
+      High = _mm256_max_pd(High, x);
+    }
+    float64 Lows[4], Highs[4];
+    _mm256_storeu_pd(Lows, Low);
+    _mm256_storeu_pd(Highs, High);
+    FoldRange(Lows, Highs, 4, Minimum, Maximum);
+  }
+  FindRangeScalar(&Source[i * SourceHop], SourceHop, Samples - i, Minimum,
+    Maximum);
+}
+
+BRICK_TARGET("avx2,fma")
+static void SymmetricFilterAVX2(float64* Destination, const float64* Source,
+  const float64* Taps, int64 Half, int64 Samples)
+{
+  int64 Last = Half * 2 - 1;
+  int64 i = 0;
+  for(; i + 16 <= Samples; i += 16)
+  {
+    __m256d Sum0 = _mm256_setzero_pd(), Sum1 = _mm256_setzero_pd();
+    __m256d Sum2 = _mm256_setzero_pd(), Sum3 = _mm256_setzero_pd();
+    for(int64 t = 0; t < Half; t++)
+    {
+      __m256d c = _mm256_set1_pd(Taps[t]);
+      const float64* a = &Source[i - t];
+      const float64* b = &Source[i - Last + t];
+      Sum0 = _mm256_fmadd_pd(c, _mm256_add_pd(_mm256_loadu_pd(a),
+        _mm256_loadu_pd(b)), Sum0);
+      Sum1 = _mm256_fmadd_pd(c, _mm256_add_pd(_mm256_loadu_pd(a + 4),
+        _mm256_loadu_pd(b + 4)), Sum1);
+      Sum2 = _mm256_fmadd_pd(c, _mm256_add_pd(_mm256_loadu_pd(a + 8),
+        _mm256_loadu_pd(b + 8)), Sum2);
+      Sum3 = _mm256_fmadd_pd(c, _mm256_add_pd(_mm256_loadu_pd(a + 12),
+        _mm256_loadu_pd(b + 12)), Sum3);
+    }
+    _mm256_storeu_pd(&Destination[i], Sum0);
+    _mm256_storeu_pd(&Destination[i + 4], Sum1);
+    _mm256_storeu_pd(&Destination[i + 8], Sum2);
+    _mm256_storeu_pd(&Destination[i + 12], Sum3);
+  }
+  for(; i + 4 <= Samples; i += 4)
+  {
+    __m256d Sum = _mm256_setzero_pd();
+    for(int64 t = 0; t < Half; t++)
+      Sum = _mm256_fmadd_pd(_mm256_set1_pd(Taps[t]), _mm256_add_pd(
+        _mm256_loadu_pd(&Source[i - t]), _mm256_loadu_pd(
+        &Source[i - Last + t])), Sum);
+    _mm256_storeu_pd(&Destination[i], Sum);
+  }
+  SymmetricFilterScalar(&Destination[i], &Source[i], Taps, Half, Samples - i);
+}
+
+template <class Sample>
+static void UseAVX2(Kernels<Sample>& k)
+{
+  k.MultiplySpectrum = MultiplySpectrumAVX2;
+  k.MultiplyAccumulateSpectrum = MultiplyAccumulateSpectrumAVX2;
+  k.MultiplyRealSpectrum = MultiplyRealSpectrumAVX2;
+  k.Gather = GatherAVX2<Sample>;
+  k.AddScaled = AddScaledAVX2;
+  k.FindRange = FindRangeAVX2;
+  k.SymmetricFilter = SymmetricFilterAVX2;
+  k.InstructionSet = "AVX2";
+}
+
+//------------------------------------------------------------------------------
+//AVX-512 kernels
+//------------------------------------------------------------------------------
+
+BRICK_TARGET("avx512f")
+static inline __m512d ComplexProduct(__m512d x, __m512d y)
+{
+  __m512d Real = _mm512_movedup_pd(y);
+  __m512d Imag = _mm512_permute_pd(y, 0xFF);
+  __m512d Swapped = _mm512_permute_pd(x, 0x55);
+  return _mm512_fmaddsub_pd(x, Real, _mm512_mul_pd(Swapped, Imag));
+}
+
+BRICK_TARGET("avx512f")
+static inline __m512 ComplexProduct(__m512 x, __m512 y)
+{
+  __m512 Real = _mm512_moveldup_ps(y);
+  __m512 Imag = _mm512_movehdup_ps(y);
+  __m512 Swapped = _mm512_permute_ps(x, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm512_fmaddsub_ps(x, Real, _mm512_mul_ps(Swapped, Imag));
+}
+
+BRICK_TARGET("avx512f")
+static void MultiplySpectrumAVX512(float64* Destination, const float64* a,
+  const float64* b, int64 Bins)
+{
+  int64 Bin = 0;
+  for(; Bin + 4 <= Bins; Bin += 4)
+  {
+    int64 i = Bin * 2;
+    _mm512_storeu_pd(&Destination[i],
+      ComplexProduct(_mm512_loadu_pd(&a[i]), _mm512_loadu_pd(&b[i])));
+  }
+  MultiplySpectrumAVX2(&Destination[Bin * 2], &a[Bin * 2], &b[Bin * 2],
+    Bins - Bin);
+}
+
+BRICK_TARGET("avx512f")
+static void MultiplySpectrumAVX512(float32* Destination, const float32* a,
+  const float32* b, int64 Bins)
+{
+  int64 Bin = 0;
+  for(; Bin + 8 <= Bins; Bin += 8)
+  {
+    int64 i = Bin * 2;
+    _mm512_storeu_ps(&Destination[i],
+      ComplexProduct(_mm512_loadu_ps(&a[i]), _mm512_loadu_ps(&b[i])));
+  }
+  MultiplySpectrumAVX2(&Destination[Bin * 2], &a[Bin * 2], &b[Bin * 2],
+    Bins - Bin);
+}
+
+BRICK_TARGET("avx512f")
+static void MultiplyAccumulateSpectrumAVX512(float64* Destination,
+  const float64* a, const float64* b, int64 Bins)
+{
+  int64 Bin = 0;
+  for(; Bin + 4 <= Bins; Bin += 4)
+  {
+    int64 i = Bin * 2;
+    _mm512_storeu_pd(&Destination[i],
+      _mm512_add_pd(_mm512_loadu_pd(&Destination[i]),
+      ComplexProduct(_mm512_loadu_pd(&a[i]), _mm512_loadu_pd(&b[i]))));
+  }
+  MultiplyAccumulateSpectrumAVX2(&Destination[Bin * 2], &a[Bin * 2],
+    &b[Bin * 2], Bins - Bin);
+}
+
+BRICK_TARGET("avx512f")
+static void MultiplyAccumulateSpectrumAVX512(float32* Destination,
+  const float32* a, const float32* b, int64 Bins)
+{
+  int64 Bin = 0;
+  for(; Bin + 8 <= Bins; Bin += 8)
+  {
+    int64 i = Bin * 2;
+    _mm512_storeu_ps(&Destination[i],
+      _mm512_add_ps(_mm512_loadu_ps(&Destination[i]),
+      ComplexProduct(_mm512_loadu_ps(&a[i]), _mm512_loadu_ps(&b[i]))));
+  }
+  MultiplyAccumulateSpectrumAVX2(&Destination[Bin * 2], &a[Bin * 2],
+    &b[Bin * 2], Bins - Bin);
+}
+
+BRICK_TARGET("avx512f")
+static void MultiplyRealSpectrumAVX512(float64* Destination, const float64* a,
+  const float64* Gains, int64 Bins)
+{
+  const __m512i Repeat = _mm512_set_epi64(3, 3, 2, 2, 1, 1, 0, 0);
+  int64 Bin = 0;
+  for(; Bin + 4 <= Bins; Bin += 4)
+  {
+    __m512d g = _mm512_permutexvar_pd(Repeat,
+      _mm512_castpd256_pd512(_mm256_loadu_pd(&Gains[Bin])));
+    _mm512_storeu_pd(&Destination[Bin * 2],
+      _mm512_mul_pd(_mm512_loadu_pd(&a[Bin * 2]), g));
+  }
+  MultiplyRealSpectrumAVX2(&Destination[Bin * 2], &a[Bin * 2], &Gains[Bin],
+    Bins - Bin);
+}
+
+BRICK_TARGET("avx512f")
+static void MultiplyRealSpectrumAVX512(float32* Destination, const float32* a,
+  const float32* Gains, int64 Bins)
+{
+  const __m512i Repeat = _mm512_set_epi32(7, 7, 6, 6, 5, 5, 4, 4, 3, 3, 2, 2,
+    1, 1, 0, 0);
+  int64 Bin = 0;
+  for(; Bin + 8 <= Bins; Bin += 8)
+  {
+    __m512 g = _mm512_permutexvar_ps(Repeat,
+      _mm512_castps256_ps512(_mm256_loadu_ps(&Gains[Bin])));
+    _mm512_storeu_ps(&Destination[Bin * 2],
+      _mm512_mul_ps(_mm512_loadu_ps(&a[Bin * 2]), g));
+  }
+  MultiplyRealSpectrumAVX2(&Destination[Bin * 2], &a[Bin * 2], &Gains[Bin],
+    Bins - Bin);
+}
+
+///Returns the offsets of eight samples that are a hop apart.
+BRICK_TARGET("avx512f")
+static inline __m512i Hops8(int64 Hop)
+{
+  return _mm512_set_epi64(Hop * 7, Hop * 6, Hop * 5, Hop * 4, Hop * 3,
+    Hop * 2, Hop, 0);
+}
+
+BRICK_TARGET("avx512f")
+static inline __m512d Load8(const float64* Source, __m512i Offsets)
+{
+  return _mm512_i64gather_pd(Offsets, Source, 8);
+}
+
+BRICK_TARGET("avx512f")
+static inline __m512d Load8(const float32* Source, __m512i Offsets)
+{
+  return _mm512_cvtps_pd(_mm512_i64gather_ps(Offsets, Source, 4));
+}
+
+BRICK_TARGET("avx512f")
+static inline void Store8(float64* Destination, __m512d x)
+{
+  _mm512_storeu_pd(Destination, x);
+}
+
+BRICK_TARGET("avx512f")
+static inline void Store8(float32* Destination, __m512d x)
+{
+  _mm256_storeu_ps(Destination, _mm512_cvtpd_ps(x));
+}
+
+template <class Sample>
+BRICK_TARGET("avx512f")
+static void GatherAVX512(Sample* Destination, int64 DestinationHop,
+  const float64* Source, int64 SourceHop, int64 Samples)
+{
+  int64 i = 0;
+  if(DestinationHop == 1)
+  {
+    __m512i Offsets = Hops8(SourceHop);
+    for(; i + 8 <= Samples; i += 8)
+      Store8(&Destination[i], Load8(&Source[i * SourceHop], Offsets));
+  }
+  GatherScalar(&Destination[i * DestinationHop], DestinationHop,
+    &Source[i * SourceHop], SourceHop, Samples - i);
+}
+
+template <class Sample>
+BRICK_TARGET("avx512f")
+static void ScatterAVX512(float64* Destination, int64 DestinationHop,
+  const Sample* Source, int64 SourceHop, int64 Samples)
+{
+  __m512i DestinationOffsets = Hops8(DestinationHop);
+  __m512i SourceOffsets = Hops8(SourceHop);
+  int64 i = 0;
+  for(; i + 8 <= Samples; i += 8)
+    _mm512_i64scatter_pd(&Destination[i * DestinationHop],
+      DestinationOffsets, Load8(&Source[i * SourceHop], SourceOffsets), 8);
+  ScatterScalar(&Destination[i * DestinationHop], DestinationHop,
+    &Source[i * SourceHop], SourceHop, Samples - i);
+}
+
+template <class Sample>
+BRICK_TARGET("avx512f")
+static void ScatterAddAVX512(float64* Destination, int64 DestinationHop,
+  const Sample* Source, int64 SourceHop, int64 Samples, float64 Scale)
+{
+  __m512i DestinationOffsets = Hops8(DestinationHop);
+  __m512i SourceOffsets = Hops8(SourceHop);
+  __m512d s = _mm512_set1_pd(Scale);
+  int64 i = 0;
+  for(; i + 8 <= Samples; i += 8)
+  {
+    float64* Frames = &Destination[i * DestinationHop];
+    __m512d Mixed = _mm512_fmadd_pd(Load8(&Source[i * SourceHop],
+      SourceOffsets), s, Load8(Frames, DestinationOffsets));
+    _mm512_i64scatter_pd(Frames, DestinationOffsets, Mixed, 8);
+  }
+  ScatterAddScalar(&Destination[i * DestinationHop], DestinationHop,
+    &Source[i * SourceHop], SourceHop, Samples - i, Scale);
+}
+
+BRICK_TARGET("avx512f")
+static void AddScaledAVX512(float64* Destination, const float64* Source,
+  int64 Samples, float64 Scale)
+{
+  __m512d s = _mm512_set1_pd(Scale);
+  int64 i = 0;
+  for(; i + 8 <= Samples; i += 8)
+    _mm512_storeu_pd(&Destination[i], _mm512_fmadd_pd(
+      _mm512_loadu_pd(&Source[i]), s, _mm512_loadu_pd(&Destination[i])));
+  AddScaledAVX2(&Destination[i], &Source[i], Samples - i, Scale);
+}
+
+BRICK_TARGET("avx512f")
+static void FindRangeAVX512(const float64* Source, int64 SourceHop,
+  int64 Samples, float64* Minimum, float64* Maximum)
+{
+  int64 i = 0;
+  if(Samples >= 8)
+  {
+    __m512d Low = _mm512_set1_pd(*Minimum), High = _mm512_set1_pd(*Maximum);
+    __m512i Offsets = Hops8(SourceHop);
+    for(; i + 8 <= Samples; i += 8)
+    {
+      __m512d x = (SourceHop == 1 ? _mm512_loadu_pd(&Source[i]) :
+        Load8(&Source[i * SourceHop], Offsets));
+      Low = _mm512_min_pd(Low, x);
+      High = _mm512_max_pd(High, x);
+    }
+    float64 Lows[8], Highs[8];
+    _mm512_storeu_pd(Lows, Low);
+    _mm512_storeu_pd(Highs, High);
+    FoldRange(Lows, Highs, 8, Minimum, Maximum);
+  }
+  FindRangeScalar(&Source[i * SourceHop], SourceHop, Samples - i, Minimum,
+    Maximum);
+}
+
+BRICK_TARGET("avx512f")
+static void SymmetricFilterAVX512(float64* Destination, const float64* Source,
+  const float64* Taps, int64 Half, int64 Samples)
+{
+  int64 Last = Half * 2 - 1;
+  int64 i = 0;
+  for(; i + 32 <= Samples; i += 32)
+  {
+    __m512d Sum0 = _mm512_setzero_pd(), Sum1 = _mm512_setzero_pd();
+    __m512d Sum2 = _mm512_setzero_pd(), Sum3 = _mm512_setzero_pd();
+    for(int64 t = 0; t < Half; t++)
+    {
+      __m512d c = _mm512_set1_pd(Taps[t]);
+      const float64* a = &Source[i - t];
+      const float64* b = &Source[i - Last + t];
+      Sum0 = _mm512_fmadd_pd(c, _mm512_add_pd(_mm512_loadu_pd(a),
+        _mm512_loadu_pd(b)), Sum0);
+      Sum1 = _mm512_fmadd_pd(c, _mm512_add_pd(_mm512_loadu_pd(a + 8),
+        _mm512_loadu_pd(b + 8)), Sum1);
+      Sum2 = _mm512_fmadd_pd(c, _mm512_add_pd(_mm512_loadu_pd(a + 16),
+        _mm512_loadu_pd(b + 16)), Sum2);
+      Sum3 = _mm512_fmadd_pd(c, _mm512_add_pd(_mm512_loadu_pd(a + 24),
+        _mm512_loadu_pd(b + 24)), Sum3);
+    }
+    _mm512_storeu_pd(&Destination[i], Sum0);
+    _mm512_storeu_pd(&Destination[i + 8], Sum1);
+    _mm512_storeu_pd(&Destination[i + 16], Sum2);
+    _mm512_storeu_pd(&Destination[i + 24], Sum3);
+  }
+  SymmetricFilterAVX2(&Destination[i], &Source[i], Taps, Half, Samples - i);
+}
+
+template <class Sample>
+static void UseAVX512(Kernels<Sample>& k)
+{
+  k.MultiplySpectrum = MultiplySpectrumAVX512;
+  k.MultiplyAccumulateSpectrum = MultiplyAccumulateSpectrumAVX512;
+  k.MultiplyRealSpectrum = MultiplyRealSpectrumAVX512;
+  k.Gather = GatherAVX512<Sample>;
+  k.Scatter = ScatterAVX512<Sample>;
+  k.ScatterAdd = ScatterAddAVX512<Sample>;
+  k.AddScaled = AddScaledAVX512;
+  k.FindRange = FindRangeAVX512;
+  k.SymmetricFilter = SymmetricFilterAVX512;
+  k.InstructionSet = "AVX-512";
+}
+
+//------------------------------------------------------------------------------
+//Detecting the instruction set
+//------------------------------------------------------------------------------
+
+///Instruction sets that there are kernels for, from narrowest to widest.
+enum InstructionSet
+{
+  NoVectors,
+  SSE2Vectors,
+  AVX2Vectors,
+  AVX512Vectors
+};
+
+///Queries CPUID for the EAX, EBX, ECX and EDX registers of a leaf.
+static void QueryCPU(uint32 Leaf, uint32 Subleaf, uint32 Registers[4])
+{
+#if defined(_MSC_VER)
+  int Values[4];
+  __cpuidex(Values, (int)Leaf, (int)Subleaf);
+  for(int i = 0; i < 4; i++)
+    Registers[i] = (uint32)Values[i];
+#else
+  __cpuid_count(Leaf, Subleaf, Registers[0], Registers[1], Registers[2],
+    Registers[3]);
+#endif
+}
+
+///Returns the register states that the operating system saves (XCR0).
+static uint64 SavedRegisterStates(void)
+{
+#if defined(_MSC_VER)
+  return (uint64)_xgetbv(0);
+#else
+  uint32 Low, High;
+  __asm__ __volatile__("xgetbv" : "=a"(Low), "=d"(High) : "c"(0));
+  return ((uint64)High << 32) | Low;
+#endif
+}
+
+/**Finds the widest instruction set that both the CPU and the operating system
+support. The wider registers are only usable if the operating system saves
+them on a context switch, which it flags in XCR0.*/
+static InstructionSet DetectInstructionSet(void)
+{
+  uint32 Registers[4];
+  QueryCPU(0, 0, Registers);
+  uint32 MaxLeaf = Registers[0];
+  if(MaxLeaf < 1)
+    return NoVectors;
+  
+  QueryCPU(1, 0, Registers);
+  bool SSE2 = (Registers[3] >> 26) & 1;
+  bool FMA = (Registers[2] >> 12) & 1;
+  bool OSXSAVE = (Registers[2] >> 27) & 1;
+  bool AVX = (Registers[2] >> 28) & 1;
+  if(!SSE2)
+    return NoVectors;
+  if(!OSXSAVE || !AVX || !FMA || MaxLeaf < 7)
+    return SSE2Vectors;
+  
+  uint64 States = SavedRegisterStates();
+  if((States & 0x6) != 0x6)
+    return SSE2Vectors;
+  
+  QueryCPU(7, 0, Registers);
+  bool AVX2 = (Registers[1] >> 5) & 1;
+  bool AVX512F = (Registers[1] >> 16) & 1;
+  if(!AVX2)
+    return SSE2Vectors;
+  if(!AVX512F || (States & 0xE6) != 0xE6)
+    return AVX2Vectors;
+  return AVX512Vectors;
+}
+#endif
+
+///Returns the scalar kernels only.
+template <class Sample>
+static Kernels<Sample> ScalarKernels(void)
+{
+  Kernels<Sample> k;
+  UseScalar(k);
+  return k;
+}
+
+///Picks the widest kernels that the CPU supports.
+template <class Sample>
+static Kernels<Sample> ChooseKernels(void)
+{
+  Kernels<Sample> k = ScalarKernels<Sample>();
+#ifdef BRICK_X86_KERNELS
+  InstructionSet Widest = DetectInstructionSet();
+  if(Widest >= SSE2Vectors)
+    UseSSE2(k);
+  if(Widest >= AVX2Vectors)
+    UseAVX2(k);
+  if(Widest >= AVX512Vectors)
+    UseAVX512(k);
+#endif
+  return k;
+}
+
+template <class Sample>
+const Kernels<Sample>& Kernels<Sample>::Get(void)
+{
+  static const Kernels<Sample> Chosen = ChooseKernels<Sample>();
+  return Chosen;
+}
+
+template <class Sample>
+const Kernels<Sample>& Kernels<Sample>::Reference(void)
+{
+  static const Kernels<Sample> Scalar = ScalarKernels<Sample>();
+  return Scalar;
+}
+
+//The precisions of the renderer.
+template struct Kernels<float32>;
+template struct Kernels<float64>;
@@ -0,0 +1,156 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "Libraries.h"
+
+/*Inner loops of the filters, shared by the renderer and the convolver. Each
+loop has a scalar version, against which the others can be checked, and on x86
+processors versions for SSE2, AVX2 with FMA, and AVX-512. The CPU is checked
+with CPUID the first time the kernels are asked for, and the widest versions it
+supports are used from then on. None of the arrays need to be aligned.*/
+template <class Sample> struct Kernels
+{
+  ///Complex multiplies two interleaved spectra (destination may be either one).
+  void (*MultiplySpectrum)(Sample* Destination, const Sample* a,
+    const Sample* b, int64 Bins);
+  
+  ///Complex multiplies two interleaved spectra, adding into the destination.
+  void (*MultiplyAccumulateSpectrum)(Sample* Destination, const Sample* a,
+    const Sample* b, int64 Bins);
+  
+  /**Multiplies each bin of an interleaved spectrum by a real gain (destination
+  may be the spectrum).*/
+  void (*MultiplyRealSpectrum)(Sample* Destination, const Sample* a,
+    const Sample* Gains, int64 Bins);
+  
+  /**Copies every SourceHop-th sample of the source to every DestinationHop-th
+  sample of the destination, such as a channel of frames into an FFT.*/
+  void (*Gather)(Sample* Destination, int64 DestinationHop,
+    const float64* Source, int64 SourceHop, int64 Samples);
+  
+  ///Copies samples back out in the same way as Gather.
+  void (*Scatter)(float64* Destination, int64 DestinationHop,
+    const Sample* Source, int64 SourceHop, int64 Samples);
+  
+  ///Mixes samples back out, multiplied by the scale, in the same way as Gather.
+  void (*ScatterAdd)(float64* Destination, int64 DestinationHop,
+    const Sample* Source, int64 SourceHop, int64 Samples, float64 Scale);
+  
+  ///Adds the source multiplied by the scale to the destination (overlap-add).
+  void (*AddScaled)(float64* Destination, const float64* Source,
+    int64 Samples, float64 Scale);
+  
+  /**Filters by a symmetric filter of 2 * Half taps, given by its first half.
+  Output i is the sum over t below Half of
+  Taps[t] * (Source[i - t] + Source[i - 2 * Half + 1 + t]), so the source has
+  2 * Half - 1 samples of history before it. Each pair of samples takes one
+  multiply.*/
+  void (*SymmetricFilter)(float64* Destination, const float64* Source,
+    const float64* Taps, int64 Half, int64 Samples);
+  
+  /**Widens the range from the minimum to the maximum to take in every
+  SourceHop-th sample of the source, such as a channel of frames.*/
+  void (*FindRange)(const float64* Source, int64 SourceHop, int64 Samples,
+    float64* Minimum, float64* Maximum);
+  
+  ///Name of the instruction set of the widest kernels.
+  const char* InstructionSet;
+  
+  ///Returns the fastest kernels that the CPU supports.
+  static const Kernels& Get(void);
+  
+  ///Returns the scalar kernels.
+  static const Kernels& Reference(void);
+};
+
+///Dot product of two arrays, summed in four independent lanes to vectorize.
+template <class Sample>
+static inline Sample DotProduct(const Sample* a, const Sample* b, int64 n)
+{
+  Sample Sum0 = 0, Sum1 = 0, Sum2 = 0, Sum3 = 0;
+  int64 i = 0;
+  for(; i + 4 <= n; i += 4)
+  {
+    Sum0 += a[i] * b[i];
+    Sum1 += a[i + 1] * b[i + 1];
+    Sum2 += a[i + 2] * b[i + 2];
+    Sum3 += a[i + 3] * b[i + 3];
+  }
+  for(; i < n; i++)
+    Sum0 += a[i] * b[i];
+  return (Sum0 + Sum1) + (Sum2 + Sum3);
+}
+
+/**Complex multiplies two half spectra of an N-point real transform and folds
+the product Q ways into the half spectrum of an N / Q-point transform, whose
+inverse is every Q-th sample of the inverse of the product. Bin f of the full
+product lands in bin f mod (N / Q), and since the product of real signals is
+conjugate symmetric, its mirror image at N - f lands conjugated in bin -f mod
+(N / Q). Only the bins of the folded half spectrum are accumulated.*/
+template <class Sample>
+static inline void MultiplyAndFoldSpectrum(Sample* Destination, const Sample* a,
+  const Sample* b, int64 N, int64 Q)
+{
+  int64 Folded = N / Q;
+  int64 FoldedBins = Folded / 2 + 1;
+  int64 Bins = N / 2 + 1;
+  Memory::ClearArray(Destination, FoldedBins * 2);
+  for(int64 f = 0, Bin = 0; f < Bins; f++)
+  {
+    Sample r1 = a[f * 2];
+    Sample r2 = b[f * 2];
+    
+    Sample i1 = a[f * 2 + 1];
+    Sample i2 = b[f * 2 + 1];
+    
+    Sample Real = r1 * r2 - i1 * i2;
+    Sample Imag = r1 * i2 + r2 * i1;
+    
+    if(Bin < FoldedBins)
+    {
+      Destination[Bin * 2] += Real;
+      Destination[Bin * 2 + 1] += Imag;
+    }
+    
+    //DC and Nyquist are their own mirror images.
+    int64 Mirror = (Bin ? Folded - Bin : 0);
+    if(f != 0 && f * 2 != N && Mirror < FoldedBins)
+    {
+      Destination[Mirror * 2] += Real;
+      Destination[Mirror * 2 + 1] -= Imag;
+    }
+    
+    if(++Bin == Folded)
+      Bin = 0;
+  }
+}
+
+#endif
@@ -0,0 +1,128 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#include "Limiter.h"
+
+void Limiter::Initialize(int64 Channels, int64 SampleRate, float64 Ceiling)
+{
+  Cleanup();
+  Limiter::Channels = Channels;
+  Limiter::Ceiling = Ceiling;
+  
+  //Look ahead 5ms, and recover with a time constant of 50ms.
+  LookAhead = math::Max(SampleRate / 200, (int64)1);
+  Release = 1.0 - exp(-1.0 / (0.05 * (float64)SampleRate));
+  
+  int64 Span = LookAhead + 1;
+  Delay = new float64[LookAhead * Channels];
+  Needed = new float64[Span];
+  Window = new int64[Span];
+  Minimums = new float64[Span];
+  for(int64 i = 0; i < Span; i++)
+    Minimums[i] = 1.0;
+  MinimumSum = (float64)Span;
+  WindowStart = 0;
+  WindowCount = 0;
+  Gain = 1.0;
+  LowestGain = 1.0;
+  Frames = 0;
+}
+
+int64 Limiter::Process(const float64* Input, float64* Output, int64 Frames)
+{
+  int64 Span = LookAhead + 1;
+  int64 FramesOut = 0;
+  for(int64 i = 0; i < Frames; i++)
+  {
+    int64 n = Limiter::Frames++;
+    const float64* x = (Input ? &Input[i * Channels] : 0);
+    float64 Peak = 0.0;
+    for(int64 c = 0; x && c < Channels; c++)
+    {
+      if(x[c] > Peak) Peak = x[c];
+      if(-x[c] > Peak) Peak = -x[c];
+    }
+    float64 Need = (Peak > Ceiling ? Ceiling / Peak : 1.0);
+    
+    //Slide the window of the look-ahead on to this frame.
+    if(WindowCount && Window[WindowStart] <= n - Span)
+    {
+      WindowStart = (WindowStart + 1) % Span;
+      WindowCount--;
+    }
+    Needed[n % Span] = Need;
+    while(WindowCount &&
+      Needed[Window[(WindowStart + WindowCount - 1) % Span] % Span] >= Need)
+        WindowCount--;
+    Window[(WindowStart + WindowCount) % Span] = n;
+    WindowCount++;
+    
+    /*The frame the look-ahead before this one comes out. Each of the windows
+    averaged covers it, so the average is no more than the gain it needs.*/
+    float64* d = &Delay[(n % LookAhead) * Channels];
+    if(n >= LookAhead)
+    {
+      int64 t = n - LookAhead;
+      float64 Minimum = Needed[Window[WindowStart] % Span];
+      MinimumSum += Minimum - Minimums[t % Span];
+      Minimums[t % Span] = Minimum;
+      float64 Average = math::Min(MinimumSum / (float64)Span, Minimum);
+      Gain = math::Min(Average, Gain + (1.0 - Gain) * Release);
+      LowestGain = math::Min(LowestGain, Gain);
+      
+      float64* y = &Output[FramesOut * Channels];
+      for(int64 c = 0; c < Channels; c++)
+        y[c] = math::Min(math::Max(d[c] * Gain, -Ceiling), Ceiling);
+      FramesOut++;
+    }
+    
+    //The frame takes the place of the one that came out.
+    if(x)
+      Memory::CopyArray(d, x, Channels);
+    else
+      Memory::ClearArray(d, Channels);
+  }
+  return FramesOut;
+}
+
+int64 Limiter::Finish(float64* Output)
+{
+  return Process(0, Output, LookAhead);
+}
+
+void Limiter::Cleanup(void)
+{
+  delete [] Delay;
+  delete [] Needed;
+  delete [] Window;
+  delete [] Minimums;
+  Delay = 0;
+  Needed = 0;
+  Window = 0;
+  Minimums = 0;
+}
@@ -0,0 +1,89 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#ifndef LIMITER_H
+#define LIMITER_H
+
+#include "Libraries.h"
+
+/**Keeps the output within full scale in a single pass by delaying it a few
+milliseconds, and turning the gain down ahead of each peak that would clip. The
+gain that each frame needs (linked across the channels) goes through the
+minimum over the look-ahead, and then through a moving average as long as it,
+so that the gain ramps down over the look-ahead to reach what a peak needs by
+the time the peak comes out. The gain then recovers at the release rate.*/
+struct Limiter
+{
+  int64 Channels;
+  int64 LookAhead;
+  float64 Ceiling;
+  float64 Release;
+  
+  ///Frames held back by the look-ahead, in a ring.
+  float64* Delay;
+  
+  ///Gains needed by the last LookAhead + 1 frames, in a ring.
+  float64* Needed;
+  
+  /**Frames of the look-ahead in order of increasing needed gain, the first
+  having the smallest, in a ring.*/
+  int64* Window;
+  int64 WindowStart;
+  int64 WindowCount;
+  
+  ///Smallest gains of the last LookAhead + 1 windows, in a ring, and their sum.
+  float64* Minimums;
+  float64 MinimumSum;
+  
+  ///Current gain, and the lowest it has been.
+  float64 Gain;
+  float64 LowestGain;
+  
+  ///Frames taken in so far.
+  int64 Frames;
+  
+  Limiter() : Channels(0), LookAhead(0), Ceiling(1.0), Release(0), Delay(0),
+    Needed(0), Window(0), WindowStart(0), WindowCount(0), Minimums(0),
+    MinimumSum(0), Gain(1.0), LowestGain(1.0), Frames(0) {}
+  ~Limiter() {Cleanup();}
+  
+  ///Prepares the limiter to keep the frames within plus or minus the ceiling.
+  void Initialize(int64 Channels, int64 SampleRate, float64 Ceiling);
+  
+  /**Takes frames in and gives out the limited frames the look-ahead before
+  them. Returns the frames given out, which are fewer only at the start. The
+  input may be null for silence.*/
+  int64 Process(const float64* Input, float64* Output, int64 Frames);
+  
+  ///Gives out the frames still held back (up to LookAhead of them).
+  int64 Finish(float64* Output);
+  
+  void Cleanup(void);
+};
+
+#endif
@@ -67,6 +67,8 @@ int main(int ArgumentCount, const ascii* ArgumentValues[])
 
 #else
 
+#include <iostream>
+
 #include "Libraries.h"
 
 void CommandLine(List<String>& Arguments);
@@ -102,6 +104,12 @@ public:
     {
       ls.Add() = s1;
     }
+    
+    /*When the audio is written to standard output, the console has to keep
+    out of its way.*/
+    if(ls.n() > 2 && ls[2] == "-")
+      std::cout.rdbuf(std::cerr.rdbuf());
+    
     Console cn;
     cn += "----------------------------------------------------------------------";
     cn += "Brick 1.3, the Brickwall Filter Resampler";
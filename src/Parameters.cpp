@@ -28,7 +28,58 @@
 
 #include "Parameters.h"
 #include "Kaiser.h"
+
+///Returns the largest prime factor of a positive number.
+static int64 LargestPrimeFactor(int64 n)
+{
+  int64 Largest = 1;
+  for(int64 d = 2; d * d <= n; d++)
+  {
+    while(n % d == 0)
+    {
+      Largest = d;
+      n /= d;
+    }
+  }
+  return (n > 1 ? n : Largest);
+}
+
+///Whether a number is a power of two (including one).
+static bool IsPowerOfTwo(int64 n)
+{
+  return n > 0 && (n & (n - 1)) == 0;
+}
+
+///Estimates the floating-point operations of a real FFT of size N.
+static float64 EstimateFFTOperations(int64 N)
+{
+  return 2.5 * (float64)N * math::Log(2.0, (float64)N);
+}
+  
+///Appends the bits of a number to a key, so that it matches only itself.
+static void AppendBits(String& Key, float64 x)
+{
+  int64 Bits;
+  Memory::Copy((void*)&Bits, (void*)&x, sizeof(Bits));
+  Key &= "_"; Key &= (integer)Bits;
+}
+
+void Parameters::SetMachineLimits(void)
+{
+  //Calculate maximum FFT size.
+  int Megs = juce::SystemStats::getMemorySizeInMegabytes();
+  MaxFFTSize = (int64)(math::Log(2.0, (float64)Megs) + 0.1) - 6 + 20;
+  if(MaxFFTSize > 26)
+    MaxFFTSize = 26; //FFTW will not uses sizes higher due to malloc failing.
+  
+  //Keep the scratch in memory if it takes no more than a quarter of it.
+  if(MaxScratchSize <= 0)
+    MaxScratchSize = (int64)Megs * 1024 * 1024 / 4;
   
+  if(Cores <= 0)
+    Cores = (int64)juce::SystemStats::getNumCpus();
+}
+
 bool Parameters::InitializeDerivedParameters(void)
 {
   //Create a Kaiser window object and determine the filter order.
@@ -44,7 +95,32 @@ bool Parameters::InitializeDerivedParameters(void)
     idealM = ConvolveInfo.frames;
     idealM_1 = idealM - 1;
   }
+  
+  /*The transition of the filter is narrow next to the P-space rate when P or Q
+  is large, so ratios like 147/160 take millions of taps. Splitting the rate
+  change into stages puts the narrow transition at twice the lower rate, and
+  leaves the other stages wide ones (see Cascade.h). The cascade is used when
+  it takes a quarter of the taps or fewer, or when the ratio is a power of two
+  with half-band stages, which are applied directly. The single filter is
+  still needed to export it.*/
+  Cascaded = false;
+  if(AllowCascade && !ConvolveHandle && !ExportFilterFilename &&
+    Cascade.Plan(P, Q, AllowableBandwidthLoss, StopbandAttenuation,
+      AllowHalfBand) && (Cascade.Taps * 4 <= idealM ||
+    (IsPowerOfTwo(P) && IsPowerOfTwo(Q) && Cascade.HalfBands > 0)))
+      return InitializeCascade();
 
+  /*Single precision resolves about 144dB below full scale, which is enough for
+  a filter that attenuates by no more than 140dB and an output rounded to
+  integers of 24 bits or fewer. The transforms and spectra then take half the
+  memory, and twice as many samples fit into each vector. The input and the
+  scratch stay in double precision, so the passes still add up exactly.*/
+  SinglePrecision = AllowSinglePrecision && !ConvolveHandle &&
+    StopbandAttenuation <= 140.0 && OutputIntegerBits > 0 &&
+    OutputIntegerBits <= 24;
+  int64 SampleSize = (int64)(SinglePrecision ? sizeof(float32) :
+    sizeof(float64));
+  
   //Algorithmically determine the best overlap-and-add FFT size.
   int64 MinPowerOfTwo = (int64)math::Log(2.0, (float64)idealM + 1.0);
   
@@ -56,6 +132,304 @@ bool Parameters::InitializeDerivedParameters(void)
     return false;
   }
   
+  int64 Min_i = EstimateFFTPowerOfTwo(idealM);
+  
+  idealFFTSize = 1;
+  for(int64 i = 1; i <= Min_i; i++)
+    idealFFTSize *= 2;
+  idealL = idealFFTSize - idealM_1;
+  idealL_1 = idealL - 1;
+  S = 1;
+  
+  if(Min_i > MaxFFTSize)
+  {
+    for(int64 i = 0; i < (Min_i - MaxFFTSize); i++)
+      S *= 2;
+  }
+  
+  paddedM = idealM + S - (idealM % S);
+  paddedM_1 = paddedM - 1;
+  
+  FFTSize = idealFFTSize / S;
+  M = paddedM / S;
+  M_1 = M - 1;
+  L = FFTSize - M_1;
+  L_1 = L - 1;
+  
+  /*When downsampling, only one in every Q samples of each inverse transform is
+  kept. If the FFT size is a multiple of Q, the spectrum can be folded Q ways
+  into the spectrum of a transform Q times shorter, which computes only those
+  samples. The chunk size must then also be a multiple of Q so that the kept
+  samples fall on the same indexes in every chunk. Transforms whose size has a
+  large prime factor are slow enough to cost more than folding saves.*/
+  Decimate = Q > 1 && LargestPrimeFactor(Q) <= 13;
+  DecimatedFFTSize = 0;
+  
+  /*When upsampling, all but one in every P samples of the P-space input are
+  zeroes. Instead of transforming the zero-stuffed input, the filter is split
+  into P sub-filters (phases) of every P-th tap, and each is convolved directly
+  with the N-space input. The P-space chunk size then becomes a whole number of
+  N-space chunks.*/
+  Polyphase = AllowPolyphase && !ConvolveHandle && P > 1;
+  if(Decimate && !Polyphase)
+  {
+    //Without a decimating size that fits, the transform is not folded.
+    int64 DecimatingFFTSize = EstimateDecimatingFFTSize(FFTSize, M);
+    if(DecimatingFFTSize)
+    {
+      FFTSize = DecimatingFFTSize;
+      L = (FFTSize - M_1) / Q * Q;
+      L_1 = L - 1;
+      DecimatedFFTSize = FFTSize / Q;
+    }
+    else
+      Decimate = false;
+  }
+  if(Polyphase)
+  {
+    PolyphaseM = (M + P - 1) / P;
+    PolyphaseFFTSize = 1;
+    int64 Polyphase_i = EstimateFFTPowerOfTwo(PolyphaseM);
+    for(int64 i = 1; i <= Polyphase_i; i++)
+      PolyphaseFFTSize *= 2;
+    
+    /*The P sub-filter spectra together should take up no more memory than the
+    spectrum of the whole filter would.*/
+    while(PolyphaseFFTSize * P > FFTSize * 2 &&
+      PolyphaseFFTSize / 2 > PolyphaseM)
+        PolyphaseFFTSize /= 2;
+    
+    //Very short sub-filters would otherwise lead to needlessly tiny chunks.
+    while(PolyphaseFFTSize < 4096)
+      PolyphaseFFTSize *= 2;
+    
+    PolyphaseL = PolyphaseFFTSize - (PolyphaseM - 1);
+    int64 DecimatingFFTSize = (Decimate ?
+      EstimateDecimatingFFTSize(PolyphaseFFTSize, PolyphaseM) : 0);
+    if(DecimatingFFTSize)
+    {
+      PolyphaseFFTSize = DecimatingFFTSize;
+      PolyphaseL = (PolyphaseFFTSize - (PolyphaseM - 1)) / Q * Q;
+      DecimatedFFTSize = PolyphaseFFTSize / Q;
+    }
+    else
+      Decimate = false;
+    L = PolyphaseL * P;
+    L_1 = L - 1;
+  }
+  
+  /*Convolution without a change of rate streams each channel through a
+  convolver whose partitions grow along the impulse response (see Convolver.h),
+  in a single pass however long the response is. Each channel has a convolver
+  of its own that takes the blocks in order, so there is one block per chunk
+  and the channels are the tasks.*/
+  NonUniform = AllowPartitioned && ConvolveHandle && P == 1 && Q == 1;
+  if(NonUniform)
+  {
+    S = 1;
+    M = paddedM;
+    M_1 = M - 1;
+    L = (int64)1 << 16;
+    L_1 = L - 1;
+    ConvolverHeadSize = 128;
+    ConvolverMaxSize = math::Min((int64)1 << 16, (int64)1 << (MaxFFTSize - 1));
+  }
+  
+  /*A filter split into S segments takes S passes over the input, each of them
+  adding into the whole scratch. Instead, the filter can be cut into partitions
+  as long as the block, which all apply in one pass (uniformly partitioned
+  convolution): partition s delays its input by s blocks, so the spectrum of
+  each block is kept for the partitions after the first, and each block sums
+  the products of the partitions with the spectra of the blocks before it ahead
+  of a single inverse transform. The blocks and partitions are half of the
+  transform, and their spectra (along with those of the last blocks of each
+  channel) have to fit in memory. The output keeps the length of the padded
+  filter of the passes, past which the partitions only have zeroes.*/
+  Partitioned = false;
+  Partitions = 1;
+  if(AllowPartitioned && S > 1)
+  {
+    int64 PartitionFFTSize = (Polyphase ? PolyphaseFFTSize : FFTSize);
+    if(Decimate && PartitionFFTSize / Q % 2 != 0)
+      PartitionFFTSize *= 2;
+    int64 PartitionL = PartitionFFTSize / 2;
+    int64 PartitionM = (Polyphase ? PartitionL * P : PartitionL);
+    int64 FilterPartitions = (idealM + PartitionM - 1) / PartitionM;
+    int64 Phases = (Polyphase ? P : 1);
+    int64 MaxBlocks = Cores * 2;
+    float64 SpectrumSize =
+      (float64)(PartitionFFTSize / 2 + 1) * 2.0 * (float64)SampleSize;
+    float64 PartitionedSize = SpectrumSize * (float64)(FilterPartitions *
+      Phases + (FilterPartitions + MaxBlocks) * Channels);
+    if(PartitionedSize <= (float64)MaxScratchSize)
+    {
+      Partitioned = true;
+      Partitions = FilterPartitions;
+      S = 1;
+      M = PartitionM;
+      M_1 = M - 1;
+      if(Polyphase)
+      {
+        PolyphaseFFTSize = PartitionFFTSize;
+        PolyphaseM = PartitionL;
+        PolyphaseL = PartitionL;
+        L = PolyphaseL * P;
+      }
+      else
+      {
+        FFTSize = PartitionFFTSize;
+        L = PartitionL;
+      }
+      L_1 = L - 1;
+      if(Decimate)
+        DecimatedFFTSize = PartitionFFTSize / Q;
+    }
+  }
+  
+  /*A stream is filtered as it arrives, and there is no scratch to add up the
+  passes of a split filter in, so the filter has to be applied in one pass.*/
+  if(Streaming && S > 1)
+  {
+    Console c;
+    c += "The filter is too long to be applied to a stream in one pass. Try a "
+      "lower --depth or a higher --allowablebandwidthloss.";
+    return false;
+  }
+  
+  /*A short filter is cheaper to apply directly: each output frame is then a
+  dot product of the PolyphaseM taps of its phase with the N-space input. The
+  filter has to fit in one pass, which it always does when it is short.*/
+  Direct = false;
+  if(AllowDirect && !ConvolveHandle && S == 1 && !Partitioned)
+  {
+    int64 DirectM = (M + P - 1) / P;
+    if((float64)DirectM * 2.0 < EstimateFFTCostPerFrame())
+    {
+      Direct = true;
+      Polyphase = false;
+      Decimate = false;
+      DecimatedFFTSize = 0;
+      PolyphaseM = DirectM;
+      PolyphaseFFTSize = 0;
+      PolyphaseL = 8192;
+      L = PolyphaseL * P;
+      L_1 = L - 1;
+    }
+  }
+  
+  /*The Kaiser filter is symmetric about its middle tap, since its length is
+  odd. When it is applied whole by zero-stuffing, it can be centred on the first
+  sample of the transform, with the taps before the middle wrapped around to the
+  end, which makes its spectrum real: only the gains need to be kept, and each
+  bin takes two multiplies instead of four. The input is placed the group delay
+  later in the transform instead, so the product and the output are unchanged.
+  Segments, partitions and phases of the filter are not symmetric.*/
+  ZeroPhase = !ConvolveHandle && !Polyphase && !Direct && !Partitioned &&
+    S == 1;
+  GroupDelay = (ZeroPhase ? idealM_1 / 2 : 0);
+  
+  /*The chunks are filtered by one worker thread per CPU. Each worker has FFT
+  buffers of its own, so there are no more workers than the memory allowed for
+  the largest FFT can hold.*/
+  int64 BatchFFTSize = (Polyphase ? PolyphaseFFTSize : FFTSize);
+  Workers = Cores;
+  while(!Direct && !NonUniform && Workers > 1 &&
+    Workers * BatchFFTSize > ((int64)1 << MaxFFTSize))
+      Workers--;
+  Workers = math::Max(Workers, (int64)1);
+  int64 WorkerChannels = (Channels + Workers - 1) / Workers;
+  
+  /*Since the filter is real, two channels can be filtered by one complex
+  transform, as its real and imaginary parts, instead of by two real ones. The
+  spectrum of the filter is conjugate-symmetric, so its upper half follows from
+  the lower half that is kept. The batches then hold an even number of
+  channels, and a channel left over by an odd count is filtered on its own.*/
+  Paired = AllowPairs && Channels > 1 && !Direct && !NonUniform &&
+    !Partitioned;
+  
+  /*Transforming the channels of a chunk together with one batched plan saves
+  the overhead of each transform, and the filter spectrum stays in cache while
+  it is applied to every channel. Large transforms gain little from this, so a
+  batch is kept to about 4M samples, in equally sized batches.*/
+  int64 MaxChannelBatch = math::Max((int64)1, ((int64)1 << 22) / BatchFFTSize);
+  int64 ChannelBatches =
+    (WorkerChannels + MaxChannelBatch - 1) / MaxChannelBatch;
+  ChannelBatch = (WorkerChannels + ChannelBatches - 1) / ChannelBatches;
+  if(Paired)
+    ChannelBatch = (ChannelBatch + 1) / 2 * 2;
+  if(NonUniform)
+    ChannelBatch = 1;
+  ChannelBatches = (Channels + ChannelBatch - 1) / ChannelBatch;
+  
+  /*With fewer channel batches than workers, several blocks of L are read at
+  once so that their transforms can run side by side. About two tasks per
+  worker leave room for the workers to balance the load by stealing. One chunk
+  is read and another written while a third is filtered, and the input and
+  output of the blocks in flight are kept within the memory of the largest
+  FFT.*/
+  Slots = 3;
+  int64 BlockFrames = (L / P + 1 + L / Q + 1) * Channels * Slots;
+  Blocks = (Workers * 2 + ChannelBatches - 1) / ChannelBatches;
+  while(Blocks > 1 && Blocks * BlockFrames > ((int64)1 << MaxFFTSize))
+    Blocks--;
+  Blocks = math::Max(Blocks, (int64)1);
+  if(NonUniform)
+    Blocks = 1;
+  Workers = math::Min(Workers, Blocks * ChannelBatches);
+  
+  CountOutputFrames();
+  ScratchInMemory = (ScratchFileSize <= MaxScratchSize);
+
+  return true;
+}
+
+bool Parameters::InitializeCascade(void)
+{
+  /*The stages are streaming resamplers, which filter in double precision,
+  each channel on its own, by FFT blocks sized for their own filters.*/
+  Cascaded = true;
+  SinglePrecision = false;
+  S = 1;
+  paddedM = idealM;
+  paddedM_1 = idealM_1;
+  M = idealM;
+  M_1 = idealM_1;
+  idealFFTSize = FFTSize = 0;
+  idealL = L = (int64)1 << 16;
+  idealL_1 = L_1 = L - 1;
+  Polyphase = Decimate = Direct = ZeroPhase = Paired = false;
+  Partitioned = NonUniform = false;
+  PolyphaseM = PolyphaseFFTSize = PolyphaseL = DecimatedFFTSize = 0;
+  Partitions = 1;
+  GroupDelay = 0;
+  Workers = 1;
+  ChannelBatch = Channels;
+  Blocks = 1;
+  Slots = 1;
+  
+  CountOutputFrames();
+  ScratchInMemory = (ScratchFileSize <= MaxScratchSize);
+  return true;
+}
+
+void Parameters::CountOutputFrames(void)
+{
+  InPFrames = Frames * P;
+  OutPFrames = InPFrames + paddedM_1;
+  if(OutPFrames % Q == 0)
+    OutPQFrames = OutPFrames / Q;
+  else
+    OutPQFrames = (OutPFrames + (Q - (OutPFrames % Q))) / Q;
+  if(Cascaded)
+    OutPQFrames = Cascade.OutputFrames(Frames);
+  
+  ScratchFileSize = OutPQFrames * Channels * sizeof(float64);
+}
+
+int64 Parameters::EstimateFFTPowerOfTwo(int64 FilterSize)
+{
+  int64 FilterSize_1 = FilterSize - 1;
+  int64 MinPowerOfTwo = (int64)math::Log(2.0, (float64)FilterSize + 1.0);
   int64 Min_i = MinPowerOfTwo + 2;
   int64 i_2 = 1;
   float64 MinEstimate = -1.;
@@ -67,11 +441,11 @@ bool Parameters::InitializeDerivedParameters(void)
   for(int64 i = MinPowerOfTwo; i <= MinPowerOfTwo + 5; i++, i_2 *= 2)
   {
     float64 Estimate;
-    if(i_2 > idealM_1)
+    if(i_2 > FilterSize_1)
     {
       AcceptableEstimateIndex++;
       Estimate = (float64)i_2 * (math::Log(2.0, (float64)i_2) + 1.0) / 
-        (float64)(i_2 - idealM_1);
+        (float64)(i_2 - FilterSize_1);
       if(Estimate < MinEstimate || MinEstimate < 0)
       {
         MinEstimate = Estimate;
@@ -92,38 +466,116 @@ bool Parameters::InitializeDerivedParameters(void)
     }
   }
   
-  idealFFTSize = 1;
-  for(int64 i = 1; i <= Min_i; i++)
-    idealFFTSize *= 2;
-  idealL = idealFFTSize - idealM_1;
-  idealL_1 = idealL - 1;
-  S = 1;
+  return Min_i;
+}
+
+int64 Parameters::EstimateDecimatingFFTSize(int64 PowerOfTwoSize,
+  int64 FilterSize)
+{
+  //Start with the largest Q times a power-of-two that is not any bigger.
+  int64 Size = Q;
+  while(Size * 2 <= PowerOfTwoSize)
+    Size *= 2;
   
-  if(Min_i > MaxFFTSize)
+  /*Rounding down could leave too little room for the chunk after the filter,
+  so keep at least half of the original chunk (and at least Q samples).*/
+  int64 FilterSize_1 = FilterSize - 1;
+  int64 MinChunk = math::Max((PowerOfTwoSize - FilterSize_1) / 2, Q);
+  int64 MaxSize = (int64)1 << MaxFFTSize;
+  while((Size - FilterSize_1) / Q * Q < MinChunk)
   {
-    for(int64 i = 0; i < (Min_i - MaxFFTSize); i++)
-      S *= 2;
+    //Growing past the largest FFT size would not fit in memory.
+    if(Size * 2 > MaxSize)
+      return 0;
+    Size *= 2;
   }
   
-  paddedM = idealM + S - (idealM % S);
-  paddedM_1 = paddedM - 1;
+  return Size;
+}
+
+float64 Parameters::EstimateFFTCostPerFrame(void)
+{
+  /*Each chunk costs a forward transform, a complex multiply (six operations
+  per bin) and an inverse transform for the filter, or for each phase of it.
+  The cost is spread over the output frames the chunk yields.*/
+  float64 Frames = (float64)L / (float64)Q;
+  if(Polyphase)
+  {
+    int64 InverseSize = (Decimate ? DecimatedFFTSize : PolyphaseFFTSize);
+    float64 PerPhase = 3.0 * (float64)PolyphaseFFTSize +
+      EstimateFFTOperations(InverseSize);
+    return (EstimateFFTOperations(PolyphaseFFTSize) + (float64)P * PerPhase) /
+      Frames;
+  }
   
-  FFTSize = idealFFTSize / S;
-  M = paddedM / S;
-  M_1 = M - 1;
-  L = FFTSize - M_1;
-  L_1 = L - 1;
+  int64 InverseSize = (Decimate ? DecimatedFFTSize : FFTSize);
+  return (EstimateFFTOperations(FFTSize) + 3.0 * (float64)FFTSize +
+    EstimateFFTOperations(InverseSize)) / Frames;
+}
+
+int64 Parameters::EstimateMemory(void)
+{
+  int64 SampleSize = (int64)(SinglePrecision ? sizeof(float32) :
+    sizeof(float64));
+  int64 Bytes = 0;
+  if(SkipFilter)
+    return (ScratchInMemory ? Frames * Channels * (int64)sizeof(float64) : 0);
   
-  InPFrames = Frames * P;
-  OutPFrames = InPFrames + paddedM_1;
-  if(OutPFrames % Q == 0)
-    OutPQFrames = OutPFrames / Q;
+  //The stages of a cascade, and the chunk of input they are fed.
+  if(Cascaded)
+  {
+    Bytes += Cascade.EstimateMemory(Channels);
+    Bytes += L * Channels * (int64)sizeof(float64);
+    if(ScratchInMemory)
+      Bytes += ScratchFileSize;
+    return Bytes;
+  }
+  
+  //The filter, and the transforms and windows of each worker.
+  if(Direct)
+  {
+    Bytes += P * PolyphaseM * SampleSize;
+    Bytes += Workers * (PolyphaseM + PolyphaseL) * SampleSize;
+  }
+  else if(NonUniform)
+  {
+    //The partitions of the response and the spectra of each channel.
+    Bytes += idealM * 4 * (Channels + 1) * (int64)sizeof(float64);
+  }
   else
-    OutPQFrames = (OutPFrames + (Q - (OutPFrames % Q))) / Q;
+  {
+    int64 Transform = (Polyphase ? PolyphaseFFTSize : FFTSize);
+    int64 Spectrum = (Transform / 2 + 1) * 2 * SampleSize;
+    int64 Phases = (Polyphase ? P : 1);
+    Bytes += Spectrum * Phases * Partitions;
+    Bytes += Spectrum * ChannelBatch * Workers * 2;
+    if(Partitioned)
+      Bytes += Spectrum * (Partitions + Blocks - 1) * Channels;
+  }
   
-  ScratchFileSize = OutPQFrames * Channels * sizeof(float64);
+  //The chunks in flight, and the scratch if it is kept in memory.
+  Bytes += Slots * Blocks * (L / P + L / Q + 2) * Channels *
+    (int64)sizeof(float64);
+  if(ScratchInMemory)
+    Bytes += ScratchFileSize;
+  return Bytes;
+}
 
-  return true;
+String Parameters::FilterKey(void)
+{
+  String Key;
+  Key &= P; Key &= "_"; Key &= Q;
+  AppendBits(Key, AllowableBandwidthLoss);
+  AppendBits(Key, StopbandAttenuation);
+  Key &= "_"; Key &= (Polyphase ? PolyphaseFFTSize : FFTSize);
+  Key &= "_"; Key &= S;
+  Key &= "_"; Key &= M;
+  Key &= "_"; Key &= Partitions;
+  Key &= "_"; Key &= PolyphaseM;
+  Key &= "_"; Key &= (Direct ? "direct" : (Polyphase ? "polyphase" :
+    (ZeroPhase ? "zerophase" : "full")));
+  Key &= "_"; Key &= (SinglePrecision ? "float32" : "float64");
+  return Key;
 }
 
 void Parameters::Print(void)
@@ -30,6 +30,7 @@
 #define PARAMETERS_H
 
 #include "Libraries.h"
+#include "Cascade.h"
 
 struct Parameters
 {
@@ -54,15 +55,29 @@ struct Parameters
   String DitherType;
   float64 DitherBits;
   
+  String Normalization; //peak, limit or none (chosen for the input if empty)
+  bool MeasureLevels; //Whether to report the RMS and DC levels of the output
+  
   //Ins...
-  int64 Frames; //Number of frames
+  int64 Frames; //Number of frames (zero until a stream runs out)
+  bool Streaming; //Whether the input or output is a pipe, read or written once
   int64 Channels; //Number of channels
   int64 P; //Upsample ratio
   int64 Q; //Downsample ratio
   bool SkipFilter; //Whether or not to skip the filter.
+  bool AllowPolyphase; //Whether the polyphase decomposition may be used.
+  bool AllowDirect; //Whether short filters may be applied without the FFT.
+  bool AllowPartitioned; //Whether a split filter may be applied in one pass.
+  bool AllowSinglePrecision; //Whether filtering may be done in float32.
+  bool AllowPairs; //Whether two channels may share a complex transform.
+  bool AllowCascade; //Whether the rate may be changed in several stages.
+  bool AllowHalfBand; //Whether stages of two may use half-band filters.
+  int64 OutputIntegerBits; //Bits of integer output samples (zero if float)
   float64 AllowableBandwidthLoss; //Transition width
   float64 StopbandAttenuation; //dB of attenuation
   int64 MaxFFTSize; //In powers of two.
+  int64 MaxScratchSize; //Largest scratch kept in memory, in bytes (or zero)
+  int64 Cores; //CPUs the render may keep busy (all of them if zero)
   int64 BCOptimizationLevel; //How many powers-of-two to go up to find the best.
   int64 OldSampleRate; //Old sample rate (Hz)
   int64 NewSampleRate; //New sample rate (Hz)
@@ -91,15 +106,76 @@ struct Parameters
   int64 L; //Actual audio chunk size
   int64 L_1; //Actual audio chunk size minus one
   
+  bool Polyphase; //Whether to split the filter into P sub-filters
+  int64 PolyphaseM; //Sub-filter size (taps per phase)
+  int64 PolyphaseFFTSize; //N-space FFT size of each sub-filter convolution
+  int64 PolyphaseL; //N-space audio chunk size
+  
+  bool Decimate; //Whether inverse FFTs only compute the kept 1 in Q samples
+  int64 DecimatedFFTSize; //Size of the folded inverse FFT
+  
+  bool Direct; //Whether to convolve each phase directly in the time domain
+  
+  bool ZeroPhase; //Whether the filter is centred so its spectrum is real
+  int64 GroupDelay; //P-space delay of the input that makes up for centring
+  
+  bool Paired; //Whether channels are filtered in pairs by complex transforms
+  
+  bool SinglePrecision; //Whether the filter is applied with float32 samples
+  
+  bool Partitioned; //Whether each pass applies several partitions of M
+  int64 Partitions; //Filter partitions applied by each pass
+  
+  bool NonUniform; //Whether to convolve with growing partitions, unresampled
+  int64 ConvolverHeadSize; //Taps convolved directly by the convolver
+  int64 ConvolverMaxSize; //Largest partition of the convolver
+  
+  bool Cascaded; //Whether the rate is changed by a cascade of stages
+  CascadePlan Cascade; //Stages of the cascade, which replace the filter
+  
+  int64 Workers; //Threads that filter the chunks in parallel
+  int64 ChannelBatch; //Channels transformed together by batched FFT plans
+  int64 Blocks; //Blocks of L read at once and filtered in parallel
+  int64 Slots; //Chunks in flight between reading, filtering and writing
+  
   int64 InPFrames; //Number of input frames
   int64 OutPFrames; //Number of output P-frames
   int64 OutPQFrames; //Number of output P/Q-frames
   int64 ScratchFileSize; //Size of scratch file in bytes
+  bool ScratchInMemory; //Whether the scratch is kept in memory instead of disk
   
   String OutFormat; //int8, int16, int24, int32, float32, float64
   
+  /**Sets the largest FFT size from the memory of the machine, along with the
+  largest scratch kept in memory and the CPUs to use, unless they are set.*/
+  void SetMachineLimits(void);
+  
   bool InitializeDerivedParameters(void);
   
+  /**Sets the derived parameters for a cascade, which streams through its
+  stages in one pass with no FFT convolution of its own.*/
+  bool InitializeCascade(void);
+  
+  ///Derives the lengths of the output from the number of input frames.
+  void CountOutputFrames(void);
+  
+  ///Finds the power-of-two exponent giving the cheapest overlap-add FFT.
+  int64 EstimateFFTPowerOfTwo(int64 FilterSize);
+  
+  /**Finds a multiple of Q near a power-of-two FFT size for decimation, or zero
+  if there is none within the largest FFT size.*/
+  int64 EstimateDecimatingFFTSize(int64 PowerOfTwoSize, int64 FilterSize);
+  
+  ///Estimates the operations per output frame of the chosen FFT convolution.
+  float64 EstimateFFTCostPerFrame(void);
+  
+  ///Estimates the bytes of memory the render takes, including the scratch.
+  int64 EstimateMemory(void);
+  
+  /**Returns a key for the design of the filter and its layout in memory, which
+  is the same for all renders that would make the same filter.*/
+  String FilterKey(void);
+  
   void Print(void);
 };
 
@@ -0,0 +1,195 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#include "Pipe.h"
+
+#if JUCE_WINDOWS
+  #include <fcntl.h>
+  #include <io.h>
+#else
+  #include <sys/stat.h>
+#endif
+
+bool Pipe::IsPipe(String Filename)
+{
+  if(Filename == "-")
+    return true;
+#if JUCE_WINDOWS
+  return false;
+#else
+  struct stat Info;
+  if(stat(Filename, &Info) != 0)
+    return false;
+  return S_ISFIFO(Info.st_mode) || S_ISCHR(Info.st_mode);
+#endif
+}
+
+SNDFILE* Pipe::Open(String Filename, int Mode, SF_INFO& Info)
+{
+  Close();
+  Writes = (Mode == SFM_WRITE);
+  if(Filename == "-")
+  {
+    Handle = (Writes ? stdout : stdin);
+#if JUCE_WINDOWS
+    _setmode(_fileno(Handle), _O_BINARY);
+#endif
+  }
+  else
+  {
+    Handle = fopen(Filename, (Writes ? "wb" : "rb"));
+    Owned = true;
+  }
+  if(!Handle)
+    return 0;
+  
+  if(!Writes)
+    Head = new byte[HeadCapacity];
+  SF_VIRTUAL_IO IO = {GetLength, Seek, Read, Write, Tell};
+  return sf_open_virtual(&IO, Mode, &Info, this);
+}
+
+void Pipe::Close(void)
+{
+  if(Handle && Owned)
+    fclose(Handle);
+  else if(Handle && Writes)
+    fflush(Handle);
+  delete [] Head;
+  Handle = 0;
+  Owned = false;
+  Head = 0;
+  HeadBytes = 0;
+  Streamed = 0;
+  Position = 0;
+}
+
+sf_count_t Pipe::GetLength(void* User)
+{
+  Pipe* p = (Pipe*)User;
+  if(p->Writes)
+    return (sf_count_t)math::Max(p->Streamed, p->Position);
+  
+  /*The length of the input is not known until it runs out. It is reported as
+  longer than any 32-bit length field of a header can describe, so that the
+  length in the header is believed, and a header written for a stream (with
+  the largest length, or none at all) is read until the stream runs out.*/
+  return (sf_count_t)1 << 40;
+}
+
+sf_count_t Pipe::Seek(sf_count_t Offset, int Whence, void* User)
+{
+  Pipe* p = (Pipe*)User;
+  int64 Target = (int64)Offset;
+  if(Whence == SEEK_CUR)
+    Target += p->Position;
+  else if(Whence == SEEK_END)
+    return -1;
+  if(Target < 0)
+    return -1;
+  
+  //Any position can be written to, although only the new bytes are sent.
+  if(p->Writes)
+  {
+    p->Position = Target;
+    return p->Position;
+  }
+  
+  /*Seek back into the head, or ahead by reading and dropping the bytes between.
+  Once more has streamed than the head holds, reading on from the head would
+  skip the bytes after it, so no position before the end of the stream can be
+  returned to.*/
+  if(Target < p->Streamed && p->Streamed > p->HeadBytes)
+    return -1;
+  if(Target <= p->Streamed)
+  {
+    p->Position = Target;
+    return p->Position;
+  }
+  p->Position = p->Streamed;
+  byte Skipped[4096];
+  while(p->Position < Target)
+  {
+    int64 Bytes = math::Min(Target - p->Position, (int64)sizeof(Skipped));
+    if(Read(Skipped, (sf_count_t)Bytes, User) < Bytes)
+      break;
+  }
+  return p->Position;
+}
+
+sf_count_t Pipe::Read(void* Destination, sf_count_t Bytes, void* User)
+{
+  Pipe* p = (Pipe*)User;
+  byte* d = (byte*)Destination;
+  int64 Done = 0;
+  
+  //Bytes before the end of the stream are in the head (see Seek).
+  if(p->Position < p->Streamed)
+  {
+    Done = math::Min((int64)Bytes, p->HeadBytes - p->Position);
+    Memory::CopyArray(d, &p->Head[p->Position], Done);
+    p->Position += Done;
+  }
+  
+  //Read the rest from the stream, keeping it in the head while there is room.
+  if(Done < (int64)Bytes)
+  {
+    int64 BytesRead = (int64)fread(&d[Done], 1, (size_t)(Bytes - Done),
+      p->Handle);
+    int64 Kept = math::Min(BytesRead, HeadCapacity - p->HeadBytes);
+    Memory::CopyArray(&p->Head[p->HeadBytes], &d[Done], Kept);
+    p->HeadBytes += Kept;
+    p->Streamed += BytesRead;
+    p->Position += BytesRead;
+    Done += BytesRead;
+  }
+  return (sf_count_t)Done;
+}
+
+sf_count_t Pipe::Write(const void* Source, sf_count_t Bytes, void* User)
+{
+  Pipe* p = (Pipe*)User;
+  const byte* s = (const byte*)Source;
+  
+  //Drop the bytes that were already sent, and fill any gap with zeroes.
+  int64 Dropped = math::Min((int64)Bytes,
+    math::Max(p->Streamed - p->Position, (int64)0));
+  for(; p->Streamed < p->Position; p->Streamed++)
+    fputc(0, p->Handle);
+  
+  int64 Sent = (int64)fwrite(&s[Dropped], 1, (size_t)(Bytes - Dropped),
+    p->Handle);
+  p->Streamed += Sent;
+  p->Position += Dropped + Sent;
+  return (sf_count_t)(Dropped + Sent);
+}
+
+sf_count_t Pipe::Tell(void* User)
+{
+  return (sf_count_t)((Pipe*)User)->Position;
+}
@@ -0,0 +1,82 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#include "Libraries.h"
+
+/**Standard input or output, or a named pipe, opened through the virtual I/O of
+libsndfile. A pipe only goes forward, so the first bytes that are read are kept
+for libsndfile to seek back into while it parses the header, and seeking ahead
+skips the bytes in between. When writing, whatever libsndfile writes back over
+bytes already sent (the header, updated with the length on closing) is dropped:
+the header keeps the length it was first written with, and readers of the
+stream read until it ends.*/
+struct Pipe
+{
+  ///The stream, and whether it was opened here rather than being standard I/O.
+  FILE* Handle;
+  bool Owned;
+  bool Writes;
+  
+  ///The first bytes of the stream, for seeking back into the header.
+  byte* Head;
+  int64 HeadBytes;
+  
+  ///Bytes read from or written to the stream, and where libsndfile is at.
+  int64 Streamed;
+  int64 Position;
+  
+  Pipe() : Handle(0), Owned(false), Writes(false), Head(0), HeadBytes(0),
+    Streamed(0), Position(0) {}
+  ~Pipe() {Close();}
+  
+  ///Bytes of the head kept for seeking back into.
+  static const int64 HeadCapacity = 1024 * 1024;
+  
+  /**Whether the filename is '-' for standard input or output, or names a
+  named pipe (or other non-seekable file) that has to be streamed.*/
+  static bool IsPipe(String Filename);
+  
+  /**Opens standard input or output for '-', and otherwise the named pipe, and
+  then the sound stream on top of it. Returns null on failure.*/
+  SNDFILE* Open(String Filename, int Mode, SF_INFO& Info);
+  
+  ///Closes the stream if it was opened here.
+  void Close(void);
+  
+  //Virtual I/O callbacks, taking the pipe as the user data.
+  static sf_count_t GetLength(void* User);
+  static sf_count_t Seek(sf_count_t Offset, int Whence, void* User);
+  static sf_count_t Read(void* Destination, sf_count_t Bytes, void* User);
+  static sf_count_t Write(const void* Source, sf_count_t Bytes, void* User);
+  static sf_count_t Tell(void* User);
+};
+
+#endif
@@ -28,8 +28,14 @@
 
 #include "Render.h"
 
+#include "Cascade.h"
+#include "Convolver.h"
+#include "FilterCache.h"
 #include "Kaiser.h"
+#include "Kernels.h"
 #include "Parameters.h"
+#include "Scratch.h"
+#include "Wisdom.h"
 
 #include "Work.h"
 
@@ -37,9 +43,182 @@
 #include <sstream>
 #include <string>
 
-void Renderer::Initialize(Parameters* p)
+void RenderLevels::Initialize(int64 Channels, bool Averages)
+{
+  Cleanup();
+  RenderLevels::Channels = Channels;
+  RenderLevels::Averages = Averages;
+  Minimums = new float64[Channels];
+  Maximums = new float64[Channels];
+  Memory::ClearArray(Minimums, Channels);
+  Memory::ClearArray(Maximums, Channels);
+  if(Averages)
+  {
+    Sums = new float64[Channels];
+    SumSquares = new float64[Channels];
+    Memory::ClearArray(Sums, Channels);
+    Memory::ClearArray(SumSquares, Channels);
+  }
+}
+
+void RenderLevels::Measure(const float64* Source, int64 Count)
+{
+  const Kernels<float64>& k = Kernels<float64>::Get();
+  for(int64 c = 0; c < Channels; c++)
+  {
+    k.FindRange(&Source[c], Channels, Count, &Minimums[c], &Maximums[c]);
+    if(!Averages)
+      continue;
+    float64 Sum = 0.0, SumSquare = 0.0;
+    for(int64 i = 0; i < Count; i++)
+    {
+      float64 Value = Source[i * Channels + c];
+      Sum += Value;
+      SumSquare += Value * Value;
+    }
+    Sums[c] += Sum;
+    SumSquares[c] += SumSquare;
+  }
+  Frames += Count;
+}
+
+float64 RenderLevels::Minimum(void)
+{
+  float64 Lowest = 0.0;
+  for(int64 c = 0; c < Channels; c++)
+    Lowest = math::Min(Lowest, Minimums[c]);
+  return Lowest;
+}
+
+float64 RenderLevels::Maximum(void)
+{
+  float64 Highest = 0.0;
+  for(int64 c = 0; c < Channels; c++)
+    Highest = math::Max(Highest, Maximums[c]);
+  return Highest;
+}
+
+void RenderLevels::Cleanup(void)
+{
+  delete [] Minimums;
+  delete [] Maximums;
+  delete [] Sums;
+  delete [] SumSquares;
+  Minimums = Maximums = Sums = SumSquares = 0;
+  Channels = 0;
+  Frames = 0;
+}
+
+///Folds a half spectrum Q ways in the same way as MultiplyAndFoldSpectrum.
+template <class Sample>
+static void FoldSpectrum(Sample* Destination, const Sample* a, int64 N,
+  int64 Q)
+{
+  int64 Folded = N / Q;
+  int64 FoldedBins = Folded / 2 + 1;
+  int64 Bins = N / 2 + 1;
+  Memory::ClearArray(Destination, FoldedBins * 2);
+  for(int64 f = 0, Bin = 0; f < Bins; f++)
+  {
+    Sample Real = a[f * 2];
+    Sample Imag = a[f * 2 + 1];
+    
+    if(Bin < FoldedBins)
+    {
+      Destination[Bin * 2] += Real;
+      Destination[Bin * 2 + 1] += Imag;
+    }
+    
+    int64 Mirror = (Bin ? Folded - Bin : 0);
+    if(f != 0 && f * 2 != N && Mirror < FoldedBins)
+    {
+      Destination[Mirror * 2] += Real;
+      Destination[Mirror * 2 + 1] -= Imag;
+    }
+    
+    if(++Bin == Folded)
+      Bin = 0;
+  }
+}
+
+/**Complex multiplies the full spectrum of an N-point complex transform by the
+spectrum of a real filter, of which only the half spectrum is kept (or only its
+gains, when they are real). The filter is conjugate symmetric, so bin f above
+N / 2 is the conjugate of bin N - f. The destination may be the spectrum.*/
+template <class Sample>
+static void MultiplyPairSpectrum(const Kernels<Sample>& k, Sample* Destination,
+  const Sample* a, const Sample* Filter, int64 N, bool Gains)
+{
+  int64 Bins = N / 2 + 1;
+  if(Gains)
+  {
+    k.MultiplyRealSpectrum(Destination, a, Filter, Bins);
+    for(int64 f = Bins; f < N; f++)
+    {
+      Sample Gain = Filter[N - f];
+      Destination[f * 2] = a[f * 2] * Gain;
+      Destination[f * 2 + 1] = a[f * 2 + 1] * Gain;
+    }
+    return;
+  }
+  
+  k.MultiplySpectrum(Destination, a, Filter, Bins);
+  for(int64 f = Bins; f < N; f++)
+  {
+    Sample r1 = a[f * 2];
+    Sample r2 = Filter[(N - f) * 2];
+    
+    Sample i1 = a[f * 2 + 1];
+    Sample i2 = -Filter[(N - f) * 2 + 1];
+    
+    Destination[f * 2] = r1 * r2 - i1 * i2;
+    Destination[f * 2 + 1] = r1 * i2 + r2 * i1;
+  }
+}
+
+/**Folds the full spectrum of an N-point complex transform Q ways into the
+spectrum of an N / Q-point transform (see MultiplyAndFoldSpectrum). Without
+conjugate symmetry every bin is kept, so bin f simply lands in f mod (N / Q).*/
+template <class Sample>
+static void FoldPairSpectrum(Sample* Destination, const Sample* a, int64 N,
+  int64 Q)
+{
+  int64 Folded_2 = N / Q * 2;
+  Memory::CopyArray(Destination, a, Folded_2);
+  for(int64 j = 1; j < Q; j++)
+  {
+    const Sample* Part = &a[j * Folded_2];
+    for(int64 i = 0; i < Folded_2; i++)
+      Destination[i] += Part[i];
+  }
+}
+
+///Reads frames from a sound file in the precision of the destination.
+static sf_count_t ReadFrames(SNDFILE* s, float64* Destination,
+  sf_count_t Frames)
+{
+  return sf_readf_double(s, Destination, Frames);
+}
+
+static sf_count_t ReadFrames(SNDFILE* s, float32* Destination,
+  sf_count_t Frames)
+{
+  return sf_readf_float(s, Destination, Frames);
+}
+
+///Copies an array into an array of another precision.
+template <class To, class From>
+static void ConvertArray(To* Destination, const From* Source, int64 Items)
+{
+  for(int64 i = 0; i < Items; i++)
+    Destination[i] = (To)Source[i];
+}
+
+template <class Sample>
+void Renderer<Sample>::Initialize(Parameters* p)
 {  
   Renderer::p = p;
+  Kernel = &Kernels<Sample>::Get();
   
   if(!p->ConvolveFilename)
   {
@@ -47,34 +226,1101 @@ void Renderer::Initialize(Parameters* p)
     KaiserLPF = new Kaiser;
     KaiserLPF->Initialize(p->P, p->Q, p->AllowableBandwidthLoss,
       p->StopbandAttenuation);
+    KaiserLPF->SetThreads(p->Cores);
   }
   else
   {
     KaiserLPF = 0;
   }
   
-  //Initialize the FFT object.
-  FFTer.Initialize(p->FFTSize, FFTW_PATIENT, 0, true);
+  /*Each worker transforms a batch of channels of a block at a time (direct
+  convolution does not need any FFTs, and the convolvers have their own).
+  FFTW plans are made here, since planning is not thread-safe. The filter is
+  transformed on its own unless there is a single unbatched transform.*/
+  int Batch = (int)p->ChannelBatch;
+  int64 FFTSize = (p->Polyphase ? p->PolyphaseFFTSize : p->FFTSize);
+  WorkerCount = p->Workers;
+  Workers = new RenderWorker<Sample>[WorkerCount];
+  
+  /*Each worker has a CPU to itself, so its transforms run on a single thread,
+  while a lone worker's transforms run on the CPUs the render may keep busy.*/
+  const juce::ScopedLock PlanLock(FFTMultithread::PlanLock);
+  bool ThreadedPlans = FFTMultithread::Threads > 0;
+  if(ThreadedPlans)
+    FFTMultithread::PlanWithThreads(WorkerCount > 1 ? 1 : (int)p->Cores);
+  for(int64 i = 0; i < WorkerCount; i++)
+  {
+    RenderWorker<Sample>& w = Workers[i];
+    w.r = this;
+    if(p->Paired)
+    {
+      //A channel left over by an odd count is transformed on its own.
+      w.PairFFTer.Initialize(FFTSize, FFTW_PATIENT, 0, Batch / 2);
+      if(p->Decimate)
+        w.PairDecimatedFFTer.Initialize(p->DecimatedFFTSize, FFTW_PATIENT, 0,
+          Batch / 2);
+      if(p->Channels % 2)
+        w.FFTer.Initialize(FFTSize, FFTW_PATIENT, 0, true);
+      if(p->Channels % 2 && p->Decimate)
+        w.DecimatedFFTer.Initialize(p->DecimatedFFTSize, FFTW_PATIENT, 0,
+          true);
+      continue;
+    }
+    if(!p->Direct && !p->NonUniform)
+      w.FFTer.Initialize(FFTSize, FFTW_PATIENT, 0, true, Batch);
+    if(p->Decimate)
+      w.DecimatedFFTer.Initialize(p->DecimatedFFTSize, FFTW_PATIENT, 0, true,
+        Batch);
+  }
+  
+  /*Without resampling, the impulse response is read whole and each channel
+  is streamed through a convolver of its own.*/
+  if(p->NonUniform)
+  {
+    float64* Response = new float64[p->idealM];
+    sf_seek(p->ConvolveHandle, 0, SEEK_SET);
+    int64 FramesRead = (int64)sf_readf_double(p->ConvolveHandle, Response,
+      (sf_count_t)p->idealM);
+    FramesRead = math::Max(FramesRead, (int64)0);
+    Memory::ClearArray(&Response[FramesRead], p->idealM - FramesRead);
+    
+    ConvolveResponse = new ConvolverFilter;
+    ConvolveResponse->Initialize(Response, p->idealM, p->ConvolverHeadSize,
+      p->ConvolverMaxSize);
+    Convolvers = new Convolver[p->Channels];
+    for(int64 i = 0; i < p->Channels; i++)
+      Convolvers[i].Initialize(*ConvolveResponse);
+    delete [] Response;
+  }
+  if(!p->Direct && !p->NonUniform && (WorkerCount > 1 || Batch > 1))
+    FilterFFTer.Initialize(FFTSize, FFTW_PATIENT, 0, true);
+  if(ThreadedPlans)
+    FFTMultithread::PlanWithThreads(FFTMultithread::Threads);
+}
+
+template <class Sample>
+Renderer<Sample>::~Renderer()
+{
+  const juce::ScopedLock PlanLock(FFTMultithread::PlanLock);
+  delete [] Workers;
+  delete KaiserLPF;
+  FilterFFTer.Initialize(0, FFTW_PATIENT, 0);
+}
+
+template <class Sample>
+AudioFFTOf<Sample>& Renderer<Sample>::FilterTransform(void)
+{
+  return (FilterFFTer.N_Time() ? FilterFFTer : Workers[0].FFTer);
+}
+
+template <class Sample>
+void RenderWorker<Sample>::run(void)
+{
+  //Each notify() hands over a chunk, unless the thread is being stopped.
+  while(wait(-1) && !threadShouldExit())
+  {
+    r->FilterTasks(*this);
+    Done.signal();
+  }
+}
+
+void RenderQueue::Initialize(int64 Capacity)
+{
+  delete [] Items;
+  RenderQueue::Capacity = Capacity;
+  Items = new int64[Capacity];
+  Head = 0;
+  Count = 0;
+  Pushed.reset();
+}
+
+void RenderQueue::Push(int64 Slot)
+{
+  {
+    const juce::ScopedLock sl(Lock);
+    Items[(Head + Count) % Capacity] = Slot;
+    Count++;
+  }
+  Pushed.signal();
+}
+
+int64 RenderQueue::Pop(void)
+{
+  //The event may be left over from an earlier push, so check before waiting.
+  while(true)
+  {
+    {
+      const juce::ScopedLock sl(Lock);
+      if(Count)
+      {
+        int64 Slot = Items[Head];
+        Head = (Head + 1) % Capacity;
+        Count--;
+        return Slot;
+      }
+    }
+    Pushed.wait(-1);
+  }
+}
+
+template <class Sample>
+void RenderIO<Sample>::run(void)
+{
+  if(Writes)
+    r->WriteChunks();
+  else
+    r->ReadChunks();
+}
+
+template <class Sample>
+void Renderer<Sample>::ReadChunks(void)
+{
+  SNDFILE* s_in = InputFile;
+  int64 InputShift = PassInputShift;
+  RenderSlot* Previous = 0;
+  bool InputEnded = false;
+  
+  //Loop through horizontal chunks of the P-space input.
+  bool Last = false;
+  for(int64 PSpaceStart = 0; !Last; PSpaceStart += ChunkL)
+  {
+    RenderSlot& Slot = Slots[FreeSlots.Pop()];
+    float64* NChunk = Slot.NChunk;
+    
+    //Make calculations for translating from N space to P space.
+    int64 PSpaceEnd = PSpaceStart + ChunkL - 1;
+    int64 NSpaceStart;
+    if(PSpaceStart % p->P == 0)
+      NSpaceStart = PSpaceStart / p->P;
+    else
+      NSpaceStart = (PSpaceStart - (PSpaceStart % p->P) + p->P) / p->P;
+    int64 NSpaceEnd = (PSpaceEnd - (PSpaceEnd % p->P)) / p->P;
+    int64 NSpaceSamples = NSpaceEnd - NSpaceStart + 1;
+      
+    //Make calculations for translating from P space to PQ space.
+    int64 PQSpaceStart;
+    if(PSpaceStart % p->Q == 0)
+      PQSpaceStart = PSpaceStart / p->Q;
+    else
+      PQSpaceStart = (PSpaceStart - (PSpaceStart % p->Q) + p->Q) / p->Q;
+    int64 PQSpaceEnd = (PSpaceEnd - (PSpaceEnd % p->Q)) / p->Q;
+    int64 PQSpaceSamples = PQSpaceEnd - PQSpaceStart + 1;
+    
+    //The history of the chunk is the end of the input before it.
+    if(Previous)
+      Memory::CopyArray(Slot.InputChunk,
+        &Previous->InputChunk[Previous->NSpaceSamples * p->Channels],
+        HistorySamples);
+    else
+      Memory::ClearArray(Slot.InputChunk, HistorySamples);
+    
+    //Read in a block taking into account the pass delay input shift zero pad.
+    int64 FramesRead;
+    if(InputShift == 0)
+    {
+      //Read in a block from the N-space input file.
+      FramesRead = (int64)sf_readf_double(
+        s_in, NChunk, (sf_count_t)NSpaceSamples);
+    }
+    else if(InputShift < NSpaceSamples)
+    {
+      //Zero pad the beginning of the chunk array to reflect input shift.
+      Memory::ClearArray(NChunk, InputShift * p->Channels);
+      
+      //Read in a block from the N-space input file.
+      FramesRead = (int64)sf_readf_double(
+        s_in, &NChunk[InputShift * p->Channels],
+        (sf_count_t)(NSpaceSamples - InputShift));
+        
+      //Report the zero padded frames as actual frames.
+      FramesRead += InputShift;
+        
+      //Input shift is no longer necessary.
+      InputShift = 0;
+    }
+    else
+    {
+      /*For some reason the input shift was really large, therefore we will
+      not even read from the file at all yet.*/
+      Memory::ClearArray(NChunk, NSpaceSamples * p->Channels);
+      
+      //Report the zero padded frames as actual frames.
+      FramesRead = InputShift;
+      
+      //Decrement the initial zero pad amount as it is used up.
+      InputShift -= NSpaceSamples;
+    }
+    
+    /*The length of a stream is only known once it runs out, and the output
+    goes on for the length of the filter after that (there is a single pass,
+    so there is no input shift).*/
+    if(p->Streaming && !InputEnded && FramesRead < NSpaceSamples)
+    {
+      InputEnded = true;
+      p->Frames = NSpaceStart + FramesRead;
+      p->CountOutputFrames();
+    }
+    
+    //Calculate the number of samples read.
+    int64 SamplesRead = FramesRead * p->Channels;
+    
+    //Zero out any portion that was not read.
+    Memory::ClearArray(&NChunk[SamplesRead],
+      NSpaceSamples * p->Channels - SamplesRead);
+    
+    /*The output of the pass starts at the output shift, and each chunk follows
+    on from the one before. Where the scratch is addressable, the chunk is
+    accumulated into it directly. Otherwise read in a block from the scratch.
+    Without a scratch, the output starts out from silence.*/
+    int64 ScratchPosition = PassOutputShift + PQSpaceStart;
+    float64* PQChunk = 0;
+    if(Accumulator)
+      PQChunk = Accumulator->Access(ScratchPosition, PQSpaceSamples);
+    if(!PQChunk)
+    {
+      PQChunk = Slot.PQBuffer;
+      int64 PQFramesRead = 0;
+      if(Accumulator)
+        PQFramesRead =
+          Accumulator->Read(ScratchPosition, PQChunk, PQSpaceSamples);
+      int64 PQSamplesRead = PQFramesRead * p->Channels;
+      
+      //Zero out any portion that was not read.
+      Memory::ClearArray(&PQChunk[PQSamplesRead],
+        PQSpaceSamples * p->Channels - PQSamplesRead);
+    }
+    
+    //Determine how much data to write.
+    int64 FramesUntilEnd = p->OutPQFrames - ScratchPosition;
+    if(p->Streaming && !InputEnded)
+      FramesUntilEnd = PQSpaceSamples + 1;
+    Last = (FramesUntilEnd <= PQSpaceSamples);
+    
+    Slot.NSpaceStart = NSpaceStart;
+    Slot.NSpaceSamples = NSpaceSamples;
+    Slot.PSpaceStart = PSpaceStart;
+    Slot.PQSpaceStart = PQSpaceStart;
+    Slot.PQChunk = PQChunk;
+    Slot.ScratchPosition = ScratchPosition;
+    Slot.WriteFrames = math::Min(PQSpaceSamples, FramesUntilEnd);
+    Slot.ReadPlace = (p->Streaming ? 0 : sf_seek(s_in, 0, SEEK_CUR));
+    Slot.Last = Last;
+    ReadSlots.Push(&Slot - Slots);
+    Previous = &Slot;
+  }
+}
+
+template <class Sample>
+void Renderer<Sample>::WriteChunks(void)
+{
+  bool Last = false;
+  while(!Last)
+  {
+    RenderSlot& Slot = Slots[FilteredSlots.Pop()];
+    Last = Slot.Last;
+    
+    //The output is finished once the final pass writes it.
+    if(Levels && FinalPass)
+      Levels->Measure(Slot.PQChunk, Slot.WriteFrames);
+    
+    /*Hand the finished output to the sink, or write PQ chunk block back to
+    the scratch, unless it was accumulated there.*/
+    if(Sink)
+      Sink->Write(Slot.PQChunk, Slot.WriteFrames);
+    else if(Slot.PQChunk == Slot.PQBuffer)
+      Accumulator->Write(Slot.ScratchPosition, Slot.PQChunk, Slot.WriteFrames);
+    FreeSlots.Push(&Slot - Slots);
+  }
+}
+
+template <class Sample>
+void Renderer<Sample>::FilterSlot(RenderSlot& Slot)
+{
+  //Split the chunk into its blocks of L.
+  int64 OverlapSamples = OverlapFrames * p->Channels;
+  for(int64 b = 0; b < p->Blocks; b++)
+  {
+    RenderChunk& Block = Blocks[b];
+    int64 BlockStart = Slot.PSpaceStart + b * p->L;
+    int64 BlockEnd = BlockStart + p->L - 1;
+    Block.NSpaceStart = (BlockStart + p->P - 1) / p->P;
+    Block.NSpaceEnd = BlockEnd / p->P;
+    Block.PSpaceStart = BlockStart;
+    Block.PQSpaceStart = (BlockStart + p->Q - 1) / p->Q;
+    Block.PQSpaceEnd = BlockEnd / p->Q;
+    Block.Index = BlockStart / p->L;
+    Block.NChunk =
+      &Slot.NChunk[(Block.NSpaceStart - Slot.NSpaceStart) * p->Channels];
+    Block.PQChunk =
+      &Slot.PQChunk[(Block.PQSpaceStart - Slot.PQSpaceStart) * p->Channels];
+    Block.Overlap = 0;
+    if(OverlapChunk)
+      Block.Overlap = &OverlapChunk[(b + 1) * OverlapSamples];
+  }
+  
+  /*A block sums its partitions with the spectra of the blocks before it, so
+  with a partitioned filter all the blocks of the chunk are transformed first.*/
+  if(p->Partitioned)
+  {
+    TransformingInputs = true;
+    FilterChunk();
+    TransformingInputs = false;
+  }
+  
+  /*Now work on each block and channel in the chunk, in parallel over the
+  workers, and add the overlaps of the blocks together in order.*/
+  FilterChunk();
+  if(OverlapChunk)
+    StitchOverlap();
+}
+
+template <class Sample>
+void Renderer<Sample>::FilterChunk(void)
+{
+  /*Deal out the tasks in contiguous ranges, so that each worker starts on
+  blocks and channels of its own. Then start the other workers and do the
+  first range here.*/
+  int64 Tasks = p->Blocks * ChannelBatches;
+  for(int64 i = 0; i < WorkerCount; i++)
+  {
+    Workers[i].NextTask = Tasks * i / WorkerCount;
+    Workers[i].EndTask = Tasks * (i + 1) / WorkerCount;
+  }
+  for(int64 i = 1; i < WorkerCount; i++)
+    Workers[i].notify();
+  FilterTasks(Workers[0]);
+  for(int64 i = 1; i < WorkerCount; i++)
+    Workers[i].Done.wait(-1);
+}
+
+template <class Sample>
+void Renderer<Sample>::FilterTasks(RenderWorker<Sample>& w)
+{
+  int64 Task;
+  while(NextTask(w, Task))
+    FilterTask(w, Task);
+}
+
+template <class Sample>
+bool Renderer<Sample>::NextTask(RenderWorker<Sample>& w, int64& Task)
+{
+  {
+    const juce::ScopedLock sl(w.TaskLock);
+    if(w.NextTask < w.EndTask)
+    {
+      Task = w.NextTask++;
+      return true;
+    }
+  }
+  
+  /*Look for tasks among the other workers, starting with the next one. Since
+  the victim keeps working from the front of its range, stealing from the back
+  leaves both with neighboring blocks.*/
+  int64 Self = &w - Workers;
+  for(int64 i = 1; i < WorkerCount; i++)
+  {
+    RenderWorker<Sample>& Victim = Workers[(Self + i) % WorkerCount];
+    int64 StolenStart, StolenEnd;
+    {
+      const juce::ScopedLock sl(Victim.TaskLock);
+      int64 Left = Victim.EndTask - Victim.NextTask;
+      if(Left <= 0)
+        continue;
+      StolenEnd = Victim.EndTask;
+      StolenStart = StolenEnd - (Left + 1) / 2;
+      Victim.EndTask = StolenStart;
+    }
+    
+    const juce::ScopedLock sl(w.TaskLock);
+    Task = StolenStart;
+    w.NextTask = StolenStart + 1;
+    w.EndTask = StolenEnd;
+    return true;
+  }
+  return false;
+}
+
+template <class Sample>
+void Renderer<Sample>::FilterTask(RenderWorker<Sample>& w, int64 Task)
+{
+  const RenderChunk& Block = Blocks[Task / ChannelBatches];
+  int64 FirstChannel = (Task % ChannelBatches) * p->ChannelBatch;
+  int64 Channels = math::Min(p->ChannelBatch, p->Channels - FirstChannel);
+  
+  //The FFT engines transform the whole batch of channels at once.
+  if(TransformingInputs)
+    TransformChannels(w, Block, FirstChannel, Channels);
+  else if(p->NonUniform)
+  {
+    int64 Frames = Block.NSpaceEnd - Block.NSpaceStart + 1;
+    for(int64 i = 0; i < Channels; i++)
+      Convolvers[FirstChannel + i].Process(&Block.NChunk[FirstChannel + i],
+        p->Channels, &Block.PQChunk[FirstChannel + i], p->Channels, Frames);
+  }
+  else if(p->Direct)
+  {
+    for(int64 i = 0; i < Channels; i++)
+      FilterChannelDirect(w, Block, FirstChannel + i);
+  }
+  else
+  {
+    //Pairs of channels first, then any channel left over.
+    int64 Paired = (p->Paired ? Channels / 2 * 2 : 0);
+    if(Paired && p->Polyphase)
+      FilterPairsPolyphase(w, Block, FirstChannel, Paired / 2);
+    else if(Paired)
+      FilterPairsZeroStuffed(w, Block, FirstChannel, Paired / 2);
+    
+    if(Paired == Channels)
+      return;
+    else if(p->Polyphase)
+      FilterChannelsPolyphase(w, Block, FirstChannel + Paired,
+        Channels - Paired);
+    else
+      FilterChannelsZeroStuffed(w, Block, FirstChannel + Paired,
+        Channels - Paired);
+  }
+}
+
+template <class Sample>
+void Renderer<Sample>::StitchOverlap(void)
+{
+  int64 Decimation = (p->Decimate ? p->Q : 1);
+  int64 Q_hop = p->Q / Decimation;
+  int64 ChannelHop = p->Channels;
+  int64 OverlapSamples = OverlapFrames * ChannelHop;
+  float64 NormalizeFactor = p->FFTSize * p->P;
+  
+  /*The tail before block b is in slot b of the overlap chunk, where slot 0 has
+  the tail of the last block of the previous chunk. Only the overlapped frames
+  that are kept after Q-decimation need to be mixed in.*/
+  for(int64 b = 0; b < p->Blocks; b++)
+  {
+    const RenderChunk& Block = Blocks[b];
+    float64* Overlap = &OverlapChunk[b * OverlapSamples];
+    float64* ptr_PQChunk = Block.PQChunk;
+    int64 PQIndex =
+      (Block.PQSpaceStart * p->Q - Block.PSpaceStart) / Decimation;
+    
+    //Without a hop the overlapped frames are contiguous, like the PQ chunk.
+    if(Q_hop == 1)
+    {
+      int64 Frames = math::Min(Block.PQSpaceEnd - Block.PQSpaceStart + 1,
+        OverlapFrames - PQIndex);
+      if(Frames > 0)
+        Kernel->AddScaled(ptr_PQChunk, &Overlap[PQIndex * ChannelHop],
+          Frames * ChannelHop, NormalizeFactor);
+      continue;
+    }
+    
+    for(int64 Frame = Block.PQSpaceStart;
+      Frame <= Block.PQSpaceEnd && PQIndex < OverlapFrames;
+      Frame++, PQIndex += Q_hop)
+    {
+      float64* ptr_Overlap = &Overlap[PQIndex * ChannelHop];
+      for(int64 Channel = 0; Channel < ChannelHop; Channel++)
+        ptr_PQChunk[Channel] += ptr_Overlap[Channel] * NormalizeFactor;
+      ptr_PQChunk += ChannelHop;
+    }
+  }
+  
+  //The tail of the last block overlaps the first block of the next chunk.
+  Memory::CopyArray(OverlapChunk, &OverlapChunk[p->Blocks * OverlapSamples],
+    OverlapSamples);
+}
+
+template <class Sample>
+void Renderer<Sample>::CreatePolyphaseFilterFFT(float64* Segment,
+  Sample* Spectrum)
+{
+  int64 P = p->P;
+  AudioFFTOf<Sample>& Filterer = FilterTransform();
+  int64 FFTer_N_Freq_2 = Filterer.N_Freq() * 2;
+  Sample* fft_time = Filterer.GetTimeDomain();
+  Sample* fft_freq = Filterer.GetFreqDomain();
+  
+  /*The input is transformed without normalization, so the 1 / N of the FFT and
+  the gain of P that makes up for the zeroes in P-space go into the filter.*/
+  Sample NormalizeFactor = (Sample)((float64)P / (float64)p->PolyphaseFFTSize);
+  
+  for(int64 Phase = 0; Phase < P; Phase++)
+  {
+    /*Phase k of the filter consists of every P-th tap starting at tap k. When
+    decimating, the sub-filter is rotated back by the phase offset so that the
+    kept outputs of the phase land on multiples of Q in the window.*/
+    int64 Offset = (PhaseOffsets ? PhaseOffsets[Phase] : 0);
+    int64 FFTSize = p->PolyphaseFFTSize;
+    Memory::ClearArray(fft_time, FFTer_N_Freq_2);
+    for(int64 i = Phase, j = 0; i < p->M; i += P, j++)
+      fft_time[(j - Offset + FFTSize) % FFTSize] = (Sample)Segment[i];
+    
+    Filterer.TimeToFreqUnnormalized();
+    Sample* PhaseFFT = &Spectrum[Phase * FFTer_N_Freq_2];
+    for(int64 i = 0; i < FFTer_N_Freq_2; i++)
+      PhaseFFT[i] = fft_freq[i] * NormalizeFactor;
+  }
+}
+
+template <class Sample>
+void Renderer<Sample>::CreateDirectFilter(float64* Segment)
+{
+  int64 P = p->P;
+  int64 PhaseM = p->PolyphaseM;
+  
+  /*Phase k consists of every P-th tap starting at tap k, stored back to front
+  so that each output frame is a forward dot product with the input window. The
+  gain of P makes up for the zeroes in P-space.*/
+  Memory::ClearArray(DirectTaps, P * PhaseM);
+  for(int64 Phase = 0; Phase < P; Phase++)
+  {
+    Sample* PhaseTaps = &DirectTaps[Phase * PhaseM];
+    for(int64 i = Phase, j = PhaseM - 1; i < p->M; i += P, j--)
+      PhaseTaps[j] = (Sample)(Segment[i] * (float64)P);
+  }
+}
+
+template <class Sample>
+void Renderer<Sample>::FilterChannelDirect(RenderWorker<Sample>& w,
+  const RenderChunk& Block, int64 Channel)
+{
+  int64 P = p->P;
+  int64 Q = p->Q;
+  int64 PhaseM = p->PolyphaseM;
+  int64 ChannelHop = p->Channels;
+  int64 HistoryFrames = PhaseM - 1;
+  int64 ChunkFrames = p->PolyphaseL;
+  Sample* DirectWindow = w.DirectWindow;
+  
+  /*Lay out the history and the block of the channel contiguously. The history
+  is the input right before the block, which precedes it in the N chunk.*/
+  Kernel->Gather(DirectWindow, 1,
+    &Block.NChunk[Channel - HistoryFrames * ChannelHop], ChannelHop,
+    HistoryFrames + ChunkFrames);
+  
+  /*Output frame j lies at P-space index jQ = aP + k, which is the dot product
+  of phase k with the PhaseM input frames ending at sample a.*/
+  float64* ptr_PQChunkChannel = &Block.PQChunk[Channel];
+  int64 PIndex = Block.PQSpaceStart * Q - Block.PSpaceStart;
+  for(int64 Frame = Block.PQSpaceStart; Frame <= Block.PQSpaceEnd;
+    Frame++, PIndex += Q)
+  {
+    *ptr_PQChunkChannel += DotProduct(&DirectTaps[(PIndex % P) * PhaseM],
+      &DirectWindow[PIndex / P], PhaseM);
+    ptr_PQChunkChannel += ChannelHop;
+  }
+}
+
+template <class Sample>
+void Renderer<Sample>::LoadPolyphaseWindow(Sample* Window, int64 Hop,
+  const RenderChunk& Block, int64 Channel)
+{
+  /*Build the N-space window out of the M - 1 frames before the block followed
+  by the block itself (overlap-save). These frames precede the block in the N
+  chunk, so blocks do not depend on each other.*/
+  int64 ChannelHop = p->Channels;
+  int64 HistoryFrames = p->PolyphaseM - 1;
+  Kernel->Gather(Window, Hop,
+    &Block.NChunk[Channel - HistoryFrames * ChannelHop], ChannelHop,
+    HistoryFrames + p->PolyphaseL);
+}
+
+template <class Sample>
+void Renderer<Sample>::LoadPolyphaseWindows(AudioFFTOf<Sample>& FFTer,
+  const RenderChunk& Block, int64 FirstChannel, int64 Channels)
+{
+  int64 WindowFrames = p->PolyphaseM - 1 + p->PolyphaseL;
+  int64 FFTer_N_Freq_2 = FFTer.N_Freq() * 2;
+  
+  for(int64 i = 0; i < Channels; i++)
+  {
+    Sample* fft_time = FFTer.GetTimeDomain((int)i);
+    LoadPolyphaseWindow(fft_time, 1, Block, FirstChannel + i);
+    Memory::ClearArray(&fft_time[WindowFrames], FFTer_N_Freq_2 - WindowFrames);
+  }
+}
+
+template <class Sample>
+void Renderer<Sample>::MixPolyphaseWindow(const RenderChunk& Block,
+  int64 Channel, int64 FirstFrame, const Sample* Window, int64 Hop)
+{
+  //Mix the valid (non-wrapped) part of the window into the PQ chunk.
+  int64 P = p->P;
+  int64 Q = p->Q;
+  int64 ChannelHop = p->Channels;
+  int64 Frames = Block.PQSpaceEnd - Block.PQSpaceStart + 1;
+  int64 PIndex = (Block.PQSpaceStart + FirstFrame) * Q - Block.PSpaceStart;
+  int64 WindowIndex = PIndex / P + p->PolyphaseM - 1;
+  int64 WindowHop = Q;
+  if(p->Decimate)
+  {
+    WindowIndex = (WindowIndex - PhaseOffsets[PIndex % P]) / Q;
+    WindowHop = 1;
+  }
+  
+  Kernel->ScatterAdd(&Block.PQChunk[FirstFrame * ChannelHop + Channel],
+    P * ChannelHop, &Window[WindowIndex * Hop], WindowHop * Hop,
+    (Frames - FirstFrame + P - 1) / P, 1.0);
+}
+
+template <class Sample>
+void Renderer<Sample>::FilterChannelsPolyphase(RenderWorker<Sample>& w,
+  const RenderChunk& Block, int64 FirstChannel, int64 Channels)
+{
+  int64 P = p->P;
+  int64 Q = p->Q;
+  AudioFFTOf<Sample>& FFTer = w.FFTer;
+  AudioFFTOf<Sample>& DecimatedFFTer = w.DecimatedFFTer;
+  Sample* InputFFT = w.InputFFT;
+  int64 FFTer_N_Freq_2 = FFTer.N_Freq() * 2;
+  
+  /*Every phase shares the same transforms of the input windows, which are
+  already in InputSpectra when the filter is partitioned.*/
+  if(!p->Partitioned)
+  {
+    LoadPolyphaseWindows(FFTer, Block, FirstChannel, Channels);
+    FFTer.TimeToFreqUnnormalized();
+    Memory::CopyArray(InputFFT, FFTer.GetFreqDomain(),
+      FFTer_N_Freq_2 * Channels);
+  }
+  
+  /*Output frame j lies at P-space index jQ = aP + k, which is sample a of the
+  input convolved with phase k. Since consecutive output frames cycle through
+  the phases, the first P frames determine the phases that are needed, and the
+  frames P apart from each of them use the same phase.*/
+  int64 Frames = Block.PQSpaceEnd - Block.PQSpaceStart + 1;
+  int64 FirstFrames = math::Min(P, Frames);
+  for(int64 FirstFrame = 0; FirstFrame < FirstFrames; FirstFrame++)
+  {
+    int64 PIndex = (Block.PQSpaceStart + FirstFrame) * Q - Block.PSpaceStart;
+    int64 Phase = PIndex % P;
+    Sample* PhaseFFT = &FilterFFT[Phase * FFTer_N_Freq_2];
+    
+    /*Apply the phase to every channel in the frequency domain while it is in
+    cache, and transform them back together. The frames of this phase are Q
+    apart in the window, so when decimating only those are computed by the
+    folded transform.*/
+    for(int64 i = 0; i < Channels; i++)
+    {
+      if(p->Partitioned)
+      {
+        Sample* fft_freq = FFTer.GetFreqDomain((int)i);
+        AccumulatePartitions(fft_freq, Block, FirstChannel + i, Phase);
+        if(p->Decimate)
+          FoldSpectrum(DecimatedFFTer.GetFreqDomain((int)i), fft_freq,
+            p->PolyphaseFFTSize, Q);
+      }
+      else if(p->Decimate)
+        MultiplyAndFoldSpectrum(DecimatedFFTer.GetFreqDomain((int)i),
+          &InputFFT[i * FFTer_N_Freq_2], PhaseFFT, p->PolyphaseFFTSize, Q);
+      else
+        Kernel->MultiplySpectrum(FFTer.GetFreqDomain((int)i),
+          &InputFFT[i * FFTer_N_Freq_2], PhaseFFT, FFTer.N_Freq());
+    }
+    if(p->Decimate)
+      DecimatedFFTer.FreqToTime();
+    else
+      FFTer.FreqToTime();
+    
+    for(int64 i = 0; i < Channels; i++)
+      MixPolyphaseWindow(Block, FirstChannel + i, FirstFrame, (p->Decimate ?
+        DecimatedFFTer.GetTimeDomain((int)i) : FFTer.GetTimeDomain((int)i)), 1);
+  }
+}
+
+template <class Sample>
+void Renderer<Sample>::FilterPairsPolyphase(RenderWorker<Sample>& w,
+  const RenderChunk& Block, int64 FirstChannel, int64 Pairs)
+{
+  int64 P = p->P;
+  int64 Q = p->Q;
+  int64 N = p->PolyphaseFFTSize;
+  ComplexFFTOf<Sample>& PairFFTer = w.PairFFTer;
+  ComplexFFTOf<Sample>& PairDecimatedFFTer = w.PairDecimatedFFTer;
+  ComplexFFTOf<Sample>& Inverse =
+    (p->Decimate ? PairDecimatedFFTer : PairFFTer);
+  Sample* InputFFT = w.InputFFT;
+  
+  //Lay out the windows of each pair as the real and imaginary parts.
+  for(int64 i = 0; i < Pairs; i++)
+  {
+    Sample* Pair = PairFFTer.GetData((int)i);
+    Memory::ClearArray(Pair, N * 2);
+    LoadPolyphaseWindow(Pair, 2, Block, FirstChannel + i * 2);
+    LoadPolyphaseWindow(&Pair[1], 2, Block, FirstChannel + i * 2 + 1);
+  }
+  PairFFTer.TimeToFreqUnnormalized();
+  Memory::CopyArray(InputFFT, PairFFTer.GetData(), N * 2 * Pairs);
+  
+  /*Apply the phases as in FilterChannelsPolyphase. The output of the first
+  channel of each pair comes out in the real parts, and that of the second in
+  the imaginary parts.*/
+  int64 Frames = Block.PQSpaceEnd - Block.PQSpaceStart + 1;
+  int64 FirstFrames = math::Min(P, Frames);
+  for(int64 FirstFrame = 0; FirstFrame < FirstFrames; FirstFrame++)
+  {
+    int64 PIndex = (Block.PQSpaceStart + FirstFrame) * Q - Block.PSpaceStart;
+    Sample* PhaseFFT = &FilterFFT[(PIndex % P) * SpectrumSize];
+    for(int64 i = 0; i < Pairs; i++)
+    {
+      Sample* Spectrum = PairFFTer.GetData((int)i);
+      MultiplyPairSpectrum(*Kernel, Spectrum, &InputFFT[i * N * 2], PhaseFFT,
+        N, false);
+      if(p->Decimate)
+        FoldPairSpectrum(PairDecimatedFFTer.GetData((int)i), Spectrum, N, Q);
+    }
+    Inverse.FreqToTime();
+    
+    for(int64 i = 0; i < Pairs; i++)
+    {
+      Sample* Pair = Inverse.GetData((int)i);
+      MixPolyphaseWindow(Block, FirstChannel + i * 2, FirstFrame, Pair, 2);
+      MixPolyphaseWindow(Block, FirstChannel + i * 2 + 1, FirstFrame,
+        &Pair[1], 2);
+    }
+  }
+}
+
+template <class Sample>
+void Renderer<Sample>::LoadZeroStuffedChunk(Sample* Window, int64 Hop,
+  const RenderChunk& Block, int64 Channel)
+{
+  /*Initialize the P chunk of the channel with all the values from NChunk,
+  straight in the FFT time domain. In p-space we are interleaving P zeroes in
+  between each actual sample point. A zero-phase filter is ahead by its group
+  delay, so the input is placed that much later to make up for it.*/
+  int64 PIndexStart = Block.NSpaceStart * p->P - Block.PSpaceStart +
+    p->GroupDelay;
+  int64 PFrames = Block.NSpaceEnd - Block.NSpaceStart + 1;
+  Kernel->Gather(&Window[PIndexStart * Hop], p->P * Hop,
+    &Block.NChunk[Channel], p->Channels, PFrames);
+}
+
+template <class Sample>
+void Renderer<Sample>::LoadZeroStuffedChunks(AudioFFTOf<Sample>& FFTer,
+  const RenderChunk& Block, int64 FirstChannel, int64 Channels)
+{
+  //Everything else, including the padding starting at L, is cleared.
+  int64 FFTer_N_Freq_2 = FFTer.N_Freq() * 2;
+  for(int64 i = 0; i < Channels; i++)
+  {
+    Sample* fft_time = FFTer.GetTimeDomain((int)i);
+    Memory::ClearArray(fft_time, FFTer_N_Freq_2);
+    LoadZeroStuffedChunk(fft_time, 1, Block, FirstChannel + i);
+  }
+}
+
+template <class Sample>
+void Renderer<Sample>::MixZeroStuffedOutput(const RenderChunk& Block,
+  int64 Channel, const Sample* Output, int64 Hop)
+{
+  int64 ChannelHop = p->Channels;
+  int64 Decimation = (p->Decimate ? p->Q : 1);
+  
+  /*Keep the tail of the block as its new overlap data. It is added to the
+  next block once the blocks before it are done (see StitchOverlap).*/
+  Kernel->Scatter(&Block.Overlap[Channel], ChannelHop,
+    &Output[p->L / Decimation * Hop], Hop, OverlapFrames);
+  
+  //Mix Q-decimated FFT time domain into current PQ chunk.
+  int64 Q_hop = p->Q / Decimation;
+  int64 PQIndexStart =
+    (Block.PQSpaceStart * p->Q - Block.PSpaceStart) / Decimation;
+  int64 PQFrames = Block.PQSpaceEnd - Block.PQSpaceStart + 1;
+  float64 NormalizeFactor = p->FFTSize * p->P;
+  Kernel->ScatterAdd(&Block.PQChunk[Channel], ChannelHop,
+    &Output[PQIndexStart * Hop], Q_hop * Hop, PQFrames, NormalizeFactor);
+}
+
+template <class Sample>
+void Renderer<Sample>::FilterChannelsZeroStuffed(RenderWorker<Sample>& w,
+  const RenderChunk& Block, int64 FirstChannel, int64 Channels)
+{
+  AudioFFTOf<Sample>& FFTer = w.FFTer;
+  AudioFFTOf<Sample>& DecimatedFFTer = w.DecimatedFFTer;
+  
+  /*Convert the P chunks into the frequency domain, unless they are already in
+  InputSpectra.*/
+  if(!p->Partitioned)
+  {
+    LoadZeroStuffedChunks(FFTer, Block, FirstChannel, Channels);
+    FFTer.TimeToFreq();
+  }
+  
+  /*Apply filter in frequency domain through complex multiplication, and
+  transform back to the time domain. The filter is applied to all the channels
+  a block of bins at a time so that it stays in cache. When decimating, the
+  product is folded so that only the samples kept after Q-decimation are
+  computed.*/
+  if(p->Decimate)
+  {
+    for(int64 i = 0; i < Channels; i++)
+    {
+      Sample* fft_freq = FFTer.GetFreqDomain((int)i);
+      if(p->Partitioned)
+      {
+        AccumulatePartitions(fft_freq, Block, FirstChannel + i, 0);
+        FoldSpectrum(DecimatedFFTer.GetFreqDomain((int)i), fft_freq,
+          p->FFTSize, p->Q);
+      }
+      else if(p->ZeroPhase)
+      {
+        Kernel->MultiplyRealSpectrum(fft_freq, fft_freq, FilterFFT,
+          FFTer.N_Freq());
+        FoldSpectrum(DecimatedFFTer.GetFreqDomain((int)i), fft_freq,
+          p->FFTSize, p->Q);
+      }
+      else
+        MultiplyAndFoldSpectrum(DecimatedFFTer.GetFreqDomain((int)i),
+          fft_freq, FilterFFT, p->FFTSize, p->Q);
+    }
+    DecimatedFFTer.FreqToTime();
+  }
+  else if(p->Partitioned)
+  {
+    for(int64 i = 0; i < Channels; i++)
+      AccumulatePartitions(FFTer.GetFreqDomain((int)i), Block,
+        FirstChannel + i, 0);
+    FFTer.FreqToTime();
+  }
+  else
+  {
+    int64 Bins = FFTer.N_Freq();
+    int64 BlockBins = 1024;
+    for(int64 Bin = 0; Bin < Bins; Bin += BlockBins)
+    {
+      int64 BinCount = math::Min(BlockBins, Bins - Bin);
+      for(int64 i = 0; i < Channels; i++)
+      {
+        Sample* fft_freq = &FFTer.GetFreqDomain((int)i)[Bin * 2];
+        if(p->ZeroPhase)
+          Kernel->MultiplyRealSpectrum(fft_freq, fft_freq, &FilterFFT[Bin],
+            BinCount);
+        else
+          Kernel->MultiplySpectrum(fft_freq, fft_freq, &FilterFFT[Bin * 2],
+            BinCount);
+      }
+    }
+    FFTer.FreqToTime();
+  }
+  
+  for(int64 i = 0; i < Channels; i++)
+    MixZeroStuffedOutput(Block, FirstChannel + i, (p->Decimate ?
+      DecimatedFFTer.GetTimeDomain((int)i) : FFTer.GetTimeDomain((int)i)), 1);
 }
 
-void Renderer::Go(SNDFILE* s_in, SNDFILE* s_scratch)
+template <class Sample>
+void Renderer<Sample>::FilterPairsZeroStuffed(RenderWorker<Sample>& w,
+  const RenderChunk& Block, int64 FirstChannel, int64 Pairs)
+{
+  int64 N = p->FFTSize;
+  ComplexFFTOf<Sample>& PairFFTer = w.PairFFTer;
+  ComplexFFTOf<Sample>& PairDecimatedFFTer = w.PairDecimatedFFTer;
+  ComplexFFTOf<Sample>& Inverse =
+    (p->Decimate ? PairDecimatedFFTer : PairFFTer);
+  
+  //Zero-stuff the channels of each pair into the real and imaginary parts.
+  for(int64 i = 0; i < Pairs; i++)
+  {
+    Sample* Pair = PairFFTer.GetData((int)i);
+    Memory::ClearArray(Pair, N * 2);
+    LoadZeroStuffedChunk(Pair, 2, Block, FirstChannel + i * 2);
+    LoadZeroStuffedChunk(&Pair[1], 2, Block, FirstChannel + i * 2 + 1);
+  }
+  PairFFTer.TimeToFreq();
+  
+  /*Apply the filter to each pair as in FilterChannelsZeroStuffed. The output
+  of the first channel comes out in the real parts, and that of the second in
+  the imaginary parts.*/
+  for(int64 i = 0; i < Pairs; i++)
+  {
+    Sample* Spectrum = PairFFTer.GetData((int)i);
+    MultiplyPairSpectrum(*Kernel, Spectrum, Spectrum, FilterFFT, N,
+      p->ZeroPhase);
+    if(p->Decimate)
+      FoldPairSpectrum(PairDecimatedFFTer.GetData((int)i), Spectrum, N, p->Q);
+  }
+  Inverse.FreqToTime();
+  
+  for(int64 i = 0; i < Pairs; i++)
+  {
+    Sample* Pair = Inverse.GetData((int)i);
+    MixZeroStuffedOutput(Block, FirstChannel + i * 2, Pair, 2);
+    MixZeroStuffedOutput(Block, FirstChannel + i * 2 + 1, &Pair[1], 2);
+  }
+}
+
+template <class Sample>
+Sample* Renderer<Sample>::InputSpectrum(int64 Index, int64 Channel)
+{
+  return &InputSpectra[((Index % SpectraBlocks) * p->Channels + Channel) *
+    SpectrumSize];
+}
+
+template <class Sample>
+void Renderer<Sample>::TransformChannels(RenderWorker<Sample>& w,
+  const RenderChunk& Block, int64 FirstChannel, int64 Channels)
+{
+  //The blocks are transformed just as they are without partitions.
+  AudioFFTOf<Sample>& FFTer = w.FFTer;
+  if(p->Polyphase)
+  {
+    LoadPolyphaseWindows(FFTer, Block, FirstChannel, Channels);
+    FFTer.TimeToFreqUnnormalized();
+  }
+  else
+  {
+    LoadZeroStuffedChunks(FFTer, Block, FirstChannel, Channels);
+    FFTer.TimeToFreq();
+  }
+  
+  //The channels of the batch are next to each other in InputSpectra.
+  Memory::CopyArray(InputSpectrum(Block.Index, FirstChannel),
+    FFTer.GetFreqDomain(), SpectrumSize * Channels);
+}
+
+template <class Sample>
+void Renderer<Sample>::AccumulatePartitions(Sample* Destination,
+  const RenderChunk& Block, int64 Channel, int64 Phase)
+{
+  /*Partition s of the filter applies to the block s blocks back. The blocks
+  before the start of the pass are silent, so they are left out.*/
+  int64 Bins = SpectrumSize / 2;
+  int64 Phases = (p->Polyphase ? p->P : 1);
+  int64 Partitions = math::Min(p->Partitions, Block.Index + 1);
+  for(int64 s = 0; s < Partitions; s++)
+  {
+    const Sample* Input = InputSpectrum(Block.Index - s, Channel);
+    const Sample* Partition = &FilterFFT[(s * Phases + Phase) * SpectrumSize];
+    if(s == 0)
+      Kernel->MultiplySpectrum(Destination, Input, Partition, Bins);
+    else
+      Kernel->MultiplyAccumulateSpectrum(Destination, Input, Partition, Bins);
+  }
+}
+
+template <class Sample>
+bool Renderer<Sample>::Go(SNDFILE* s_in, Scratch* s_scratch,
+  RenderSink* s_sink, RenderLevels* s_levels)
 {
   Console c;
   
   //Allocate arrays.
-  FilterFFT = new float64[FFTer.N_Freq() * 2];
+  int64 FilterPhases = (p->Polyphase ? p->P : 1);
+  int64 FilterSpectra = FilterPhases * p->Partitions;
+  int64 FilterSize = p->P * p->PolyphaseM;
+  if(!p->Direct && !p->NonUniform)
+  {
+    int64 FFTSize = (p->Polyphase ? p->PolyphaseFFTSize : p->FFTSize);
+    SpectrumSize = (FFTSize / 2 + 1) * 2;
+    int64 FilterSpectrumSize = (p->ZeroPhase ? SpectrumSize / 2 :
+      SpectrumSize);
+    FilterSize = FilterSpectrumSize * FilterSpectra;
+  }
   
-  int64 NChunkFramesMax = p->L / p->P + 1;
-  int64 NChunkSamplesMax = NChunkFramesMax * p->Channels;
-  float64* NChunk = new float64[NChunkSamplesMax];
+  /*A filter applied in one pass is the same for every render of the same
+  design, so when the filter cache is on, only the first of them makes it. It
+  may also have been stored by an earlier run.*/
+  String FilterKey;
+  int64 FilterBytes = 0;
+  if(FilterCache::IsOn() && KaiserLPF && p->S == 1 &&
+    !p->ExportFilterFilename)
+  {
+    FilterKey = p->FilterKey();
+    FilterBytes = FilterSize * (int64)sizeof(Sample);
+    SharedFilter = (Sample*)FilterCache::Acquire(FilterKey, FilterBytes);
+  }
+  if(!p->Direct && !p->NonUniform)
+    FilterFFT = (SharedFilter ? SharedFilter : new Sample[FilterSize]);
   
-  float64* PChunk = new float64[p->L];
+  /*A partitioned filter keeps the spectra of the blocks that its partitions
+  still apply to: those of the chunk being filtered and of the blocks that
+  precede them.*/
+  if(p->Partitioned)
+  {
+    SpectraBlocks = p->Partitions + p->Blocks - 1;
+    InputSpectra = new Sample[SpectraBlocks * p->Channels * SpectrumSize];
+  }
+  
+  /*The polyphase and direct filters need the whole filter segment apart from
+  the FFT, as well as the history of the N-space input. The history is kept
+  right before the N chunk, so that every block of the chunk finds its history
+  in front of it.*/
+  bool Phased = p->Polyphase || p->Direct;
+  int64 HistoryFrames = (Phased ? p->PolyphaseM - 1 : 0);
+  HistorySamples = HistoryFrames * p->Channels;
+  ChunkL = p->L * p->Blocks;
+  float64* FilterSegment = 0;
+  if(Phased)
+    FilterSegment = new float64[p->M];
+  
+  /*When decimating, the overlap is kept Q-decimated as well: it is the tail of
+  the decimated window after the L / Q frames of the block. Each block keeps a
+  tail of its own until the overlaps are stitched together in order.*/
+  OverlapFrames = p->M_1;
+  if(p->Decimate && !p->Polyphase)
+    OverlapFrames = p->DecimatedFFTSize - p->L / p->Q;
+  int64 OverlapSamples = OverlapFrames * p->Channels;
+  if(!Phased && !p->NonUniform)
+    OverlapChunk = new float64[(p->Blocks + 1) * OverlapSamples];
+  
+  Blocks = new RenderChunk[p->Blocks];
+  ChannelBatches = (p->Channels + p->ChannelBatch - 1) / p->ChannelBatch;
+  
+  for(int64 i = 0; i < WorkerCount; i++)
+  {
+    RenderWorker<Sample>& w = Workers[i];
+    if(p->Direct)
+      w.DirectWindow = new Sample[HistoryFrames + p->PolyphaseL];
+    else if(p->Polyphase && !p->Partitioned)
+      w.InputFFT = new Sample[SpectrumSize * p->ChannelBatch];
+  }
   
-  int64 PQChunkFramesMax = p->L / p->Q + 1;
+  if(p->Direct)
+    DirectTaps = (SharedFilter ? SharedFilter : new Sample[FilterSize]);
+  else if(p->Polyphase)
+  {
+    /*With chunks a multiple of Q long, output frame j at P-space index jQ = aP
+    + k always sits at window index a + PolyphaseM - 1 (modulo Q), which only
+    depends on its phase k. The first P output frames cover every phase.*/
+    if(p->Decimate)
+    {
+      PhaseOffsets = new int64[p->P];
+      Memory::ClearArray(PhaseOffsets, p->P);
+      for(int64 j = 0; j < p->P; j++)
+      {
+        int64 PIndex = j * p->Q;
+        PhaseOffsets[PIndex % p->P] =
+          (PIndex / p->P + p->PolyphaseM - 1) % p->Q;
+      }
+    }
+  }
+  
+  /*Each chunk in flight has input and PQ chunks of its own, so that the next
+  chunk can be read and the previous one written while this one is filtered.*/
+  int64 NChunkFramesMax = ChunkL / p->P + 1;
+  int64 NChunkSamplesMax = NChunkFramesMax * p->Channels;
+  int64 PQChunkFramesMax = ChunkL / p->Q + 1;
   int64 PQChunkSamplesMax = PQChunkFramesMax * p->Channels;
-  float64* PQChunk = new float64[PQChunkSamplesMax];
+  SlotCount = p->Slots;
+  Slots = new RenderSlot[SlotCount];
+  for(int64 i = 0; i < SlotCount; i++)
+  {
+    RenderSlot& Slot = Slots[i];
+    Slot.InputChunk = new float64[HistorySamples + NChunkSamplesMax];
+    Slot.NChunk = &Slot.InputChunk[HistorySamples];
+    Slot.PQBuffer = new float64[PQChunkSamplesMax];
+  }
+  InputFile = s_in;
+  Accumulator = s_scratch;
+  Sink = s_sink;
+  Levels = s_levels;
+  Reader.r = this;
+  Writer.r = this;
+  Writer.Writes = true;
   
-  float64* OverlapChunk = new float64[p->M_1 * p->Channels];
+  //Start the workers that run on their own threads.
+  for(int64 i = 1; i < WorkerCount; i++)
+    Workers[i].startThread();
   
   //For plotting the filter.
   bool DoFilterPlot = p->ExportFilterFilename;
@@ -84,10 +1330,26 @@ void Renderer::Go(SNDFILE* s_in, SNDFILE* s_scratch)
   if(DoFilterPlot)
   {
     PlotFFTSize = (int64)pow(2.0,
-      ceil(log((float64)(p->M * p->S)) / log(2.)));
+      ceil(log((float64)(p->M * p->Partitions * p->S)) / log(2.)));
     PlotFFTData = new float64[PlotFFTSize];
   }
   
+  //The convolvers have the response already, so it is only read for the plot.
+  if(Convolvers)
+  {
+    if(DoFilterPlot)
+    {
+      Memory::ClearArray(PlotFFTData, PlotFFTSize);
+      sf_seek(p->ConvolveHandle, 0, SEEK_SET);
+      sf_readf_double(p->ConvolveHandle, PlotFFTData, (sf_count_t)p->idealM);
+    }
+    sf_close(p->ConvolveHandle);
+  }
+  
+  /*A pass that fails stops the render, but the workers, the arrays and the
+  shared filter are still cleaned up below.*/
+  bool Failed = false;
+  
   //Go through the Kaiser LPF in chunks (can be 1 chunk).
   for(int64 Pass = 0; Pass < p->S; Pass++)
   {
@@ -97,54 +1359,124 @@ void Renderer::Go(SNDFILE* s_in, SNDFILE* s_scratch)
     GlobalWorkInfo::setTotalPasses(p->S);
     GlobalWorkInfo::setPercentComplete(0);
     
-    //Get rid of the bogus stuff leftover in the overlap chunk.
-    Memory::ClearArray(OverlapChunk, p->M_1 * p->Channels);
+    /*Get rid of the bogus stuff leftover in the overlap chunk (the reader
+    starts the history of each pass from silence).*/
+    if(OverlapChunk)
+      Memory::ClearArray(OverlapChunk, OverlapSamples);
     
-    //Retrieve the filter.
-    if(KaiserLPF)
-    {
-      //Create the Kaiser chunk for this pass.
-      int64 KaiserSectionWidth = p->M;
-      int64 KaiserSectionStart = Pass * KaiserSectionWidth;
-      KaiserLPF->CreateLPFInPlace(FFTer.GetTimeDomain(), KaiserSectionStart,
-        KaiserSectionWidth);
-      Memory::ClearArray(&FFTer.GetTimeDomain()[KaiserSectionWidth],
-        p->FFTSize - KaiserSectionWidth);
-    }
-    else
+    /*Retrieve the filter, one partition at a time (usually just the one). The
+    convolvers already have theirs.*/
+    AudioFFTOf<Sample>& Filterer = FilterTransform();
+    int64 FilterPartitions = (Convolvers || SharedFilter ? 0 : p->Partitions);
+    for(int64 Partition = 0; Partition < FilterPartitions; Partition++)
     {
-      /*We are convolving with a file instead of using an LPF because the
-      --convolve setting was used. Note only mono IR is supported right now.
-      Need to figure out what channel combinations are possible (i.e. what do
-      you do if stereo impulse response is convolved on quad file, and is this
-      even allowed. Certainly if the number of channels matches then it should
-      be legal. Also, we need to create an array of FilterFFTs that the channel
-      loop will iterate over, but only in the case of convolution.*/
-      int64 ConvolveSectionWidth = p->M;
-      int64 ConvolveSectionStart = Pass * ConvolveSectionWidth;
-      sf_seek(p->ConvolveHandle, ConvolveSectionStart, SEEK_SET);
-      sf_readf_double(p->ConvolveHandle, FFTer.GetTimeDomain(),
-        (sf_count_t)ConvolveSectionWidth);
-      Memory::ClearArray(&FFTer.GetTimeDomain()[ConvolveSectionWidth],
-        p->FFTSize - ConvolveSectionWidth);
-        
-      //Close file on last pass since we are done with it.
-      if(Pass == p->S - 1)
-        sf_close(p->ConvolveHandle);
+      int64 Segment = Pass * p->Partitions + Partition;
+      Sample* Spectrum = &FilterFFT[Partition * FilterPhases * SpectrumSize];
+      if(KaiserLPF && Phased)
+      {
+        //Create the Kaiser chunk for this pass apart from the FFT.
+        int64 KaiserSectionWidth = p->M;
+        int64 KaiserSectionStart = Segment * KaiserSectionWidth;
+        KaiserLPF->CreateLPFInPlace(FilterSegment, KaiserSectionStart,
+          KaiserSectionWidth);
+      }
+      else if(KaiserLPF && p->ZeroPhase)
+      {
+        /*Centre the filter on the first sample, wrapping the taps before the
+        middle around to the end of the transform.*/
+        int64 Middle = p->GroupDelay;
+        Sample* fft_time = Filterer.GetTimeDomain();
+        KaiserLPF->CreateLPFInPlace(fft_time, Middle, p->M - Middle);
+        Memory::ClearArray(&fft_time[p->M - Middle], p->FFTSize - p->M);
+        KaiserLPF->CreateLPFInPlace(&fft_time[p->FFTSize - Middle], 0,
+          Middle);
+      }
+      else if(KaiserLPF)
+      {
+        //Create the Kaiser chunk for this pass.
+        int64 KaiserSectionWidth = p->M;
+        int64 KaiserSectionStart = Segment * KaiserSectionWidth;
+        KaiserLPF->CreateLPFInPlace(Filterer.GetTimeDomain(),
+          KaiserSectionStart, KaiserSectionWidth);
+        Memory::ClearArray(&Filterer.GetTimeDomain()[KaiserSectionWidth],
+          p->FFTSize - KaiserSectionWidth);
+      }
+      else
+      {
+        /*We are convolving with a file instead of using an LPF because the
+        --convolve setting was used. Note only mono IR is supported right now.
+        Need to figure out what channel combinations are possible (i.e. what
+        do you do if stereo impulse response is convolved on quad file, and is
+        this even allowed. Certainly if the number of channels matches then it
+        should be legal. Also, we need to create an array of FilterFFTs that
+        the channel loop will iterate over, but only in the case of
+        convolution. The last segment may run past the end of the file.*/
+        int64 ConvolveSectionWidth = p->M;
+        int64 ConvolveSectionStart = Segment * ConvolveSectionWidth;
+        sf_seek(p->ConvolveHandle, ConvolveSectionStart, SEEK_SET);
+        int64 ConvolveFramesRead = (int64)ReadFrames(p->ConvolveHandle,
+          Filterer.GetTimeDomain(), (sf_count_t)ConvolveSectionWidth);
+        ConvolveFramesRead = math::Max(ConvolveFramesRead, (int64)0);
+        Memory::ClearArray(&Filterer.GetTimeDomain()[ConvolveFramesRead],
+          p->FFTSize - ConvolveFramesRead);
+          
+        //Close file on last segment since we are done with it.
+        if(Segment == p->S * p->Partitions - 1)
+          sf_close(p->ConvolveHandle);
+      }
+      
+      //Copy in the data for the plot.
+      if(DoFilterPlot && Phased)
+        Memory::CopyArray(&PlotFFTData[Segment * p->M], FilterSegment, p->M);
+      else if(DoFilterPlot && p->ZeroPhase)
+      {
+        int64 Middle = p->GroupDelay;
+        ConvertArray(PlotFFTData,
+          &Filterer.GetTimeDomain()[p->FFTSize - Middle], Middle);
+        ConvertArray(&PlotFFTData[Middle], Filterer.GetTimeDomain(),
+          p->M - Middle);
+      }
+      else if(DoFilterPlot)
+        ConvertArray(&PlotFFTData[Segment * p->M], Filterer.GetTimeDomain(),
+          p->M);
+      
+      //Do the FFT of the filter so that it can be saved for later.
+      if(p->Direct)
+        CreateDirectFilter(FilterSegment);
+      else if(p->Polyphase)
+        CreatePolyphaseFilterFFT(FilterSegment, Spectrum);
+      else if(p->ZeroPhase)
+      {
+        //The imaginary parts are zero, save for rounding.
+        Filterer.TimeToFreq();
+        for(int64 j = 0; j < Filterer.N_Freq(); j++)
+          Spectrum[j] = Filterer.FreqReal(j);
+      }
+      else
+      {
+        Filterer.TimeToFreq();
+        int64 FFTer_N_Freq_2 = Filterer.N_Freq() * 2;
+        for(int64 i = 0, j = 0; i < FFTer_N_Freq_2; i += 2, j++)
+        {
+          Spectrum[i] = Filterer.FreqReal(j);
+          Spectrum[i + 1] = Filterer.FreqImag(j);
+        }
+      }
     }
     
-    //Copy in the data for the plot.
-    if(DoFilterPlot)
-      Memory::CopyArray(&PlotFFTData[Pass * p->M],
-        FFTer.GetTimeDomain(), p->M);
-    
-    //Do the FFT of the filter so that it can be saved for later.
-    FFTer.TimeToFreq();
-    int64 FFTer_N_Freq_2 = FFTer.N_Freq() * 2;
-    for(int64 i = 0, j = 0; i < FFTer_N_Freq_2; i += 2, j++)
+    /*Keep the finished filter for the other renders, using the kept copy, and
+    store it for later runs.*/
+    if(FilterBytes && !SharedFilter)
     {
-      FilterFFT[i] = FFTer.FreqReal(j);
-      FilterFFT[i + 1] = FFTer.FreqImag(j);
+      Sample*& Filter = (p->Direct ? DirectTaps : FilterFFT);
+      if(FilterCache::Enabled)
+      {
+        SharedFilter = (Sample*)FilterCache::Share(FilterKey, Filter,
+          FilterBytes);
+        delete [] Filter;
+        Filter = SharedFilter;
+      }
+      FilterCache::Store(FilterKey, Filter, FilterBytes);
     }
     
     /*Solve the pass delay problem (find a set of input and output shifts, that
@@ -212,7 +1544,8 @@ void Renderer::Go(SNDFILE* s_in, SNDFILE* s_scratch)
     {
       //Stop -- this should not happen!
       c += "There was a problem determining the input delay.";
-      return;
+      Failed = true;
+      break;
     }
 
     //Calculate input and output shifts.
@@ -223,229 +1556,145 @@ void Renderer::Go(SNDFILE* s_in, SNDFILE* s_scratch)
     {
       //Stop -- this should not happen!
       c += "There was a problem determining the output delay.";
-      return;
+      Failed = true;
+      break;
     }
     OutputShift /= Q;
     c += "OutputShift: "; c &= OutputShift;
     
     //The pass delay problem is solved!
         
-    //Initialize disk read and write heads.
-    sf_seek(s_scratch, OutputShift, SEEK_SET | SFM_READ);
-    sf_seek(s_scratch, OutputShift, SEEK_SET | SFM_WRITE);
-    sf_seek(s_in, 0, SEEK_SET);
-    
-    //Loop through horizontal blocks of size L in the P-space input.
-    int64 PSpaceInitial = 0;
-    int64 PSpaceSamples = p->L;
-    int64 NSpaceStart;
-    int64 PSpaceStart = PSpaceInitial;
-    do
+    /*Read ahead and write behind on threads of their own, so that the disks
+    are kept busy while the chunks are filtered here. All the slots start out
+    free for the reader.*/
+    PassInputShift = InputShift;
+    PassOutputShift = OutputShift;
+    FinalPass = (Pass == p->S - 1);
+    if(Pass > 0)
+      sf_seek(s_in, 0, SEEK_SET);
+    FreeSlots.Initialize(SlotCount);
+    ReadSlots.Initialize(SlotCount);
+    FilteredSlots.Initialize(SlotCount);
+    for(int64 i = 0; i < SlotCount; i++)
+      FreeSlots.Push(i);
+    Reader.startThread();
+    Writer.startThread();
+    
+    //Filter the chunks in the order they are read, and pass them on to write.
+    bool Last = false;
+    while(!Last)
     {
-      //Make calculations for translating from N space to P space.
-      int64 PSpaceEnd = PSpaceStart + PSpaceSamples - 1;
-      if(PSpaceStart % p->P == 0)
-        NSpaceStart = PSpaceStart / p->P;
-      else
-        NSpaceStart = (PSpaceStart - (PSpaceStart % p->P) + p->P) / p->P;
-      int64 NSpaceEnd = (PSpaceEnd - (PSpaceEnd % p->P)) / p->P;
-      int64 NSpaceSamples = NSpaceEnd - NSpaceStart + 1;
-        
-      //Make calculations for translating from P space to PQ space.
-      int64 PQSpaceStart;
-      if(PSpaceStart % p->Q == 0)
-        PQSpaceStart = PSpaceStart / p->Q;
-      else
-        PQSpaceStart = (PSpaceStart - (PSpaceStart % p->Q) + p->Q) / p->Q;        
-      int64 PQSpaceEnd = (PSpaceEnd - (PSpaceEnd % p->Q)) / p->Q;
-      int64 PQSpaceSamples = PQSpaceEnd - PQSpaceStart + 1;
-      
-      //Make calculations for adding the pass delay.
-      int64 PSpacePassStart = PSpaceStart;
-      int64 PSpacePassEnd = PSpaceEnd;
-      int64 PQSpacePassStart = PQSpaceStart;
-      int64 PQSpacePassEnd = PQSpaceEnd;
-      int64 PQSpacePassSamples = PQSpaceSamples;
+      RenderSlot& Slot = Slots[ReadSlots.Pop()];
+      Last = Slot.Last;
+      int64 CurrentReadPlace = Slot.ReadPlace;
+      FilterSlot(Slot);
       
-      //Read in a block taking into account the pass delay input shift zero pad.
-      int64 FramesRead;
-      if(InputShift == 0)
-      {
-        //Read in a block from the N-space input file.
-        FramesRead = (int64)sf_readf_double(
-          s_in, NChunk, (sf_count_t)NSpaceSamples);
-      }
-      else if(InputShift < NSpaceSamples)
-      {
-        //Zero pad the beginning of the chunk array to reflect input shift.
-        Memory::ClearArray(NChunk, InputShift * p->Channels);
-        
-        //Read in a block from the N-space input file.
-        FramesRead = (int64)sf_readf_double(
-          s_in, &NChunk[InputShift * p->Channels],
-          (sf_count_t)(NSpaceSamples - InputShift));
-          
-        //Report the zero padded frames as actual frames.
-        FramesRead += InputShift;
-          
-        //Input shift is no longer necessary.
-        InputShift = 0;
-      }
-      else
-      {
-        /*For some reason the input shift was really large, therefore we will
-        not even read from the file at all yet.*/
-        Memory::ClearArray(NChunk, NSpaceSamples * p->Channels);
-        
-        //Report the zero padded frames as actual frames.
-        FramesRead = InputShift;
-        
-        //Decrement the initial zero pad amount as it is used up.
-        InputShift -= NSpaceSamples;
-      }
-      
-      //Calculate the number of samples read.
-      int64 SamplesRead = FramesRead * p->Channels;
-      
-      //Zero out any portion that was not read.
-      Memory::ClearArray(&NChunk[SamplesRead],
-        NSpaceSamples * p->Channels - SamplesRead);
-      
-      /*Zero out p-chunk array. (Note we only need to do this once per
-      multi-channel chunk since the placement of zeroes is the same in all
-      channels.*/
-      Memory::ClearArray(PChunk, p->L);
-      
-      //Read in a block from scratch disk.
-      int64 PQFramesRead = (int64)sf_readf_double(
-        s_scratch, PQChunk, (sf_count_t)PQSpaceSamples);
-      int64 PQSamplesRead = PQFramesRead * p->Channels;
-      
-      //Zero out any portion that was not read.
-      Memory::ClearArray(&PQChunk[PQSamplesRead],
-        PQSpaceSamples * p->Channels - PQSamplesRead);
-      
-      //Roll back write cursor and read cursor to same point.
-      int64 OriginalPosition = 
-        sf_seek(s_scratch, -PQFramesRead, SEEK_CUR | SFM_READ);        
-      sf_seek(s_scratch, OriginalPosition, SEEK_SET | SFM_WRITE);
-      
-      //Now work on each channel in the chunk.
-      for(int64 Channel = 0; Channel < p->Channels; Channel++)
-      {
-        /*Initialize the PChunk with all the values from NChunk. In p-space we
-        are interleaving P zeroes in between each actual sample point. We
-        created the zeroes above by clearing the array.*/
-        int64 PIndexStart = NSpaceStart * p->P - PSpaceStart;
-        int64 PIndexEnd = NSpaceEnd * p->P - PSpaceStart;
-        int64 P_hop = p->P;
-        float64* ptr_ChannelNChunk = &NChunk[Channel];
-        int64 ChannelHop = p->Channels;
-        
-        for(int64 PIndex = PIndexStart; PIndex <= PIndexEnd; PIndex += P_hop)
-        {
-          PChunk[PIndex] = *ptr_ChannelNChunk;
-          ptr_ChannelNChunk += ChannelHop;
-        }
-        
-        //Copy P chunk into FFTer, and zero out everything else starting at L.
-        float64* fft_time = FFTer.GetTimeDomain();
-        Memory::CopyArray(fft_time, PChunk, p->L);
-        Memory::ClearArray(&fft_time[p->L], FFTer.N_Freq() * 2 - p->L);
-        
-        //Convert the P chunk into the frequency domain.
-        FFTer.TimeToFreq();
-        
-        //Transform is in place so freq domain is same memory as time domain.
-        float64* fft_freq = fft_time;
-        int64 P_Freq = FFTer.N_Freq() * 2;
-        
-        //Apply filter in frequency domain through complex multiplication.
-        for(int64 FreqSample = 0; FreqSample < P_Freq; FreqSample += 2)
-        {
-          int64 FreqSample_imag = FreqSample + 1;
-          float64* fft_cur_freq_real = &fft_freq[FreqSample];
-          float64* fft_cur_freq_imag = &fft_freq[FreqSample_imag];
-          
-          float64 r1 = *fft_cur_freq_real;
-          float64 r2 = FilterFFT[FreqSample];
-          
-          float64 i1 = *fft_cur_freq_imag;
-          float64 i2 = FilterFFT[FreqSample_imag];
-          
-          *fft_cur_freq_real = r1 * r2 - i1 * i2;
-          *fft_cur_freq_imag = r1 * i2 + r2 * i1;
-        }
-        
-        //Transform back to the time domain.
-        FFTer.FreqToTime();
-        
-        //Get current channel of overlap data.
-        float64* ChannelOverlapChunk = &OverlapChunk[Channel];
-        float64* ptr_ChannelOverlapChunk = ChannelOverlapChunk;
-        
-        /*Compute the necessary overlap, straight onto the FFT time domain data.
-        At the same time fill in the new overlap data.*/
-        int64 OverlapEnd = p->M_1;
-        float64* ptr_fft_time_overlap = &fft_time[p->L];
-        for(int64 OverlapIndex = 0; OverlapIndex < OverlapEnd; OverlapIndex++)
-        {
-          float64 NewOverlapValue = *ptr_fft_time_overlap;
-          fft_time[OverlapIndex] += *ptr_ChannelOverlapChunk;
-          *ptr_ChannelOverlapChunk = NewOverlapValue;
-          ptr_ChannelOverlapChunk += ChannelHop;
-          ptr_fft_time_overlap++;
-        }
-        
-        //Mix Q-decimated FFT time domain into current PQ chunk.
-        float64* ptr_PQChunkChannel = &PQChunk[Channel];
-        int64 Q_hop = p->Q;
-        int64 PQIndexStart = PQSpacePassStart * Q_hop - PSpacePassStart;
-        int64 PQIndexEnd = PQSpacePassEnd * Q_hop - PSpacePassStart;
-        float64 NormalizeFactor = p->FFTSize * p->P;
-        for(int64 PQIndex = PQIndexStart;
-          PQIndex <= PQIndexEnd; PQIndex += Q_hop)
-        {
-          *ptr_PQChunkChannel += fft_time[PQIndex] * NormalizeFactor;            
-          ptr_PQChunkChannel += ChannelHop;
-        }
-      }
-
-      //Determine how much data to write.
-      int64 CurrentPosition = sf_seek(s_scratch, 0, SEEK_CUR | SFM_WRITE);
-      int64 FramesUntilEnd = p->OutPQFrames - CurrentPosition;
-      if(FramesUntilEnd < PQSpacePassSamples)
-        PQSpacePassSamples = FramesUntilEnd;
-
-      //Write PQ chunk block back to scratch disk.
-      sf_writef_double(s_scratch, PQChunk, (sf_count_t)PQSpacePassSamples);
-      if(FramesUntilEnd <= PQSpacePassSamples)
+      //The slot belongs to the writer from here on.
+      FilteredSlots.Push(&Slot - Slots);
+      if(Last)
         break;
-
-      //Push the read cursor up to where the write cursor is.
-      int64 NextPosition = sf_seek(s_scratch, 0, SEEK_CUR | SFM_WRITE);
-      sf_seek(s_scratch, NextPosition, SEEK_SET | SFM_READ);
       
-      //Increment the P-space index for the next loop iteration.
-      PSpaceStart += p->L;
-      
-      //Get the current read place.
-      int64 CurrentReadPlace = sf_seek(s_in, 0, SEEK_CUR);
+      //Report the current read place, unless the length is not known.
+      if(p->Streaming)
+        continue;
       float64 pc = (float64)CurrentReadPlace/(float64)p->Frames*100.;
       c &= (number)pc;
       c &= "%...";
       GlobalWorkInfo::setPercentComplete(pc);
       std::cout.flush();
-    } while(true);
+    }
+    
+    //Wait for the last chunk of the pass to be written.
+    Reader.waitForThreadToExit(-1);
+    Writer.waitForThreadToExit(-1);
+  }
+  
+  /*The final pass starts at its output shift, so the output before it, which
+  the earlier passes finished, is measured from the scratch.*/
+  if(!Failed && Levels && Accumulator)
+  {
+    float64* Head = Slots[0].PQBuffer;
+    int64 HeadFrames = ChunkL / p->Q + 1;
+    for(int64 Position = 0; Position < PassOutputShift;)
+    {
+      int64 FramesRead = Accumulator->Read(Position, Head,
+        math::Min(HeadFrames, PassOutputShift - Position));
+      if(FramesRead <= 0)
+        break;
+      Levels->Measure(Head, FramesRead);
+      Position += FramesRead;
+    }
   }
   
+  //Stop the worker threads.
+  for(int64 i = 1; i < WorkerCount; i++)
+    Workers[i].stopThread(-1);
+  
   //Cleanup arrays.
+  for(int64 i = 0; i < SlotCount; i++)
+  {
+    delete [] Slots[i].InputChunk;
+    delete [] Slots[i].PQBuffer;
+  }
+  if(SharedFilter)
+  {
+    FilterCache::Release(SharedFilter);
+    if(FilterFFT == SharedFilter)
+      FilterFFT = 0;
+    if(DirectTaps == SharedFilter)
+      DirectTaps = 0;
+    SharedFilter = 0;
+  }
+  delete [] Slots;
   delete [] OverlapChunk;
-  delete [] PQChunk;
-  delete [] PChunk;
-  delete [] NChunk;
+  delete [] Blocks;
   delete [] FilterFFT;
-  FFTer.Initialize(16, FFTW_PATIENT, 0, true);
+  delete [] FilterSegment;
+  delete [] PhaseOffsets;
+  delete [] DirectTaps;
+  delete [] InputSpectra;
+  delete [] Convolvers;
+  delete ConvolveResponse;
+  FilterFFT = 0;
+  OverlapChunk = 0;
+  Blocks = 0;
+  Slots = 0;
+  SlotCount = 0;
+  PhaseOffsets = 0;
+  DirectTaps = 0;
+  InputSpectra = 0;
+  Convolvers = 0;
+  ConvolveResponse = 0;
+  for(int64 i = 0; i < WorkerCount; i++)
+  {
+    RenderWorker<Sample>& w = Workers[i];
+    delete [] w.InputFFT;
+    delete [] w.DirectWindow;
+    w.InputFFT = 0;
+    w.DirectWindow = 0;
+  }
+  
+  //Shrink the transforms while no other render is planning.
+  {
+    const juce::ScopedLock PlanLock(FFTMultithread::PlanLock);
+    for(int64 i = 0; i < WorkerCount; i++)
+    {
+      RenderWorker<Sample>& w = Workers[i];
+      if(!p->Direct && !p->NonUniform)
+        w.FFTer.Initialize(16, FFTW_PATIENT, 0, true);
+      if(p->Decimate)
+        w.DecimatedFFTer.Initialize(16, FFTW_PATIENT, 0, true);
+    }
+    if(FilterFFTer.N_Time())
+      FilterFFTer.Initialize(16, FFTW_PATIENT, 0, true);
+  }
+  
+  //There is no plot of a render that failed.
+  if(Failed)
+  {
+    delete [] PlotFFTData;
+    return false;
+  }
   
   /*Dump the plot contents to file and write a Mathematica script that can
   generate some nice plots for us.*/
@@ -563,4 +1812,55 @@ void Renderer::Go(SNDFILE* s_in, SNDFILE* s_scratch)
     c++;
     c++;
   }
+  return true;
+}
+
+bool Render(Parameters& p, SNDFILE* s_in, Scratch& s_scratch,
+  RenderLevels* s_levels)
+{
+  if(p.Cascaded)
+  {
+    CascadeRenderer R;
+    if(!R.Initialize(&p))
+      return false;
+    R.Go(s_in, &s_scratch, 0, s_levels);
+  }
+  else if(p.SinglePrecision)
+  {
+    Renderer<float32> R;
+    R.Initialize(&p);
+    return R.Go(s_in, &s_scratch, 0, s_levels);
+  }
+  else
+  {
+    Renderer<float64> R;
+    R.Initialize(&p);
+    return R.Go(s_in, &s_scratch, 0, s_levels);
+  }
+  return true;
+}
+
+bool Render(Parameters& p, SNDFILE* s_in, RenderSink& s_sink,
+  RenderLevels* s_levels)
+{
+  if(p.Cascaded)
+  {
+    CascadeRenderer R;
+    if(!R.Initialize(&p))
+      return false;
+    R.Go(s_in, 0, &s_sink, s_levels);
+  }
+  else if(p.SinglePrecision)
+  {
+    Renderer<float32> R;
+    R.Initialize(&p);
+    return R.Go(s_in, 0, &s_sink, s_levels);
+  }
+  else
+  {
+    Renderer<float64> R;
+    R.Initialize(&p);
+    return R.Go(s_in, 0, &s_sink, s_levels);
+  }
+  return true;
 }
@@ -31,22 +31,394 @@
 
 #include "Libraries.h"
 
+struct Convolver;
+struct ConvolverFilter;
 class Kaiser;
+template <class Sample> struct Kernels;
 struct Parameters;
-struct Renderer
+template <class Sample> struct Renderer;
+struct Scratch;
+
+///Describes a block of L of the input and of the output.
+struct RenderChunk
+{
+  float64* NChunk;
+  float64* PQChunk;
+  int64 NSpaceStart;
+  int64 NSpaceEnd;
+  int64 PSpaceStart;
+  int64 PQSpaceStart;
+  int64 PQSpaceEnd;
+  
+  ///Number of the block since the start of the pass.
+  int64 Index;
+  
+  ///Overlap-add tail of the block, frame by frame (zero-stuffing only).
+  float64* Overlap;
+};
+
+/**Buffers of one chunk in flight between the reader, the workers and the
+writer. The history of the input is kept right before the N chunk. The PQ chunk
+is either the slot's own buffer or the frames of the scratch itself.*/
+struct RenderSlot
+{
+  float64* InputChunk;
+  float64* NChunk;
+  float64* PQBuffer;
+  float64* PQChunk;
+  int64 NSpaceStart;
+  int64 NSpaceSamples;
+  int64 PSpaceStart;
+  int64 PQSpaceStart;
+  
+  ///Frame of the scratch file the PQ chunk is read from and written back to.
+  int64 ScratchPosition;
+  
+  ///Frames of the PQ chunk to write back.
+  int64 WriteFrames;
+  
+  ///Input frames read so far, for reporting progress.
+  int64 ReadPlace;
+  
+  ///Whether this is the last chunk of the pass.
+  bool Last;
+  
+  RenderSlot() : InputChunk(0), NChunk(0), PQBuffer(0), PQChunk(0),
+    NSpaceStart(0), NSpaceSamples(0), PSpaceStart(0), PQSpaceStart(0),
+    ScratchPosition(0), WriteFrames(0), ReadPlace(0), Last(false) {}
+};
+
+/**Passes the indexes of slots from one stage of the pipeline to the next, in
+order. There is only ever room for all the slots, so a push never waits, and
+there is a single thread that pops.*/
+struct RenderQueue
+{
+  int64* Items;
+  int64 Capacity;
+  int64 Head;
+  int64 Count;
+  juce::CriticalSection Lock;
+  juce::WaitableEvent Pushed;
+  
+  RenderQueue() : Items(0), Capacity(0), Head(0), Count(0) {}
+  ~RenderQueue() {delete [] Items;}
+  
+  ///Empties the queue and makes room for the given number of slots.
+  void Initialize(int64 Capacity);
+  
+  ///Adds a slot to the back of the queue.
+  void Push(int64 Slot);
+  
+  ///Waits for a slot and takes it from the front of the queue.
+  int64 Pop(void);
+};
+
+/**Takes the output of a single-pass render as it is written, in order, in
+place of a scratch to accumulate it in (streaming only).*/
+struct RenderSink
 {
-  float64* FilterFFT;
+  virtual ~RenderSink() {}
   
-  AudioFFT FFTer;
+  ///Takes the next frames of the output.
+  virtual void Write(const float64* Frames, int64 Count) = 0;
+};
+
+/**Levels of each channel of the finished output, measured as it is written
+rather than by reading it back. The range is always measured, and the sums for
+the average (DC) and RMS levels only when they are asked for.*/
+struct RenderLevels
+{
+  int64 Channels;
+  bool Averages;
+  int64 Frames;
+  float64* Minimums;
+  float64* Maximums;
+  float64* Sums;
+  float64* SumSquares;
+  
+  RenderLevels() : Channels(0), Averages(false), Frames(0), Minimums(0),
+    Maximums(0), Sums(0), SumSquares(0) {}
+  ~RenderLevels() {Cleanup();}
+  
+  ///Prepares to measure the channels, with or without their averages.
+  void Initialize(int64 Channels, bool Averages);
+  
+  ///Measures frames of interleaved channels.
+  void Measure(const float64* Source, int64 Count);
+  
+  ///Lowest and highest sample of any channel.
+  float64 Minimum(void);
+  float64 Maximum(void);
+  
+  void Cleanup(void);
+};
+
+///Reads chunks ahead of the workers or writes them behind, on its own thread.
+template <class Sample> struct RenderIO : public juce::Thread
+{
+  Renderer<Sample>* r;
+  bool Writes;
+  
+  RenderIO() : juce::Thread("BrickIOThread"), r(0), Writes(false) {}
+  
+  ///Reads or writes the chunks of the current pass, then exits.
+  void run(void);
+};
+
+/**Filters the blocks of every chunk a batch of channels at a time. Each worker
+owns its FFT buffers, so that workers can run at the same time on their own
+threads, sharing only the read-only filter and input. The tasks of a chunk are
+dealt out to the workers in ranges, and a worker that runs out of tasks steals
+from the others.*/
+template <class Sample> struct RenderWorker : public juce::Thread
+{
+  Renderer<Sample>* r;
+  
+  ///Transforms a batch of channels at a time.
+  AudioFFTOf<Sample> FFTer;
+  
+  ///Inverse FFT of the spectrum folded Q ways (Q-decimation only).
+  AudioFFTOf<Sample> DecimatedFFTer;
+  
+  /**Transforms a batch of pairs of channels, each pair as the real and
+  imaginary parts of one complex transform, and its folded inverse when
+  Q-decimating (paired only).*/
+  ComplexFFTOf<Sample> PairFFTer;
+  ComplexFFTOf<Sample> PairDecimatedFFTer;
+  
+  ///Spectrum of the current input windows (unpartitioned polyphase only).
+  Sample* InputFFT;
+  
+  ///History followed by the block of the current channel (direct only).
+  Sample* DirectWindow;
+  
+  ///Range of tasks left to the worker, guarded by the lock.
+  int64 NextTask;
+  int64 EndTask;
+  juce::CriticalSection TaskLock;
+  
+  ///Signaled when the worker has run out of tasks in the current chunk.
+  juce::WaitableEvent Done;
+  
+  RenderWorker() : juce::Thread("BrickRenderThread"), r(0), InputFFT(0),
+    DirectWindow(0), NextTask(0), EndTask(0) {}
+  
+  ///Waits for chunks to filter until the thread is told to exit.
+  void run(void);
+};
+
+/**Applies the filter to the input, adding the output into the scratch. The
+transforms, spectra and taps of the filter are in the precision of the sample
+type (float32 or float64), while the input, the output and the overlap are
+always in double precision.*/
+template <class Sample> struct Renderer
+{
+  Sample* FilterFFT;
+  
+  ///Unbatched transform for the filter (only when channels are batched).
+  AudioFFTOf<Sample> FilterFFTer;
   
   Kaiser* KaiserLPF;
   
   Parameters* p;
   
-  Renderer() : FilterFFT(0), KaiserLPF(0) {}
+  ///Workers that filter the chunks in parallel (the first on this thread).
+  RenderWorker<Sample>* Workers;
+  int64 WorkerCount;
+  
+  ///The blocks of the chunk the workers are filtering.
+  RenderChunk* Blocks;
+  
+  ///Batches of channels in each block; each batch of a block is one task.
+  int64 ChannelBatches;
+  
+  ///Window index modulo Q of the outputs of each phase (polyphase decimation).
+  int64* PhaseOffsets;
+  
+  ///Frames of overlap per channel.
+  int64 OverlapFrames;
+  
+  /**Tail of the previous chunk followed by the tails of the blocks (zero-
+  stuffing only).*/
+  float64* OverlapChunk;
+  
+  ///P-space length of a chunk, and input samples of history before it.
+  int64 ChunkL;
+  int64 HistorySamples;
+  
+  /**Input and output of the render, and the shifts of the current pass delay.
+  The output is either accumulated in the scratch, or handed to the sink.*/
+  SNDFILE* InputFile;
+  Scratch* Accumulator;
+  RenderSink* Sink;
+  int64 PassInputShift;
+  int64 PassOutputShift;
+  
+  ///Levels of the output, measured as the final pass writes it (if any).
+  RenderLevels* Levels;
+  bool FinalPass;
+  
+  /**Chunks in flight, passed from the reader to the workers to the writer and
+  back to the reader.*/
+  RenderSlot* Slots;
+  int64 SlotCount;
+  RenderQueue FreeSlots;
+  RenderQueue ReadSlots;
+  RenderQueue FilteredSlots;
+  RenderIO<Sample> Reader;
+  RenderIO<Sample> Writer;
+  
+  ///Time-reversed taps of each phase, one after the other (direct only).
+  Sample* DirectTaps;
+  
+  ///Inner loops for the instruction set of the CPU.
+  const Kernels<Sample>* Kernel;
+  
+  /**Spectra of the input blocks of every channel that the partitions of the
+  filter still apply to, indexed by block number modulo the number of entries
+  (partitioned only).*/
+  Sample* InputSpectra;
+  int64 SpectraBlocks;
+  int64 SpectrumSize;
+  
+  ///Whether the workers are transforming the blocks into InputSpectra.
+  bool TransformingInputs;
+  
+  ///Impulse response and the convolver of each channel (no resampling only).
+  ConvolverFilter* ConvolveResponse;
+  Convolver* Convolvers;
+  
+  /**The filter in FilterFFT or DirectTaps when it is shared with other renders
+  through the filter cache, or null.*/
+  Sample* SharedFilter;
+  
+  Renderer() : FilterFFT(0), KaiserLPF(0), p(0), Workers(0), WorkerCount(0),
+    Blocks(0), ChannelBatches(0), PhaseOffsets(0), OverlapFrames(0),
+    OverlapChunk(0), ChunkL(0), HistorySamples(0), InputFile(0),
+    Accumulator(0), Sink(0), PassInputShift(0), PassOutputShift(0), Levels(0),
+    FinalPass(false), Slots(0), SlotCount(0), DirectTaps(0), Kernel(0),
+    InputSpectra(0), SpectraBlocks(0), SpectrumSize(0),
+    TransformingInputs(false), ConvolveResponse(0), Convolvers(0),
+    SharedFilter(0) {}
+  
+  ///Destroys the plans of the workers while no other render is planning.
+  ~Renderer();
   
   void Initialize(Parameters* p);
-  void Go(SNDFILE* s_in, SNDFILE* s_scratch);
+  
+  ///Renders all the passes. Returns false if a pass could not be rendered.
+  bool Go(SNDFILE* s_in, Scratch* s_scratch, RenderSink* s_sink,
+    RenderLevels* s_levels);
+  
+  /**Reads the chunks of a pass from the input file and the scratch into free
+  slots (reader thread).*/
+  void ReadChunks(void);
+  
+  /**Writes the filtered chunks of a pass back to the scratch, or on to the
+  sink, and frees their slots (writer thread).*/
+  void WriteChunks(void);
+  
+  ///Returns the unbatched FFT used to transform the filter.
+  AudioFFTOf<Sample>& FilterTransform(void);
+  
+  ///Filters every block of the current chunk on all channels, with all workers.
+  void FilterChunk(void);
+  
+  ///Splits the chunk of a slot into blocks, filters them and stitches them.
+  void FilterSlot(RenderSlot& Slot);
+  
+  ///Runs the tasks of a worker and then those it can steal until none are left.
+  void FilterTasks(RenderWorker<Sample>& w);
+  
+  /**Takes the next task of a worker. Once it has none left, it steals the back
+  half of the tasks of another worker. Returns false when there are none.*/
+  bool NextTask(RenderWorker<Sample>& w, int64& Task);
+  
+  ///Filters one batch of channels of one block.
+  void FilterTask(RenderWorker<Sample>& w, int64 Task);
+  
+  /**Adds the tail of each block to the head of the next block in order, and
+  keeps the tail of the last block for the next chunk (zero-stuffing only).*/
+  void StitchOverlap(void);
+  
+  /**Transforms each of the P sub-filters of a filter segment into a spectrum
+  of FilterFFT.*/
+  void CreatePolyphaseFilterFFT(float64* Segment, Sample* Spectrum);
+  
+  ///Lays out the overlap-save windows of a batch of channels of a block.
+  void LoadPolyphaseWindows(AudioFFTOf<Sample>& FFTer,
+    const RenderChunk& Block, int64 FirstChannel, int64 Channels);
+  
+  ///Zero-stuffs a batch of channels of a block into P-space.
+  void LoadZeroStuffedChunks(AudioFFTOf<Sample>& FFTer,
+    const RenderChunk& Block, int64 FirstChannel, int64 Channels);
+  
+  /**Lays out a channel of a block at every Hop-th sample from the start of a
+  transform, in the same way as LoadPolyphaseWindows or LoadZeroStuffedChunks
+  (the transform is not cleared).*/
+  void LoadPolyphaseWindow(Sample* Window, int64 Hop, const RenderChunk& Block,
+    int64 Channel);
+  void LoadZeroStuffedChunk(Sample* Window, int64 Hop, const RenderChunk& Block,
+    int64 Channel);
+  
+  /**Mixes the outputs of one phase in every Hop-th sample of a window into a
+  channel of the PQ chunk, starting from one of the first P frames.*/
+  void MixPolyphaseWindow(const RenderChunk& Block, int64 Channel,
+    int64 FirstFrame, const Sample* Window, int64 Hop);
+  
+  /**Keeps the tail of the output in every Hop-th sample of a zero-stuffed
+  transform as the overlap of a channel, and mixes the rest into the PQ chunk.*/
+  void MixZeroStuffedOutput(const RenderChunk& Block, int64 Channel,
+    const Sample* Output, int64 Hop);
+  
+  ///Returns the spectrum of a channel of a block in InputSpectra.
+  Sample* InputSpectrum(int64 Index, int64 Channel);
+  
+  ///Transforms a batch of channels of a block into InputSpectra.
+  void TransformChannels(RenderWorker<Sample>& w, const RenderChunk& Block,
+    int64 FirstChannel, int64 Channels);
+  
+  /**Sums the products of the partitions of the filter (or of one of its
+  phases) with the spectra of the blocks they delay, up to this block.*/
+  void AccumulatePartitions(Sample* Destination, const RenderChunk& Block,
+    int64 Channel, int64 Phase);
+  
+  /**Filters a batch of channels of an N-space block with the P sub-filters,
+  mixing the results into the PQ chunk.*/
+  void FilterChannelsPolyphase(RenderWorker<Sample>& w,
+    const RenderChunk& Block, int64 FirstChannel, int64 Channels);
+  
+  /**Filters a batch of channels of an N-space block by zero-stuffing them into
+  P-space and convolving with the whole filter, mixing the results into the PQ
+  chunk and keeping the tail for the overlap-add.*/
+  void FilterChannelsZeroStuffed(RenderWorker<Sample>& w,
+    const RenderChunk& Block, int64 FirstChannel, int64 Channels);
+  
+  /**Filters pairs of channels in the same way as FilterChannelsPolyphase and
+  FilterChannelsZeroStuffed, each pair with complex transforms.*/
+  void FilterPairsPolyphase(RenderWorker<Sample>& w, const RenderChunk& Block,
+    int64 FirstChannel, int64 Pairs);
+  void FilterPairsZeroStuffed(RenderWorker<Sample>& w,
+    const RenderChunk& Block, int64 FirstChannel, int64 Pairs);
+  
+  ///Splits a filter segment into the time-reversed phases of DirectTaps.
+  void CreateDirectFilter(float64* Segment);
+  
+  /**Filters one channel of an N-space block by direct convolution with the P
+  sub-filters, mixing the results into the PQ chunk.*/
+  void FilterChannelDirect(RenderWorker<Sample>& w, const RenderChunk& Block,
+    int64 Channel);
 };
 
+/**Filters the input into the scratch with a renderer of the precision that the
+parameters call for, or with the stages of their cascade. Returns false if the
+render could not be done.*/
+bool Render(Parameters& p, SNDFILE* s_in, Scratch& s_scratch,
+  RenderLevels* s_levels = 0);
+
+/**Filters the input in a single pass, handing the output to the sink as it is
+written (streaming). Returns false if the render could not be done.*/
+bool Render(Parameters& p, SNDFILE* s_in, RenderSink& s_sink,
+  RenderLevels* s_levels = 0);
+
 #endif
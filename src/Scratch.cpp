@@ -0,0 +1,260 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#include "Scratch.h"
+
+#if JUCE_WINDOWS
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+bool Scratch::Open(int64 Frames, int64 Channels, int64 SampleRate,
+  bool InMemory)
+{
+  Console c;
+  Close();
+  Scratch::Channels = Channels;
+  
+  /*Keep the scratch in aligned memory if it fits. If the memory can not be
+  had after all, fall back to the disk.*/
+  if(InMemory)
+  {
+    Data = (float64*)fftw_malloc(sizeof(float64) * Frames * Channels);
+    if(Data)
+    {
+      c += "Keeping the scratch in memory.";
+      Capacity = Frames;
+      return true;
+    }
+  }
+  
+  //Otherwise map a raw scratch file into memory.
+  if(OpenMapped(Frames))
+    return true;
+  
+  //As a last resort, open the scratch file through libsndfile.
+  SF_INFO s_scratch_info;
+  Memory::ClearObject(s_scratch_info);
+  String ScratchFilename;
+  TempFile = juce::File::createTempFile(".aiff");
+  ScratchFilename = TempFile.getFullPathName().toUTF8();
+  c += "Opening scratch file '"; c &= ScratchFilename;
+  c &= "' for reading/writing...";
+  s_scratch_info.samplerate = (int)SampleRate;
+  s_scratch_info.channels = (int)Channels;
+  s_scratch_info.format = SF_FORMAT_DOUBLE | SF_FORMAT_AIFF;
+  File = sf_open(ScratchFilename, SFM_RDWR, &s_scratch_info);
+  if(!File)
+  {
+    c += "Could not open scratch file: ";
+    c &= sf_strerror(File);
+    TempFile.deleteFile();
+    return false;
+  }
+  return true;
+}
+
+bool Scratch::OpenMapped(int64 Frames)
+{
+  Console c;
+  
+  /*Round the mapping up to a multiple of 2 MB, so that it can be backed by
+  large pages where the kernel supports them for files.*/
+  int64 Alignment = 2 * 1024 * 1024;
+  MappedBytes = (int64)sizeof(float64) * Frames * Channels;
+  MappedBytes = math::Max((MappedBytes + Alignment - 1) / Alignment, (int64)1) *
+    Alignment;
+  if((int64)(size_t)MappedBytes != MappedBytes)
+    return false;
+  
+  TempFile = juce::File::createTempFile(".raw");
+  String ScratchFilename = TempFile.getFullPathName().toUTF8();
+  
+  /*The file is sized up front, which leaves it filled with zeroes without
+  writing them. Sequential access is hinted so that the kernel reads ahead and
+  writes back in large runs.*/
+  void* View = 0;
+#if JUCE_WINDOWS
+  HANDLE FileHandle = CreateFileA(ScratchFilename, GENERIC_READ | GENERIC_WRITE,
+    0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_SEQUENTIAL_SCAN,
+    0);
+  if(FileHandle == INVALID_HANDLE_VALUE)
+  {
+    TempFile.deleteFile();
+    return false;
+  }
+  HANDLE MappingHandle = CreateFileMappingA(FileHandle, 0, PAGE_READWRITE,
+    (DWORD)((uint64)MappedBytes >> 32), (DWORD)(MappedBytes & 0xffffffff), 0);
+  if(MappingHandle)
+    View = MapViewOfFile(MappingHandle, FILE_MAP_ALL_ACCESS, 0, 0,
+      (SIZE_T)MappedBytes);
+  if(!View)
+  {
+    if(MappingHandle)
+      CloseHandle(MappingHandle);
+    CloseHandle(FileHandle);
+    TempFile.deleteFile();
+    return false;
+  }
+  MapFile = (uintptr)FileHandle;
+  MapHandle = (uintptr)MappingHandle;
+#else
+  int FileDescriptor = open(ScratchFilename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if(FileDescriptor < 0)
+  {
+    TempFile.deleteFile();
+    return false;
+  }
+  if(ftruncate(FileDescriptor, (off_t)MappedBytes) == 0)
+    View = mmap(0, (size_t)MappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+      FileDescriptor, 0);
+  if(!View || View == MAP_FAILED)
+  {
+    close(FileDescriptor);
+    TempFile.deleteFile();
+    return false;
+  }
+  madvise(View, (size_t)MappedBytes, MADV_SEQUENTIAL);
+  MapFile = (uintptr)FileDescriptor;
+#endif
+  
+  c += "Mapping scratch file '"; c &= ScratchFilename; c &= "' into memory...";
+  Data = (float64*)View;
+  Capacity = Frames;
+  Mapped = true;
+  return true;
+}
+
+void Scratch::Clear(int64 Frames)
+{
+  //A new mapped file is already zero, and clearing it would only dirty it.
+  if(Mapped)
+  {
+    Length = math::Max(Length, math::Min(Frames, Capacity));
+    return;
+  }
+  
+  if(Data)
+  {
+    Frames = math::Min(Frames, Capacity);
+    Memory::ClearArray(Data, Frames * Channels);
+    Length = math::Max(Length, Frames);
+    return;
+  }
+  
+  //Zero out the scratch file one block at a time.
+  int64 BlankFrames = 1024 * 128;
+  float64* BlankMemory = new float64[Channels * BlankFrames];
+  Memory::ClearArray(BlankMemory, Channels * BlankFrames);
+  for(int64 Position = 0; Position < Frames; Position += BlankFrames)
+    Write(Position, BlankMemory, math::Min(BlankFrames, Frames - Position));
+  delete [] BlankMemory;
+}
+
+int64 Scratch::Read(int64 Position, float64* Destination, int64 Frames)
+{
+  Frames = math::Min(Frames, Length - Position);
+  if(Frames <= 0)
+    return 0;
+  
+  if(Data)
+  {
+    Memory::CopyArray(Destination, &Data[Position * Channels],
+      Frames * Channels);
+    return Frames;
+  }
+  
+  const juce::ScopedLock sl(Lock);
+  sf_seek(File, Position, SEEK_SET | SFM_READ);
+  return (int64)sf_readf_double(File, Destination, (sf_count_t)Frames);
+}
+
+void Scratch::Write(int64 Position, const float64* Source, int64 Frames)
+{
+  if(Data)
+  {
+    Frames = math::Min(Frames, Capacity - Position);
+    if(Frames <= 0)
+      return;
+    Memory::CopyArray(&Data[Position * Channels], Source, Frames * Channels);
+    if(Position + Frames > Length)
+      Length = Position + Frames;
+    return;
+  }
+  
+  if(Frames <= 0)
+    return;
+  const juce::ScopedLock sl(Lock);
+  sf_seek(File, Position, SEEK_SET | SFM_WRITE);
+  sf_writef_double(File, (float64*)Source, (sf_count_t)Frames);
+  if(Position + Frames > Length)
+    Length = Position + Frames;
+}
+
+float64* Scratch::Access(int64 Position, int64 Frames)
+{
+  if(!Data || Position < 0 || Position + Frames > Capacity)
+    return 0;
+  if(Position + Frames > Length)
+    Length = Position + Frames;
+  return &Data[Position * Channels];
+}
+
+void Scratch::Close(void)
+{
+  if(Mapped)
+  {
+#if JUCE_WINDOWS
+    UnmapViewOfFile(Data);
+    CloseHandle((HANDLE)MapHandle);
+    CloseHandle((HANDLE)MapFile);
+#else
+    munmap(Data, (size_t)MappedBytes);
+    close((int)MapFile);
+#endif
+    TempFile.deleteFile();
+  }
+  else if(Data)
+    fftw_free(Data);
+  if(File)
+  {
+    sf_close(File);
+    TempFile.deleteFile();
+  }
+  Data = 0;
+  Mapped = false;
+  MappedBytes = 0;
+  MapFile = 0;
+  MapHandle = 0;
+  File = 0;
+  Capacity = 0;
+  Length = 0;
+}
@@ -0,0 +1,102 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include "Libraries.h"
+
+/**Accumulates the PQ-space output of every pass. The scratch is kept in memory
+when it fits the memory budget, and otherwise in a temporary file of raw
+float64 frames that is mapped into memory. Only when the file can not be mapped
+(for example in a 32-bit address space) is it accessed through libsndfile as
+an AIFF file instead. Either way it behaves like a file: frames are read and
+written at explicit positions, and it grows as frames are written past its end.
+Reads and writes of different frames may happen at the same time on different
+threads.*/
+struct Scratch
+{
+  ///Frames of the scratch in memory or in the mapped file, or null.
+  float64* Data;
+  
+  ///Frames that fit in the memory of the scratch.
+  int64 Capacity;
+  
+  ///Frames written to the scratch so far.
+  int64 Length;
+  
+  int64 Channels;
+  
+  ///Whether Data is a mapping of the scratch file rather than memory.
+  bool Mapped;
+  
+  ///Bytes mapped, and the handles of the file and of its mapping.
+  int64 MappedBytes;
+  uintptr MapFile;
+  uintptr MapHandle;
+  
+  ///Scratch file when it is accessed through libsndfile, or null.
+  SNDFILE* File;
+  juce::File TempFile;
+  
+  ///Guards the libsndfile scratch file, whose cursors all threads share.
+  juce::CriticalSection Lock;
+  
+  Scratch() : Data(0), Capacity(0), Length(0), Channels(0), Mapped(false),
+    MappedBytes(0), MapFile(0), MapHandle(0), File(0) {}
+  ~Scratch() {Close();}
+  
+  /**Creates an empty scratch for the given number of frames. It is kept in
+  memory if InMemory is set and the memory can be had, and on disk otherwise.
+  Returns false if the scratch file could not be created.*/
+  bool Open(int64 Frames, int64 Channels, int64 SampleRate, bool InMemory);
+  
+  ///Whether the scratch is kept in memory.
+  bool IsInMemory(void) {return Data && !Mapped;}
+  
+  ///Fills all the frames the scratch was opened for with zeroes.
+  void Clear(int64 Frames);
+  
+  ///Reads frames at a position, and returns how many there were.
+  int64 Read(int64 Position, float64* Destination, int64 Frames);
+  
+  ///Writes frames at a position.
+  void Write(int64 Position, const float64* Source, int64 Frames);
+  
+  /**Returns the frames at a position to accumulate into directly, or null if
+  they are not all addressable (the scratch is then read and written).*/
+  float64* Access(int64 Position, int64 Frames);
+  
+  ///Frees the memory, or closes and deletes the scratch file.
+  void Close(void);
+  
+  ///Creates the raw scratch file and maps it into memory.
+  bool OpenMapped(int64 Frames);
+};
+
+#endif
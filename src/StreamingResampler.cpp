@@ -0,0 +1,511 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#include "StreamingResampler.h"
+
+#include "Kaiser.h"
+#include "Kernels.h"
+
+bool StreamingResampler::Initialize(int64 P, int64 Q, int64 Channels,
+  float64 AllowableBandwidthLoss, float64 StopbandAttenuation,
+  int64 BlockFrames)
+{
+  Cleanup();
+  if(P < 1 || Q < 1 || Channels < 1 || BlockFrames < 0 ||
+    AllowableBandwidthLoss <= 0.0 || AllowableBandwidthLoss >= 1.0 ||
+    StopbandAttenuation <= 0.0)
+      return false;
+  
+  //Take out any common factor of the ratio, and design the filter in P-space.
+  math::Ratio Reduced(P, Q);
+  Kaiser KaiserLPF;
+  KaiserLPF.Initialize(Reduced.Num(), Reduced.Den(), AllowableBandwidthLoss,
+    StopbandAttenuation);
+  return Build(Reduced.Num(), Reduced.Den(), Channels, KaiserLPF,
+    BlockFrames);
+}
+
+bool StreamingResampler::InitializeBand(int64 P, int64 Q, int64 Channels,
+  float64 Passband, float64 Stopband, float64 StopbandAttenuation,
+  int64 BlockFrames)
+{
+  Cleanup();
+  if(P < 1 || Q < 1 || Channels < 1 || BlockFrames < 0 ||
+    StopbandAttenuation <= 0.0)
+      return false;
+  
+  //The P-space Nyquist frequency is P times that of the input.
+  math::Ratio Reduced(P, Q);
+  float64 Scale = 1.0 / (float64)Reduced.Num();
+  if(Passband <= 0.0 || Stopband <= Passband || Stopband * Scale > 1.0)
+    return false;
+  Kaiser KaiserLPF;
+  KaiserLPF.Initialize(Passband * Scale, (Stopband - Passband) * Scale,
+    StopbandAttenuation);
+  return Build(Reduced.Num(), Reduced.Den(), Channels, KaiserLPF,
+    BlockFrames);
+}
+
+bool StreamingResampler::Build(int64 P, int64 Q, int64 Channels,
+  Kaiser& KaiserLPF, int64 BlockFrames)
+{
+  StreamingResampler::P = P;
+  StreamingResampler::Q = Q;
+  StreamingResampler::Channels = Channels;
+  FilterLength = KaiserLPF.GetOrder();
+  PhaseLength = (FilterLength + P - 1) / P;
+  
+  /*Each block has to be at least as long as a phase so that the previous block
+  covers the history of its first output. It is a multiple of Q so that each
+  block gives a whole number of output frames, and a power-of-two multiple so
+  that the transforms stay fast.*/
+  int64 Smallest = (BlockFrames ? BlockFrames : 1024);
+  if(Smallest < PhaseLength - 1)
+    Smallest = PhaseLength - 1;
+  StreamingResampler::BlockFrames = Q;
+  while(StreamingResampler::BlockFrames < Smallest)
+    StreamingResampler::BlockFrames *= 2;
+  BlockFrames = StreamingResampler::BlockFrames;
+  OutputBlockFrames = BlockFrames / Q * P;
+  FFTSize = BlockFrames * 2;
+  FoldedSize = FFTSize / Q;
+  if(FFTSize > (int64)1 << 30)
+  {
+    Cleanup();
+    return false;
+  }
+  
+  BlockFFT.Initialize((int)FFTSize, FFTW_PATIENT, 0, true);
+  PhaseFFT.Initialize((int)FoldedSize, FFTW_PATIENT, 0, true);
+  
+  /*Output t of a block is at place p = BlockFrames + floor(t * Q / P) of the
+  output of phase (t * Q) mod P over the previous and pending blocks. The places
+  of a phase are Q apart, so shifting the phase back by the remainder of its
+  places lines them up with every Q-th sample of the folded inverse.*/
+  OutputPlaces = new int64[OutputBlockFrames];
+  int64* Shifts = new int64[P];
+  Memory::ClearArray(Shifts, P);
+  for(int64 t = 0; t < OutputBlockFrames; t++)
+  {
+    int64 Phase = (t * Q) % P;
+    int64 Place = BlockFrames + (t * Q) / P;
+    Shifts[Phase] = Place % Q;
+    OutputPlaces[t] = Phase * FoldedSize + (Place - Shifts[Phase]) / Q;
+  }
+  
+  //Transform each shifted phase, including the gain of P.
+  float64* Taps = new float64[FilterLength];
+  KaiserLPF.CreateLPFInPlace(Taps, 0, FilterLength);
+  int64 SpectrumSize = FFTSize + 2;
+  PhaseSpectra = new float64[P * SpectrumSize];
+  for(int64 Phase = 0; Phase < P; Phase++)
+  {
+    float64* fft_time = BlockFFT.GetTimeDomain();
+    Memory::ClearArray(fft_time, SpectrumSize);
+    for(int64 k = 0; k < PhaseLength && Phase + k * P < FilterLength; k++)
+    {
+      int64 Place = (k - Shifts[Phase] + FFTSize) % FFTSize;
+      fft_time[Place] = Taps[Phase + k * P] * (float64)P;
+    }
+    BlockFFT.TimeToFreq();
+    Memory::CopyArray(&PhaseSpectra[Phase * SpectrumSize],
+      BlockFFT.GetFreqDomain(), SpectrumSize);
+  }
+  delete [] Shifts;
+  delete [] Taps;
+  
+  BlockSpectrum = new float64[SpectrumSize];
+  PhaseOutputs = new float64[P * FoldedSize];
+  Previous = new float64[BlockFrames * Channels];
+  Pending = new float64[BlockFrames * Channels];
+  Ready = new float64[OutputBlockFrames * Channels];
+  Reset();
+  return true;
+}
+
+void StreamingResampler::Reset(void)
+{
+  Memory::ClearArray(Previous, BlockFrames * Channels);
+  Memory::ClearArray(Pending, BlockFrames * Channels);
+  PendingFrames = 0;
+  ReadyStart = 0;
+  ReadyFrames = 0;
+  FramesPushed = 0;
+  FramesPulled = 0;
+  BlocksFiltered = 0;
+  Finished = false;
+}
+
+int64 StreamingResampler::OutputFrames(int64 InputFrames)
+{
+  if(InputFrames < 1 || !FilterLength)
+    return 0;
+  return ((InputFrames - 1) * P + FilterLength - 1) / Q + 1;
+}
+
+void StreamingResampler::FilterBlock(void)
+{
+  int64 SpectrumSize = FFTSize + 2;
+  float64* fft_time = BlockFFT.GetTimeDomain();
+  for(int64 c = 0; c < Channels; c++)
+  {
+    //Transform the previous and pending blocks of the channel together.
+    Memory::CopyArray(fft_time, &Previous[c * BlockFrames], BlockFrames);
+    Memory::CopyArray(&fft_time[BlockFrames], &Pending[c * BlockFrames],
+      BlockFrames);
+    BlockFFT.TimeToFreqUnnormalized();
+    Memory::CopyArray(BlockSpectrum, BlockFFT.GetFreqDomain(), SpectrumSize);
+    
+    //Filter by each phase, only transforming back every Q-th output.
+    for(int64 Phase = 0; Phase < P; Phase++)
+    {
+      MultiplyAndFoldSpectrum(PhaseFFT.GetFreqDomain(), BlockSpectrum,
+        &PhaseSpectra[Phase * SpectrumSize], FFTSize, Q);
+      PhaseFFT.FreqToTime();
+      Memory::CopyArray(&PhaseOutputs[Phase * FoldedSize],
+        PhaseFFT.GetTimeDomain(), FoldedSize);
+    }
+    
+    //Interleave the outputs of the phases in order.
+    for(int64 t = 0; t < OutputBlockFrames; t++)
+      Ready[t * Channels + c] = PhaseOutputs[OutputPlaces[t]];
+  }
+  
+  //The pending block becomes the history of the next.
+  float64* Swap = Previous;
+  Previous = Pending;
+  Pending = Swap;
+  PendingFrames = 0;
+  ReadyStart = 0;
+  ReadyFrames = OutputBlockFrames;
+  BlocksFiltered++;
+}
+
+bool StreamingResampler::Advance(void)
+{
+  if(ReadyFrames || !BlockFrames)
+    return false;
+  
+  if(PendingFrames < BlockFrames)
+  {
+    int64 Filtered = BlocksFiltered * OutputBlockFrames;
+    if(!Finished || Filtered >= OutputFrames(FramesPushed))
+      return false;
+    
+    //Pad the rest of the block with silence.
+    for(int64 c = 0; c < Channels; c++)
+      Memory::ClearArray(&Pending[c * BlockFrames + PendingFrames],
+        BlockFrames - PendingFrames);
+    PendingFrames = BlockFrames;
+  }
+  
+  FilterBlock();
+  
+  //Once the input has ended, stop at the end of the filter.
+  if(Finished)
+  {
+    int64 Remaining = OutputFrames(FramesPushed) - FramesPulled;
+    if(ReadyFrames > Remaining)
+      ReadyFrames = (Remaining > 0 ? Remaining : 0);
+  }
+  return true;
+}
+
+template <class Frame>
+int64 StreamingResampler::PushFrames(const Frame* Input,
+  const Frame* const* Planes, int64 Offset, int64 Frames)
+{
+  int64 Taken = 0;
+  while(Taken < Frames && !Finished)
+  {
+    if(PendingFrames == BlockFrames && !Advance())
+      break;
+    
+    //Deinterleave as much as fits into the pending block.
+    int64 n = BlockFrames - PendingFrames;
+    if(n > Frames - Taken)
+      n = Frames - Taken;
+    int64 From = Offset + Taken;
+    for(int64 c = 0; c < Channels; c++)
+    {
+      float64* Destination = &Pending[c * BlockFrames + PendingFrames];
+      if(Planes)
+      {
+        const Frame* Source = &Planes[c][From];
+        for(int64 i = 0; i < n; i++)
+          Destination[i] = (float64)Source[i];
+      }
+      else
+      {
+        const Frame* Source = &Input[From * Channels + c];
+        for(int64 i = 0; i < n; i++)
+          Destination[i] = (float64)Source[i * Channels];
+      }
+    }
+    PendingFrames += n;
+    FramesPushed += n;
+    Taken += n;
+    
+    if(PendingFrames == BlockFrames)
+      Advance();
+  }
+  return Taken;
+}
+
+template <class Frame>
+int64 StreamingResampler::PullFrames(Frame* Output, Frame* const* Planes,
+  int64 Offset, int64 Frames)
+{
+  int64 Given = 0;
+  while(Given < Frames)
+  {
+    if(!ReadyFrames && !Advance())
+      break;
+    
+    int64 n = ReadyFrames;
+    if(n > Frames - Given)
+      n = Frames - Given;
+    const float64* Source = &Ready[ReadyStart * Channels];
+    int64 To = Offset + Given;
+    if(Planes)
+    {
+      for(int64 c = 0; c < Channels; c++)
+      {
+        Frame* Destination = &Planes[c][To];
+        for(int64 i = 0; i < n; i++)
+          Destination[i] = (Frame)Source[i * Channels + c];
+      }
+    }
+    else
+    {
+      Frame* Destination = &Output[To * Channels];
+      for(int64 i = 0; i < n * Channels; i++)
+        Destination[i] = (Frame)Source[i];
+    }
+    ReadyStart += n;
+    ReadyFrames -= n;
+    FramesPulled += n;
+    Given += n;
+  }
+  return Given;
+}
+
+template <class Frame>
+int64 StreamingResampler::ProcessFrames(const Frame* Input,
+  const Frame* const* InputPlanes, int64 Frames, Frame* Output,
+  Frame* const* OutputPlanes)
+{
+  if(!BlockFrames)
+    return 0;
+  
+  int64 Room = MaxOutputFrames(Frames);
+  int64 Taken = 0, Given = 0;
+  for(;;)
+  {
+    int64 Pushed = PushFrames(Input, InputPlanes, Taken, Frames - Taken);
+    int64 Pulled = PullFrames(Output, OutputPlanes, Given, Room - Given);
+    Taken += Pushed;
+    Given += Pulled;
+    if(Taken == Frames || (!Pushed && !Pulled))
+      break;
+  }
+  
+  //Pull the block that the last of the input may have completed.
+  Given += PullFrames(Output, OutputPlanes, Given, Room - Given);
+  return Given;
+}
+
+template <class Frame>
+int64 StreamingResampler::ResampleFrames(const Frame* Input,
+  const Frame* const* InputPlanes, int64 Frames, Frame* Output,
+  Frame* const* OutputPlanes, int64 Room)
+{
+  //A resampler that was never initialized takes and gives nothing.
+  if(!BlockFrames)
+    return 0;
+  
+  Reset();
+  int64 Taken = 0, Given = 0;
+  while(Taken < Frames && Given < Room)
+  {
+    int64 Pushed = PushFrames(Input, InputPlanes, Taken, Frames - Taken);
+    int64 Pulled = PullFrames(Output, OutputPlanes, Given, Room - Given);
+    Taken += Pushed;
+    Given += Pulled;
+    if(!Pushed && !Pulled)
+      break;
+  }
+  
+  //Pull the rest up to the end of the filter.
+  Finish();
+  Given += PullFrames(Output, OutputPlanes, Given, Room - Given);
+  return Given;
+}
+
+int64 StreamingResampler::Push(const float32* Input, int64 Frames)
+{
+  return PushFrames(Input, (const float32* const*)0, 0, Frames);
+}
+
+int64 StreamingResampler::Push(const float64* Input, int64 Frames)
+{
+  return PushFrames(Input, (const float64* const*)0, 0, Frames);
+}
+
+int64 StreamingResampler::Push(const float32* const* Input, int64 Frames)
+{
+  return PushFrames((const float32*)0, Input, 0, Frames);
+}
+
+int64 StreamingResampler::Push(const float64* const* Input, int64 Frames)
+{
+  return PushFrames((const float64*)0, Input, 0, Frames);
+}
+
+int64 StreamingResampler::Pull(float32* Output, int64 Frames)
+{
+  return PullFrames(Output, (float32* const*)0, 0, Frames);
+}
+
+int64 StreamingResampler::Pull(float64* Output, int64 Frames)
+{
+  return PullFrames(Output, (float64* const*)0, 0, Frames);
+}
+
+int64 StreamingResampler::Pull(float32* const* Output, int64 Frames)
+{
+  return PullFrames((float32*)0, Output, 0, Frames);
+}
+
+int64 StreamingResampler::Pull(float64* const* Output, int64 Frames)
+{
+  return PullFrames((float64*)0, Output, 0, Frames);
+}
+
+int64 StreamingResampler::Process(const float32* Input, int64 Frames,
+  float32* Output)
+{
+  return ProcessFrames(Input, (const float32* const*)0, Frames, Output,
+    (float32* const*)0);
+}
+
+int64 StreamingResampler::Process(const float64* Input, int64 Frames,
+  float64* Output)
+{
+  return ProcessFrames(Input, (const float64* const*)0, Frames, Output,
+    (float64* const*)0);
+}
+
+int64 StreamingResampler::Process(const float32* const* Input, int64 Frames,
+  float32* const* Output)
+{
+  return ProcessFrames((const float32*)0, Input, Frames, (float32*)0, Output);
+}
+
+int64 StreamingResampler::Process(const float64* const* Input, int64 Frames,
+  float64* const* Output)
+{
+  return ProcessFrames((const float64*)0, Input, Frames, (float64*)0, Output);
+}
+
+int64 StreamingResampler::Resample(const float32* Input, int64 Frames,
+  float32* Output, int64 Room)
+{
+  return ResampleFrames(Input, (const float32* const*)0, Frames, Output,
+    (float32* const*)0, Room);
+}
+
+int64 StreamingResampler::Resample(const float64* Input, int64 Frames,
+  float64* Output, int64 Room)
+{
+  return ResampleFrames(Input, (const float64* const*)0, Frames, Output,
+    (float64* const*)0, Room);
+}
+
+int64 StreamingResampler::Resample(const float32* const* Input, int64 Frames,
+  float32* const* Output, int64 Room)
+{
+  return ResampleFrames((const float32*)0, Input, Frames, (float32*)0, Output,
+    Room);
+}
+
+int64 StreamingResampler::Resample(const float64* const* Input, int64 Frames,
+  float64* const* Output, int64 Room)
+{
+  return ResampleFrames((const float64*)0, Input, Frames, (float64*)0, Output,
+    Room);
+}
+
+void StreamingResampler::Finish(void)
+{
+  if(Finished)
+    return;
+  Finished = true;
+  
+  //Limit output that is already waiting to the end of the filter.
+  int64 Remaining = OutputFrames(FramesPushed) - FramesPulled;
+  if(ReadyFrames > Remaining)
+    ReadyFrames = (Remaining > 0 ? Remaining : 0);
+}
+
+int64 StreamingResampler::MaxOutputFrames(int64 InputFrames)
+{
+  if(!BlockFrames)
+    return 0;
+  return (InputFrames / BlockFrames + 2) * OutputBlockFrames;
+}
+
+float64 StreamingResampler::Latency(void)
+{
+  return (float64)(FilterLength - 1) / (float64)(Q * 2);
+}
+
+void StreamingResampler::Cleanup(void)
+{
+  delete [] PhaseSpectra;
+  delete [] OutputPlaces;
+  delete [] BlockSpectrum;
+  delete [] PhaseOutputs;
+  delete [] Previous;
+  delete [] Pending;
+  delete [] Ready;
+  PhaseSpectra = 0;
+  OutputPlaces = 0;
+  BlockSpectrum = 0;
+  PhaseOutputs = 0;
+  Previous = 0;
+  Pending = 0;
+  Ready = 0;
+  P = Q = 1;
+  Channels = 0;
+  FilterLength = PhaseLength = 0;
+  BlockFrames = OutputBlockFrames = FFTSize = FoldedSize = 0;
+  PendingFrames = ReadyStart = ReadyFrames = 0;
+  FramesPushed = FramesPulled = BlocksFiltered = 0;
+  Finished = false;
+}
@@ -0,0 +1,216 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#ifndef STREAMINGRESAMPLER_H
+#define STREAMINGRESAMPLER_H
+
+#include "Libraries.h"
+
+class Kaiser;
+
+/**Resamples interleaved frames by P / Q with the same Kaiser filter as Brick,
+for embedding in other programs: frames are pushed in and pulled out in any
+amounts, with no files, scratch or parameters in between. Everything is
+allocated when it is initialized, so that pushing and pulling never allocate.
+
+The input is filtered in fixed blocks of BlockFrames frames, each of which gives
+exactly BlockFrames * P / Q output frames, by polyphase overlap-save: phase f
+of the filter is every P-th tap from tap f, and output m is output m * Q / P of
+phase (m * Q) mod P filtering the input. Each block is transformed once, and
+for each phase the product with the spectrum of the phase is folded Q ways
+before its inverse transform, so that only the outputs that are used (every
+Q-th) are transformed back. Each phase is shifted so that its outputs line up
+with every Q-th sample.
+
+The output is not trimmed: like the output of Brick, it starts with the delay of
+the filter, which Latency gives in output frames.*/
+class StreamingResampler
+{
+  ///The reduced ratio, and the number of interleaved channels.
+  int64 P, Q, Channels;
+  
+  ///Length of the filter in P-space, and of each of its phases.
+  int64 FilterLength;
+  int64 PhaseLength;
+  
+  ///Input and output frames of a block, and the length of its transform.
+  int64 BlockFrames;
+  int64 OutputBlockFrames;
+  int64 FFTSize;
+  int64 FoldedSize;
+  
+  ///Half spectra of the shifted phases of the filter, one after the other.
+  float64* PhaseSpectra;
+  
+  ///For each output frame of a block, where it is in PhaseOutputs.
+  int64* OutputPlaces;
+  
+  ///Spectrum of the block of a channel, kept while each phase is folded.
+  float64* BlockSpectrum;
+  
+  ///Every Q-th output of each phase for the block of a channel.
+  float64* PhaseOutputs;
+  
+  ///The previous block and the block being filled with input.
+  float64* Previous;
+  float64* Pending;
+  int64 PendingFrames;
+  
+  ///Output of the last block, and how much of it has been pulled.
+  float64* Ready;
+  int64 ReadyStart;
+  int64 ReadyFrames;
+  
+  ///Frames pushed and pulled so far, and whether the input has ended.
+  int64 FramesPushed;
+  int64 FramesPulled;
+  int64 BlocksFiltered;
+  bool Finished;
+  
+  ///Transform of the input blocks, and the folded inverse of each phase.
+  AudioFFT BlockFFT;
+  AudioFFT PhaseFFT;
+  
+  /**Filters the pending block once the output of the last one is pulled, and
+  returns whether it did. Once the input has ended, the block is padded with
+  silence until the end of the filter.*/
+  bool Advance(void);
+  
+  /**Allocates everything for the reduced ratio with the designed filter, and
+  returns false if the transforms would be too large.*/
+  bool Build(int64 P, int64 Q, int64 Channels, Kaiser& KaiserLPF,
+    int64 BlockFrames);
+  
+  ///Filters the pending block of each channel into the ready output.
+  void FilterBlock(void);
+  
+  /**Moves frames from the offset on of either the interleaved buffer or, if
+  given, the separate buffers of each channel.*/
+  template <class Frame> int64 PushFrames(const Frame* Input,
+    const Frame* const* Planes, int64 Offset, int64 Frames);
+  template <class Frame> int64 PullFrames(Frame* Output, Frame* const* Planes,
+    int64 Offset, int64 Frames);
+  template <class Frame> int64 ProcessFrames(const Frame* Input,
+    const Frame* const* InputPlanes, int64 Frames, Frame* Output,
+    Frame* const* OutputPlanes);
+  template <class Frame> int64 ResampleFrames(const Frame* Input,
+    const Frame* const* InputPlanes, int64 Frames, Frame* Output,
+    Frame* const* OutputPlanes, int64 Room);
+  
+  public:
+  
+  StreamingResampler() : P(1), Q(1), Channels(0), FilterLength(0),
+    PhaseLength(0), BlockFrames(0), OutputBlockFrames(0), FFTSize(0),
+    FoldedSize(0), PhaseSpectra(0), OutputPlaces(0), BlockSpectrum(0),
+    PhaseOutputs(0), Previous(0), Pending(0), PendingFrames(0), Ready(0),
+    ReadyStart(0), ReadyFrames(0), FramesPushed(0), FramesPulled(0),
+    BlocksFiltered(0), Finished(false) {}
+  
+  ~StreamingResampler() {Cleanup();}
+  
+  /**Designs the filter for resampling by P / Q (any common factor is taken
+  out), with the allowable bandwidth loss as a fraction of the output Nyquist
+  frequency (0.001 for 0.1%) and the stopband attenuation in decibels, and
+  allocates everything. BlockFrames is a smallest length for the input blocks,
+  which are at least as long as a phase of the filter (zero to choose). Returns
+  false if the ratio or the filter does not make sense.*/
+  bool Initialize(int64 P, int64 Q, int64 Channels,
+    float64 AllowableBandwidthLoss = 0.001,
+    float64 StopbandAttenuation = 200.0, int64 BlockFrames = 0);
+  
+  /**Like Initialize, but with the edges of the passband and the stopband of
+  the filter given directly, as fractions of the Nyquist frequency of the input.
+  When upsampling, the stopband may start above the Nyquist frequency, up to P
+  times it, for an input that has nothing in the images just above it (as is
+  the case in the stages of a cascade).*/
+  bool InitializeBand(int64 P, int64 Q, int64 Channels, float64 Passband,
+    float64 Stopband, float64 StopbandAttenuation = 200.0,
+    int64 BlockFrames = 0);
+  
+  /**Takes up to the given number of input frames, and returns how many were
+  taken. Fewer are taken once a block is waiting for the output of the last one
+  to be pulled. The frames are either interleaved, or given as a buffer for
+  each channel.*/
+  int64 Push(const float32* Input, int64 Frames);
+  int64 Push(const float64* Input, int64 Frames);
+  int64 Push(const float32* const* Input, int64 Frames);
+  int64 Push(const float64* const* Input, int64 Frames);
+  
+  ///Gives up to the given number of output frames, and returns how many.
+  int64 Pull(float32* Output, int64 Frames);
+  int64 Pull(float64* Output, int64 Frames);
+  int64 Pull(float32* const* Output, int64 Frames);
+  int64 Pull(float64* const* Output, int64 Frames);
+  
+  /**Pushes all of the input and pulls all of the output that it completes.
+  The output has to have room for MaxOutputFrames(Frames) frames. Returns the
+  number of output frames. After Finish, the rest is pulled with Pull.*/
+  int64 Process(const float32* Input, int64 Frames, float32* Output);
+  int64 Process(const float64* Input, int64 Frames, float64* Output);
+  int64 Process(const float32* const* Input, int64 Frames,
+    float32* const* Output);
+  int64 Process(const float64* const* Input, int64 Frames,
+    float64* const* Output);
+  
+  /**Resamples a whole input from the start, writing up to Room output frames,
+  and returns how many were written: all of them if there is room for
+  OutputFrames(Frames). Returns zero if the resampler is not initialized.*/
+  int64 Resample(const float32* Input, int64 Frames, float32* Output,
+    int64 Room);
+  int64 Resample(const float64* Input, int64 Frames, float64* Output,
+    int64 Room);
+  int64 Resample(const float32* const* Input, int64 Frames,
+    float32* const* Output, int64 Room);
+  int64 Resample(const float64* const* Input, int64 Frames,
+    float64* const* Output, int64 Room);
+  
+  /**Ends the input, after which Pull gives the rest of the output up to the
+  end of the filter, and then none.*/
+  void Finish(void);
+  
+  ///Clears the input and output to start over with the same filter.
+  void Reset(void);
+  
+  /**Most output frames that Process can give for a number of input frames,
+  including output that was not pulled yet.*/
+  int64 MaxOutputFrames(int64 InputFrames);
+  
+  ///Output frames there are in total for a number of input frames.
+  int64 OutputFrames(int64 InputFrames);
+  
+  ///Delay of the center of the filter, in output frames.
+  float64 Latency(void);
+  
+  ///Input frames of each block, and output frames that each gives.
+  int64 InputBlockSize(void) {return BlockFrames;}
+  int64 OutputBlockSize(void) {return OutputBlockFrames;}
+  
+  void Cleanup(void);
+};
+
+#endif
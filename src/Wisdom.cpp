@@ -28,11 +28,14 @@
 
 #include "Wisdom.h"
 
+int FFTMultithread::Threads = 0;
+juce::CriticalSection FFTMultithread::PlanLock;
+
 bool FFTMultithread::Init(void)
 {
   Console c;
   c++;
-  if(fftw_init_threads() == 0)
+  if(fftw_init_threads() == 0 || fftwf_init_threads() == 0)
   {
     c += "There was a problem beginning the multithreading FFT engine.";
     return false;
@@ -42,14 +45,23 @@ bool FFTMultithread::Init(void)
   c += "Initializing multithreading FFT engine to make use of ";
   c &= (integer)NumCPUs;
   c &= " cores or CPUs in parallel for maximum performance.";
-  fftw_plan_with_nthreads(NumCPUs);
+  PlanWithThreads(NumCPUs);
+  Threads = NumCPUs;
   c++;
   return true;
 }
 
+void FFTMultithread::PlanWithThreads(int Threads)
+{
+  fftw_plan_with_nthreads(Threads);
+  fftwf_plan_with_nthreads(Threads);
+}
+
 void FFTMultithread::Cleanup(void)
 {
   fftw_cleanup_threads();
+  fftwf_cleanup_threads();
+  Threads = 0;
 }
 
 FFTMultithread::FFTMultithread()
@@ -75,7 +87,10 @@ void Wisdom::LoadWisdomFromCache(void)
     juce::PropertiesFile::createDefaultAppPropertiesFile(Name, Extension,
     Folder, false, -1, juce::PropertiesFile::storeAsXML);
   WisdomText = pf->getValue("Wisdom").toUTF8();
+  SingleWisdomText = pf->getValue("SingleWisdom").toUTF8();
   fftw_import_wisdom_from_string(WisdomText.Merge());
+  if(SingleWisdomText)
+    fftwf_import_wisdom_from_string(SingleWisdomText.Merge());
 }
 
 void Wisdom::SaveWisdomToCache(void)
@@ -84,9 +99,22 @@ void Wisdom::SaveWisdomToCache(void)
     juce::PropertiesFile::createDefaultAppPropertiesFile(Name, Extension,
     Folder, false, -1, juce::PropertiesFile::storeAsXML);
   pf->setValue("Wisdom", juce::String(WisdomText.Merge()));
+  pf->setValue("SingleWisdom", juce::String(SingleWisdomText.Merge()));
   pf->save();
 }
 
+void Wisdom::CheckpointWisdom(void)
+{
+  char* allwisdom = fftw_export_wisdom_to_string();
+  WisdomText = allwisdom;
+  free(allwisdom);
+  
+  char* singlewisdom = fftwf_export_wisdom_to_string();
+  SingleWisdomText = singlewisdom;
+  free(singlewisdom);
+  SaveWisdomToCache();
+}
+
 void Wisdom::AcquireWisdom(void)
 {
   Console c;
@@ -125,14 +153,15 @@ void Wisdom::AcquireWisdom(void)
         c &= " / "; c &= (integer)Limit; p++;
       AudioFFT afft;
       integer flops = afft.Initialize(i, FFTW_PATIENT, 5);
+      AudioFFTSingle safft;
+      safft.Initialize(i, FFTW_PATIENT, 5);
+      ComplexFFT cfft;
+      cfft.Initialize(i, FFTW_PATIENT, 5);
+      ComplexFFTSingle scfft;
+      scfft.Initialize(i, FFTW_PATIENT, 5);
       
       //Save wisdom now in case of crash...
-      {
-        char* allwisdom = fftw_export_wisdom_to_string();
-        WisdomText = allwisdom;
-        free(allwisdom);
-      }
-      SaveWisdomToCache();
+      CheckpointWisdom();
     }
   }
   
@@ -146,14 +175,15 @@ void Wisdom::AcquireWisdom(void)
         c &= " / "; c &= (integer)Limit; p++;
       AudioFFT afft;
       integer flops = afft.Initialize(i, FFTW_MEASURE, 30);
+      AudioFFTSingle safft;
+      safft.Initialize(i, FFTW_MEASURE, 30);
+      ComplexFFT cfft;
+      cfft.Initialize(i, FFTW_MEASURE, 30);
+      ComplexFFTSingle scfft;
+      scfft.Initialize(i, FFTW_MEASURE, 30);
       
       //Save wisdom now in case of crash...
-      {
-        char* allwisdom = fftw_export_wisdom_to_string();
-        WisdomText = allwisdom;
-        free(allwisdom);
-      }
-      SaveWisdomToCache();
+      CheckpointWisdom();
     }
   }
   
@@ -167,14 +197,15 @@ void Wisdom::AcquireWisdom(void)
         c &= " / "; c &= (integer)Limit; p++;
       AudioFFT afft;
       integer flops = afft.Initialize(i, FFTW_MEASURE, 60);
+      AudioFFTSingle safft;
+      safft.Initialize(i, FFTW_MEASURE, 60);
+      ComplexFFT cfft;
+      cfft.Initialize(i, FFTW_MEASURE, 60);
+      ComplexFFTSingle scfft;
+      scfft.Initialize(i, FFTW_MEASURE, 60);
       
       //Save wisdom now in case of crash...
-      {
-        char* allwisdom = fftw_export_wisdom_to_string();
-        WisdomText = allwisdom;
-        free(allwisdom);
-      }
-      SaveWisdomToCache();
+      CheckpointWisdom();
     }
   }
   
@@ -189,5 +220,13 @@ void Wisdom::AcquireWisdom(void)
 void Wisdom::ForgetWisdom(void)
 {
   WisdomText = "";
+  SingleWisdomText = "";
   SaveWisdomToCache();
+  GetFilterFolder().deleteRecursively();
+}
+
+juce::File Wisdom::GetFilterFolder(void)
+{
+  return juce::PropertiesFile::getDefaultAppSettingsFile(Name, Extension,
+    Folder, false).getSiblingFile("Filters");
 }
@@ -30,6 +30,16 @@
 
 struct FFTMultithread
 {
+  ///Threads that FFTW plans are made for (zero if not initialized).
+  static int Threads;
+  
+  /**Held while making or destroying plans, which FFTW does not allow on more
+  than one thread at a time (for example by the jobs of a batch).*/
+  static juce::CriticalSection PlanLock;
+  
+  ///Sets the threads of the plans made from here on, in both precisions.
+  static void PlanWithThreads(int Threads);
+  
   bool Init(void);
   void Cleanup(void);
   FFTMultithread();
@@ -41,9 +51,20 @@ struct Wisdom
   juce::String Name, Extension, Folder;
   prim::String WisdomText;
   
+  ///Wisdom of the single-precision (fftwf) plans, which FFTW keeps apart.
+  prim::String SingleWisdomText;
+  
   Wisdom();
   void LoadWisdomFromCache(void);
   void SaveWisdomToCache(void);
+  
+  ///Exports the wisdom of both precisions and saves it in case of a crash.
+  void CheckpointWisdom(void);
   void AcquireWisdom(void);
+  
+  ///Forgets the wisdom, and deletes the stored filters along with it.
   void ForgetWisdom(void);
+  
+  ///Returns the folder of the stored filters, next to the wisdom.
+  juce::File GetFilterFolder(void);
 };
@@ -0,0 +1,184 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#include "LibBrick.h"
+
+#include "StreamingResampler.h"
+
+#include <new>
+
+///The resampler behind the C interface, with its format.
+struct brick_resampler
+{
+  StreamingResampler Resampler;
+  bool Double;
+  bool Planar;
+  
+  ///Pushes input in the format of the resampler.
+  int64 Push(const void* Input, int64 Frames)
+  {
+    if(Double && Planar)
+      return Resampler.Push((const float64* const*)Input, Frames);
+    else if(Double)
+      return Resampler.Push((const float64*)Input, Frames);
+    else if(Planar)
+      return Resampler.Push((const float32* const*)Input, Frames);
+    return Resampler.Push((const float32*)Input, Frames);
+  }
+  
+  ///Pulls output in the format of the resampler.
+  int64 Pull(void* Output, int64 Frames)
+  {
+    if(Double && Planar)
+      return Resampler.Pull((float64* const*)Output, Frames);
+    else if(Double)
+      return Resampler.Pull((float64*)Output, Frames);
+    else if(Planar)
+      return Resampler.Pull((float32* const*)Output, Frames);
+    return Resampler.Pull((float32*)Output, Frames);
+  }
+  
+  ///Processes input and output in the format of the resampler.
+  int64 Process(const void* Input, int64 Frames, void* Output)
+  {
+    if(Double && Planar)
+      return Resampler.Process((const float64* const*)Input, Frames,
+        (float64* const*)Output);
+    else if(Double)
+      return Resampler.Process((const float64*)Input, Frames,
+        (float64*)Output);
+    else if(Planar)
+      return Resampler.Process((const float32* const*)Input, Frames,
+        (float32* const*)Output);
+    return Resampler.Process((const float32*)Input, Frames, (float32*)Output);
+  }
+  
+  ///Resamples a whole input in the format of the resampler.
+  int64 Resample(const void* Input, int64 Frames, void* Output, int64 Room)
+  {
+    if(Double && Planar)
+      return Resampler.Resample((const float64* const*)Input, Frames,
+        (float64* const*)Output, Room);
+    else if(Double)
+      return Resampler.Resample((const float64*)Input, Frames,
+        (float64*)Output, Room);
+    else if(Planar)
+      return Resampler.Resample((const float32* const*)Input, Frames,
+        (float32* const*)Output, Room);
+    return Resampler.Resample((const float32*)Input, Frames, (float32*)Output,
+      Room);
+  }
+};
+
+brick_resampler* brick_resampler_create(long long p, long long q, int channels,
+  int format, double bandwidth_loss, double attenuation)
+{
+  int Precision = format & ~BRICK_PLANAR;
+  if(Precision != BRICK_FLOAT32 && Precision != BRICK_FLOAT64)
+    return 0;
+  
+  //Allocation failures must not unwind into C.
+  brick_resampler* r = new (std::nothrow) brick_resampler;
+  if(!r)
+    return 0;
+  r->Double = (Precision == BRICK_FLOAT64);
+  r->Planar = ((format & BRICK_PLANAR) != 0);
+  try
+  {
+    if(r->Resampler.Initialize(p, q, channels, bandwidth_loss, attenuation))
+      return r;
+  }
+  catch(...) {}
+  delete r;
+  return 0;
+}
+
+void brick_resampler_destroy(brick_resampler* r)
+{
+  delete r;
+}
+
+long long brick_resampler_push(brick_resampler* r, const void* input,
+  long long frames)
+{
+  if(!r || !input || frames <= 0)
+    return 0;
+  return r->Push(input, frames);
+}
+
+long long brick_resampler_pull(brick_resampler* r, void* output,
+  long long frames)
+{
+  if(!r || !output || frames <= 0)
+    return 0;
+  return r->Pull(output, frames);
+}
+
+long long brick_resampler_process(brick_resampler* r, const void* input,
+  long long frames, void* output)
+{
+  if(!r || !input || !output || frames < 0)
+    return 0;
+  return r->Process(input, frames, output);
+}
+
+void brick_resampler_finish(brick_resampler* r)
+{
+  if(r)
+    r->Resampler.Finish();
+}
+
+void brick_resampler_reset(brick_resampler* r)
+{
+  if(r)
+    r->Resampler.Reset();
+}
+
+long long brick_resampler_max_output(brick_resampler* r, long long frames)
+{
+  return (r ? r->Resampler.MaxOutputFrames(frames) : 0);
+}
+
+long long brick_resampler_output_frames(brick_resampler* r, long long frames)
+{
+  return (r ? r->Resampler.OutputFrames(frames) : 0);
+}
+
+double brick_resampler_latency(brick_resampler* r)
+{
+  return (r ? r->Resampler.Latency() : 0.0);
+}
+
+long long brick_resample(brick_resampler* r, const void* input,
+  long long frames, void* output, long long output_frames)
+{
+  if(!r || !input || !output || frames <= 0 || output_frames <= 0)
+    return 0;
+  
+  return r->Resample(input, frames, output, output_frames);
+}
@@ -0,0 +1,115 @@
+/*
+  ==============================================================================
+
+   This file is part of Brick
+   Copyright 2010 by Andi
+   
+  ------------------------------------------------------------------------------
+
+   Brick can be redistributed and/or modified under the terms of
+   the GNU General Public License, as published by the
+   Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Brick is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Brick; if not, visit www.gnu.org/licenses or write:
+   
+   Free Software Foundation, Inc.
+   59 Temple Place, Suite 330,
+   Boston, MA 02111-1307 USA
+
+  ==============================================================================
+*/
+
+#ifndef LIBBRICK_H
+#define LIBBRICK_H
+
+/*The C interface of libbrick, for resampling audio in memory with the same
+Kaiser filter as Brick. The caller owns all of the buffers: input is read from
+them and output is written into them, without any files in between. Samples
+are single or double precision, and either interleaved (one buffer holding
+frame after frame) or planar (an array of one buffer for each channel).
+
+Typical use for a whole buffer:
+
+  brick_resampler* r = brick_resampler_create(48000, 44100, 2,
+    BRICK_FLOAT32 | BRICK_PLANAR, 0.001, 200.0);
+  long long n = brick_resampler_output_frames(r, frames);
+  ...allocate n frames of output for each channel...
+  brick_resample(r, input, frames, output, n);
+  brick_resampler_destroy(r);
+
+or for a stream, repeatedly pushing input and pulling output, and finishing
+with brick_resampler_finish and pulling the rest.*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*Sample formats, one of the precisions combined with BRICK_PLANAR for separate
+buffers for each channel.*/
+#define BRICK_FLOAT32 1
+#define BRICK_FLOAT64 2
+#define BRICK_PLANAR 256
+
+/*A resampler, which is only used by one thread at a time.*/
+typedef struct brick_resampler brick_resampler;
+
+/*Creates a resampler from a rate of q to a rate of p (such as 48000 and 44100)
+for the channels in the given format, with the allowable bandwidth loss as a
+fraction of the output Nyquist frequency (0.001 for 0.1%) and the stopband
+attenuation in decibels. Everything is allocated here, and never while
+resampling. Returns null if the arguments do not make sense or allocation
+fails.*/
+brick_resampler* brick_resampler_create(long long p, long long q, int channels,
+  int format, double bandwidth_loss, double attenuation);
+
+/*Frees the resampler.*/
+void brick_resampler_destroy(brick_resampler* r);
+
+/*Takes up to the given number of input frames and returns how many were taken.
+Fewer are taken while output is waiting to be pulled.*/
+long long brick_resampler_push(brick_resampler* r, const void* input,
+  long long frames);
+
+/*Writes up to the given number of output frames and returns how many.*/
+long long brick_resampler_pull(brick_resampler* r, void* output,
+  long long frames);
+
+/*Pushes all of the input and pulls all of the output it completes, returning
+the number of output frames. The output has room for at least
+brick_resampler_max_output(r, frames) frames.*/
+long long brick_resampler_process(brick_resampler* r, const void* input,
+  long long frames, void* output);
+
+/*Ends the input, after which pulling gives the rest of the output.*/
+void brick_resampler_finish(brick_resampler* r);
+
+/*Starts over with the same filter.*/
+void brick_resampler_reset(brick_resampler* r);
+
+/*Most output frames that brick_resampler_process gives for some input.*/
+long long brick_resampler_max_output(brick_resampler* r, long long frames);
+
+/*Output frames there are in total for some input, including the filter.*/
+long long brick_resampler_output_frames(brick_resampler* r, long long frames);
+
+/*Delay of the center of the filter in output frames.*/
+double brick_resampler_latency(brick_resampler* r);
+
+/*Resamples a whole buffer from the start, writing up to the given number of
+output frames, and returns how many were written. This is all of them if the
+output has room for brick_resampler_output_frames(r, frames).*/
+long long brick_resample(brick_resampler* r, const void* input,
+  long long frames, void* output, long long output_frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -32,71 +32,194 @@
 #include <fftw3.h>
 #include <cmath>
 
-void AudioFFT::Deinitialize(void)
+///Calls the FFTW interface of the precision of the sample type.
+template <class Sample> struct FFTW;
+
+template <> struct FFTW<double>
+{
+  typedef fftw_plan Plan;
+  typedef fftw_complex Complex;
+  
+  static void* Malloc(size_t n) {return fftw_malloc(n);}
+  static void Free(void* p) {fftw_free(p);}
+  static void SetTimeLimit(double t) {fftw_set_timelimit(t);}
+  static void Execute(Plan p) {fftw_execute(p);}
+  static void Destroy(Plan p) {fftw_destroy_plan(p);}
+  
+  static Plan TimeToFreq(int N, double* In, Complex* Out, int PlanType)
+  {
+    return fftw_plan_dft_r2c_1d(N, In, Out, PlanType);
+  }
+  
+  static Plan FreqToTime(int N, Complex* In, double* Out, int PlanType)
+  {
+    return fftw_plan_dft_c2r_1d(N, In, Out, PlanType);
+  }
+  
+  static Plan TimeToFreq(int* N, int Transforms, double* In, int InDistance,
+    Complex* Out, int OutDistance, int PlanType)
+  {
+    return fftw_plan_many_dft_r2c(1, N, Transforms, In, 0, 1, InDistance, Out,
+      0, 1, OutDistance, PlanType);
+  }
+  
+  static Plan FreqToTime(int* N, int Transforms, Complex* In, int InDistance,
+    double* Out, int OutDistance, int PlanType)
+  {
+    return fftw_plan_many_dft_c2r(1, N, Transforms, In, 0, 1, InDistance, Out,
+      0, 1, OutDistance, PlanType);
+  }
+  
+  static Plan Transform(int* N, int Transforms, Complex* Data, int Sign,
+    int PlanType)
+  {
+    return fftw_plan_many_dft(1, N, Transforms, Data, 0, 1, *N, Data, 0, 1, *N,
+      Sign, PlanType);
+  }
+  
+  static void Flops(Plan p, double* Add, double* Mul, double* FMA)
+  {
+    fftw_flops(p, Add, Mul, FMA);
+  }
+};
+
+template <> struct FFTW<float>
+{
+  typedef fftwf_plan Plan;
+  typedef fftwf_complex Complex;
+  
+  static void* Malloc(size_t n) {return fftwf_malloc(n);}
+  static void Free(void* p) {fftwf_free(p);}
+  static void SetTimeLimit(double t) {fftwf_set_timelimit(t);}
+  static void Execute(Plan p) {fftwf_execute(p);}
+  static void Destroy(Plan p) {fftwf_destroy_plan(p);}
+  
+  static Plan TimeToFreq(int N, float* In, Complex* Out, int PlanType)
+  {
+    return fftwf_plan_dft_r2c_1d(N, In, Out, PlanType);
+  }
+  
+  static Plan FreqToTime(int N, Complex* In, float* Out, int PlanType)
+  {
+    return fftwf_plan_dft_c2r_1d(N, In, Out, PlanType);
+  }
+  
+  static Plan TimeToFreq(int* N, int Transforms, float* In, int InDistance,
+    Complex* Out, int OutDistance, int PlanType)
+  {
+    return fftwf_plan_many_dft_r2c(1, N, Transforms, In, 0, 1, InDistance, Out,
+      0, 1, OutDistance, PlanType);
+  }
+  
+  static Plan FreqToTime(int* N, int Transforms, Complex* In, int InDistance,
+    float* Out, int OutDistance, int PlanType)
+  {
+    return fftwf_plan_many_dft_c2r(1, N, Transforms, In, 0, 1, InDistance, Out,
+      0, 1, OutDistance, PlanType);
+  }
+  
+  static Plan Transform(int* N, int Transforms, Complex* Data, int Sign,
+    int PlanType)
+  {
+    return fftwf_plan_many_dft(1, N, Transforms, Data, 0, 1, *N, Data, 0, 1, *N,
+      Sign, PlanType);
+  }
+  
+  static void Flops(Plan p, double* Add, double* Mul, double* FMA)
+  {
+    fftwf_flops(p, Add, Mul, FMA);
+  }
+};
+
+template <class Sample> void AudioFFTOf<Sample>::Deinitialize(void)
 {
+  typedef typename FFTW<Sample>::Plan Plan;
   if(PlanTimeToFreq)
   {
-    fftw_destroy_plan(*((fftw_plan*)PlanTimeToFreq));
-    fftw_destroy_plan(*((fftw_plan*)PlanFreqToTime));
+    FFTW<Sample>::Destroy(*((Plan*)PlanTimeToFreq));
+    FFTW<Sample>::Destroy(*((Plan*)PlanFreqToTime));
     
-    fftw_free((fftw_complex*)FreqDomain);
+    FFTW<Sample>::Free(FreqDomain);
     
     if((void*)TimeDomain != (void*)FreqDomain)
-      fftw_free((double*)TimeDomain);
+      FFTW<Sample>::Free(TimeDomain);
     
-    delete ((fftw_plan*)PlanTimeToFreq);
-    delete ((fftw_plan*)PlanFreqToTime);
+    delete ((Plan*)PlanTimeToFreq);
+    delete ((Plan*)PlanFreqToTime);
     PlanTimeToFreq = 0;
     PlanFreqToTime = 0;
   }
 }
 
-double AudioFFT::Initialize(int N, int PlanType, double PlanTime, bool InPlace)
+template <class Sample> double AudioFFTOf<Sample>::Initialize(int N,
+  int PlanType, double PlanTime, bool InPlace, int Transforms)
 {
   using namespace prim;
+  typedef typename FFTW<Sample>::Plan Plan;
+  typedef typename FFTW<Sample>::Complex Complex;
   
   //Wipe out any previous initialization.
   Deinitialize();
   
   //Get out of here if requested length is invalid.
-  if(N < 1)
+  if(N < 1 || Transforms < 1)
     return 0;
   N_TimeDomain = N;
   N_FreqDomain = N / 2 + 1;
+  N_Transforms = Transforms;
   
   //Allocate memory.
-  PlanTimeToFreq = (void*)new fftw_plan;
-  PlanFreqToTime = (void*)new fftw_plan;
+  PlanTimeToFreq = (void*)new Plan;
+  PlanFreqToTime = (void*)new Plan;
   
   //Create the freq domain array (which is slightly padded)
-  FreqDomain = (void*)fftw_malloc(sizeof(fftw_complex) * N_FreqDomain);
-  Memory::ClearArray((double*)FreqDomain, N_FreqDomain * 2);
+  FreqDomain = FFTW<Sample>::Malloc(sizeof(Complex) * N_FreqDomain *
+    N_Transforms);
+  Memory::ClearArray((Sample*)FreqDomain, N_FreqDomain * 2 * N_Transforms);
   
   //If in place, we reuse the FreqDomain for TimeDomain, else allocate an array.
   if(InPlace)
-    TimeDomain = (double*)FreqDomain;
+  {
+    TimeDomain = (Sample*)FreqDomain;
+    TimeDistance = N_FreqDomain * 2;
+  }
   else
   {
-    TimeDomain = (double*)fftw_malloc(sizeof(double) * N_TimeDomain);
-    Memory::ClearArray(TimeDomain, N_TimeDomain);
+    TimeDomain = (Sample*)FFTW<Sample>::Malloc(sizeof(Sample) * N_TimeDomain *
+      N_Transforms);
+    Memory::ClearArray(TimeDomain, N_TimeDomain * N_Transforms);
+    TimeDistance = N_TimeDomain;
   }
   
   //Set the amount of time to spend planning.
-  fftw_set_timelimit(PlanTime);
+  FFTW<Sample>::SetTimeLimit(PlanTime);
   
-  //Create the plan for time to frequency domain.
-  *((fftw_plan*)PlanTimeToFreq) = fftw_plan_dft_r2c_1d(N_TimeDomain,
-    TimeDomain, (fftw_complex*)FreqDomain, PlanType);
-    
-  /*Create the plan for frequency to time domain. N is given in terms of the
-  time-domain length (not frequency-domain, even though that is the input.*/
-  *((fftw_plan*)PlanFreqToTime) = fftw_plan_dft_c2r_1d(N_TimeDomain,
-    (fftw_complex*)FreqDomain, TimeDomain, PlanType);
+  if(N_Transforms == 1)
+  {
+    //Create the plan for time to frequency domain.
+    *((Plan*)PlanTimeToFreq) = FFTW<Sample>::TimeToFreq(N_TimeDomain,
+      TimeDomain, (Complex*)FreqDomain, PlanType);
+      
+    /*Create the plan for frequency to time domain. N is given in terms of the
+    time-domain length (not frequency-domain, even though that is the input.*/
+    *((Plan*)PlanFreqToTime) = FFTW<Sample>::FreqToTime(N_TimeDomain,
+      (Complex*)FreqDomain, TimeDomain, PlanType);
+  }
+  else
+  {
+    //Create the batched plans with each transform following the previous one.
+    *((Plan*)PlanTimeToFreq) = FFTW<Sample>::TimeToFreq(&N_TimeDomain,
+      N_Transforms, TimeDomain, TimeDistance, (Complex*)FreqDomain,
+      N_FreqDomain, PlanType);
+    *((Plan*)PlanFreqToTime) = FFTW<Sample>::FreqToTime(&N_TimeDomain,
+      N_Transforms, (Complex*)FreqDomain, N_FreqDomain, TimeDomain,
+      TimeDistance, PlanType);
+  }
   
   //Return number of flops needed.
   double mul1 = 0, add1 = 0, fma1 = 0, mul2 = 0, add2 = 0, fma2 = 0;
-  fftw_flops(*((fftw_plan*)PlanTimeToFreq), &add1, &mul1, &fma1);
-  fftw_flops(*((fftw_plan*)PlanFreqToTime), &add2, &mul2, &fma2);
+  FFTW<Sample>::Flops(*((Plan*)PlanTimeToFreq), &add1, &mul1, &fma1);
+  FFTW<Sample>::Flops(*((Plan*)PlanFreqToTime), &add2, &mul2, &fma2);
   return mul1 + add1 + mul2 + add2 + 2. * (fma1 + fma2);
   
   /*  
@@ -105,84 +228,176 @@ double AudioFFT::Initialize(int N, int PlanType, double PlanTime, bool InPlace)
   free(allwisdom);*/
 }
 
-void AudioFFT::TimeToFreqUnnormalized(void)
+template <class Sample> void AudioFFTOf<Sample>::TimeToFreqUnnormalized(void)
 {
   //Execute the time-to-freq FFTW plan.
-  fftw_execute(*((fftw_plan*)PlanTimeToFreq));
+  FFTW<Sample>::Execute(*((typename FFTW<Sample>::Plan*)PlanTimeToFreq));
 }
 
-void AudioFFT::TimeToFreq(void)
+template <class Sample> void AudioFFTOf<Sample>::TimeToFreq(void)
 {
   //First do the unnormalized forwards transform.
   TimeToFreqUnnormalized();
   
   ///Normalize the frequency domain by dividing out the FFT length.
-  double N_inv = 1.0 / (double)N_TimeDomain;
-  for(int i = 0; i < N_FreqDomain; i++)
-  {
-    double& re = ((fftw_complex*)FreqDomain)[i][0];
-    double& im = ((fftw_complex*)FreqDomain)[i][1];
-    re *= N_inv;
-    im *= N_inv;
-  }
+  Sample N_inv = (Sample)(1.0 / (double)N_TimeDomain);
+  Sample* Freq = (Sample*)FreqDomain;
+  for(int i = 0; i < N_FreqDomain * 2 * N_Transforms; i++)
+    Freq[i] *= N_inv;
 }
 
-void AudioFFT::FreqToTime(void)
+template <class Sample> void AudioFFTOf<Sample>::FreqToTime(void)
 {
   //Execute the freq-to-time FFTW plan.
-  fftw_execute(*((fftw_plan*)PlanFreqToTime));
+  FFTW<Sample>::Execute(*((typename FFTW<Sample>::Plan*)PlanFreqToTime));
 }
 
-double AudioFFT::FreqReal(int i)
+template <class Sample> Sample AudioFFTOf<Sample>::FreqReal(int i)
 {
-  return ((fftw_complex*)FreqDomain)[i][0];
+  return ((Sample*)FreqDomain)[i * 2];
 }
 
-void AudioFFT::FreqReal(int i, double Value)
+template <class Sample> void AudioFFTOf<Sample>::FreqReal(int i, Sample Value)
 {
-  ((fftw_complex*)FreqDomain)[i][0] = Value;
+  ((Sample*)FreqDomain)[i * 2] = Value;
 }
 
-double AudioFFT::FreqImag(int i)
+template <class Sample> Sample AudioFFTOf<Sample>::FreqImag(int i)
 {
-  return ((fftw_complex*)FreqDomain)[i][1];
+  return ((Sample*)FreqDomain)[i * 2 + 1];
 }
 
-void AudioFFT::FreqImag(int i, double Value)
+template <class Sample> void AudioFFTOf<Sample>::FreqImag(int i, Sample Value)
 {
-  ((fftw_complex*)FreqDomain)[i][1] = Value;
+  ((Sample*)FreqDomain)[i * 2 + 1] = Value;
 }
 
-double AudioFFT::Mag(int i)
+template <class Sample> double AudioFFTOf<Sample>::Mag(int i)
 {
   if(i >= 0 && i < N_FreqDomain)
   {
-    double re = ((fftw_complex*)FreqDomain)[i][0];
-    double im = ((fftw_complex*)FreqDomain)[i][1];
+    double re = FreqReal(i);
+    double im = FreqImag(i);
     return sqrt(re * re + im * im) * 2.0;
   }
   else
     return 0;    
 }
 
-double AudioFFT::Ang(int i)
+template <class Sample> double AudioFFTOf<Sample>::Ang(int i)
 {
   if(i >= 0 && i < N_FreqDomain)
   {
-    double re = ((fftw_complex*)FreqDomain)[i][0];
-    double im = ((fftw_complex*)FreqDomain)[i][1];
+    double re = FreqReal(i);
+    double im = FreqImag(i);
     return atan2(im, re);
   }
   else
     return 0;    
 }
 
-double* AudioFFT::GetTimeDomain(void)
+template <class Sample> Sample* AudioFFTOf<Sample>::GetTimeDomain(void)
 {
   return TimeDomain;
 }
 
-double* AudioFFT::GetFreqDomain(void)
+template <class Sample> Sample* AudioFFTOf<Sample>::GetFreqDomain(void)
+{
+  return (Sample*)FreqDomain;
+}
+
+template <class Sample> Sample* AudioFFTOf<Sample>::GetTimeDomain(
+  int Transform)
+{
+  return &TimeDomain[Transform * TimeDistance];
+}
+
+template <class Sample> Sample* AudioFFTOf<Sample>::GetFreqDomain(
+  int Transform)
+{
+  return &((Sample*)FreqDomain)[Transform * N_FreqDomain * 2];
+}
+
+template <class Sample> void ComplexFFTOf<Sample>::Deinitialize(void)
+{
+  typedef typename FFTW<Sample>::Plan Plan;
+  if(PlanTimeToFreq)
+  {
+    FFTW<Sample>::Destroy(*((Plan*)PlanTimeToFreq));
+    FFTW<Sample>::Destroy(*((Plan*)PlanFreqToTime));
+    FFTW<Sample>::Free(Data);
+    delete ((Plan*)PlanTimeToFreq);
+    delete ((Plan*)PlanFreqToTime);
+    PlanTimeToFreq = 0;
+    PlanFreqToTime = 0;
+    Data = 0;
+  }
+}
+
+template <class Sample> double ComplexFFTOf<Sample>::Initialize(int N,
+  int PlanType, double PlanTime, int Transforms)
+{
+  using namespace prim;
+  typedef typename FFTW<Sample>::Plan Plan;
+  typedef typename FFTW<Sample>::Complex Complex;
+  
+  //Wipe out any previous initialization.
+  Deinitialize();
+  
+  //Get out of here if requested length is invalid.
+  if(N < 1 || Transforms < 1)
+    return 0;
+  N_Values = N;
+  N_Transforms = Transforms;
+  
+  //Allocate memory.
+  PlanTimeToFreq = (void*)new Plan;
+  PlanFreqToTime = (void*)new Plan;
+  Data = (Sample*)FFTW<Sample>::Malloc(sizeof(Complex) * N_Values *
+    N_Transforms);
+  Memory::ClearArray(Data, N_Values * 2 * N_Transforms);
+  
+  //Set the amount of time to spend planning.
+  FFTW<Sample>::SetTimeLimit(PlanTime);
+  
+  //Create the plans, which work in place on each transform of the batch.
+  *((Plan*)PlanTimeToFreq) = FFTW<Sample>::Transform(&N_Values, N_Transforms,
+    (Complex*)Data, FFTW_FORWARD, PlanType);
+  *((Plan*)PlanFreqToTime) = FFTW<Sample>::Transform(&N_Values, N_Transforms,
+    (Complex*)Data, FFTW_BACKWARD, PlanType);
+  
+  //Return number of flops needed.
+  double mul1 = 0, add1 = 0, fma1 = 0, mul2 = 0, add2 = 0, fma2 = 0;
+  FFTW<Sample>::Flops(*((Plan*)PlanTimeToFreq), &add1, &mul1, &fma1);
+  FFTW<Sample>::Flops(*((Plan*)PlanFreqToTime), &add2, &mul2, &fma2);
+  return mul1 + add1 + mul2 + add2 + 2. * (fma1 + fma2);
+}
+
+template <class Sample> void ComplexFFTOf<Sample>::TimeToFreqUnnormalized(void)
+{
+  FFTW<Sample>::Execute(*((typename FFTW<Sample>::Plan*)PlanTimeToFreq));
+}
+
+template <class Sample> void ComplexFFTOf<Sample>::TimeToFreq(void)
+{
+  TimeToFreqUnnormalized();
+  Sample N_inv = (Sample)(1.0 / (double)N_Values);
+  for(int i = 0; i < N_Values * 2 * N_Transforms; i++)
+    Data[i] *= N_inv;
+}
+
+template <class Sample> void ComplexFFTOf<Sample>::FreqToTime(void)
+{
+  FFTW<Sample>::Execute(*((typename FFTW<Sample>::Plan*)PlanFreqToTime));
+}
+
+template <class Sample> Sample* ComplexFFTOf<Sample>::GetData(int Transform)
 {
-  return (double*)FreqDomain;
+  return &Data[Transform * N_Values * 2];
 }
+
+//The two precisions that FFTW provides.
+template class AudioFFTOf<double>;
+template class AudioFFTOf<float>;
+template class ComplexFFTOf<double>;
+template class ComplexFFTOf<float>;
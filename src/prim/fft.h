@@ -36,21 +36,29 @@ sudo make install
 Header: /usr/local/include
 Libraries: /usr/local/lib
 
-3) You need to link with fftw3 (-lfftw3)
+3) You need to link with fftw3 (-lfftw3), and for single precision with fftw3f
+(-lfftw3f).
 */
 
 #ifndef AUDIO_FFT
 #define AUDIO_FFT
 
-///Wrapper for FFTW (Fastest Fourier Transforms in the West)
-class AudioFFT
+/**Wrapper for FFTW (Fastest Fourier Transforms in the West) in the precision of
+the sample type, which is either double or float (the fftwf plans).*/
+template <class Sample> class AudioFFTOf
 {
   ///Length of the FFT.
   int N_TimeDomain;
   int N_FreqDomain;
+  
+  ///Number of transforms computed together by each plan.
+  int N_Transforms;
+  
+  ///Distance between consecutive transforms in the time domain.
+  int TimeDistance;
 
   ///The real-input time domain.
-  double* TimeDomain;
+  Sample* TimeDomain;
   
   //Note: Using void* below to isolate FFTW3.h to just fftw.cpp.
   
@@ -67,11 +75,12 @@ class AudioFFT
   public:
   
   ///Constructor zeroes out structure.
-  AudioFFT() : N_TimeDomain(0), N_FreqDomain(0), TimeDomain(0), FreqDomain(0),
-    PlanTimeToFreq(0), PlanFreqToTime(0) {}
+  AudioFFTOf() : N_TimeDomain(0), N_FreqDomain(0), N_Transforms(0),
+    TimeDistance(0), TimeDomain(0), FreqDomain(0), PlanTimeToFreq(0),
+    PlanFreqToTime(0) {}
   
   ///Destructor frees all data.
-  ~AudioFFT() {Deinitialize();}
+  ~AudioFFTOf() {Deinitialize();}
   
   ///Gets the length of the time domain portion of the FFT.
   inline int N_Time(void) {return N_TimeDomain;}
@@ -79,14 +88,20 @@ class AudioFFT
   ///Gets the length of the time domain portion of the FFT.
   inline int N_Freq(void) {return N_FreqDomain;}
   
+  ///Gets the number of transforms computed together.
+  inline int N_Batch(void) {return N_Transforms;}
+  
   /**Sets up the input and output arrays and makes FFTW plans. N is the length
   of the FFT, which does not need to be a power-of-two. PlanTime is the total
   amount of time to spend planning in seconds. (Actual plan time may exceed
   this if it is in the middle of testing an algorithm when the time is over.)
   Returns the number of flops (floating-point operations) needed. If InPlace is
   true, then the time domain and frequency domain will share the same memory
-  (and calling TimeToFreq or FreqToTime overwrites the other.)*/
-  double Initialize(int N, int PlanType, double PlanTime, bool InPlace = false);
+  (and calling TimeToFreq or FreqToTime overwrites the other.) If Transforms is
+  greater than one, then each plan computes that many transforms of separate
+  arrays in one batch, which are laid out one after the other.*/
+  double Initialize(int N, int PlanType, double PlanTime, bool InPlace = false,
+    int Transforms = 1);
   
   ///Calculates forwards transform and divides by the length of the FFT.
   void TimeToFreq(void);
@@ -102,22 +117,22 @@ class AudioFFT
   void FreqToTime(void);
   
   ///Gets the value in the time-domain at index i.
-  inline double Time(int i) {return TimeDomain[i];}
+  inline Sample Time(int i) {return TimeDomain[i];}
   
   ///Sets the value in the time-domain at index i.
-  inline void Time(int i, double Value) {TimeDomain[i] = Value;}
+  inline void Time(int i, Sample Value) {TimeDomain[i] = Value;}
   
   ///Gets the real value in the freq-domain at index i.
-  double FreqReal(int i);
+  Sample FreqReal(int i);
   
   ///Sets the real value in the freq-domain at index i.
-  void FreqReal(int i, double Value);
+  void FreqReal(int i, Sample Value);
     
   ///Gets the real value in the freq-domain at index i.
-  double FreqImag(int i);
+  Sample FreqImag(int i);
   
   ///Sets the real value in the freq-domain at index i.
-  void FreqImag(int i, double Value);
+  void FreqImag(int i, Sample Value);
   
   ///Gets the magnitude in the freq-domain at index i.
   double Mag(int i);
@@ -126,9 +141,81 @@ class AudioFFT
   double Ang(int i);
   
   ///Gets a pointer to the time domain data.
-  double* GetTimeDomain(void);
+  Sample* GetTimeDomain(void);
   
   ///Gets a pointer to the frequency domain data.
-  double* GetFreqDomain(void);
+  Sample* GetFreqDomain(void);
+  
+  ///Gets a pointer to the time domain data of one transform of the batch.
+  Sample* GetTimeDomain(int Transform);
+  
+  ///Gets a pointer to the frequency domain data of one transform of the batch.
+  Sample* GetFreqDomain(int Transform);
+};
+
+///Double-precision FFT.
+typedef AudioFFTOf<double> AudioFFT;
+
+///Single-precision FFT.
+typedef AudioFFTOf<float> AudioFFTSingle;
+
+/**In-place complex FFT of the sample type, with the real and imaginary parts
+of each value interleaved. Since the transform is linear, two real signals can
+be transformed at once as the real and imaginary parts of one complex signal.*/
+template <class Sample> class ComplexFFTOf
+{
+  ///Length of the FFT.
+  int N_Values;
+  
+  ///Number of transforms computed together by each plan.
+  int N_Transforms;
+  
+  ///The complex values, shared by the time and the frequency domain.
+  Sample* Data;
+  
+  ///The plans created using FFTW's wisdom feature.
+  void* PlanTimeToFreq;
+  void* PlanFreqToTime;
+  
+  ///Frees all data.
+  void Deinitialize(void);
+  
+  public:
+  
+  ///Constructor zeroes out structure.
+  ComplexFFTOf() : N_Values(0), N_Transforms(0), Data(0), PlanTimeToFreq(0),
+    PlanFreqToTime(0) {}
+  
+  ///Destructor frees all data.
+  ~ComplexFFTOf() {Deinitialize();}
+  
+  ///Gets the number of complex values in each domain.
+  inline int N(void) {return N_Values;}
+  
+  ///Gets the number of transforms computed together.
+  inline int N_Batch(void) {return N_Transforms;}
+  
+  /**Sets up the array and makes FFTW plans in the same way as AudioFFTOf, with
+  the transforms of a batch laid out one after the other. Returns the number of
+  flops needed.*/
+  double Initialize(int N, int PlanType, double PlanTime, int Transforms = 1);
+  
+  ///Calculates forwards transform and divides by the length of the FFT.
+  void TimeToFreq(void);
+  
+  ///Performs the forwards transform from time to frequency.
+  void TimeToFreqUnnormalized(void);
+  
+  ///Performs the unnormalized backwards transform from frequency to time.
+  void FreqToTime(void);
+  
+  ///Gets a pointer to the values of one transform of the batch.
+  Sample* GetData(int Transform = 0);
 };
+
+///Double-precision complex FFT.
+typedef ComplexFFTOf<double> ComplexFFT;
+
+///Single-precision complex FFT.
+typedef ComplexFFTOf<float> ComplexFFTSingle;
 #endif